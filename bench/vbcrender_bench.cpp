@@ -0,0 +1,561 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/// vbcrender_bench - Microbenchmarks of the stages of the rendering pipeline.
+///
+/// Every benchmark repeats its operation until the minimum measuring time has passed and
+/// reports the number of iterations, the number of items processed (lines, events,
+/// nodes or frames) and the time per item. Results are written as a JSON document so
+/// that runs on different revisions or machines can be compared by a script.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/device/file.hpp>
+#include <boost/iostreams/filter/bzip2.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/program_options.hpp>
+
+#include <cairo.h>
+#include <gst/gst.h>
+
+#include "EventStream.hpp"
+#include "Json.hpp"
+#include "Render.hpp"
+#include "Styles.hpp"
+#include "Tree.hpp"
+#include "VbcReader.hpp"
+#include "VideoOutput.hpp"
+
+namespace bfs = boost::filesystem;
+namespace bio = boost::iostreams;
+namespace po = boost::program_options;
+
+typedef std::chrono::steady_clock Clock;
+typedef std::chrono::duration<double> Seconds;
+
+
+/// Benchmark options
+struct BenchOptions {
+    std::string output_path;    ///< Path of JSON output ("-" for standard output).
+    std::string filter;         ///< Only run benchmarks whose name contains this string.
+    double      min_time;       ///< Minimum measuring time per benchmark in seconds.
+    double      scale;          ///< Factor applied to all problem sizes.
+    uint64_t    seed;           ///< Seed of generated inputs.
+};
+
+/// Measurement of a single benchmark
+struct BenchResult {
+    std::string name;           ///< Name of the benchmark.
+    std::string variant;        ///< Input or parameter variant.
+    size_t      iterations;     ///< Number of measured iterations.
+    uint64_t    items;          ///< Number of items processed in all iterations.
+    double      seconds;        ///< Total measured time in seconds.
+    double      min_seconds;    ///< Fastest iteration in seconds.
+};
+
+
+/// Runs and records benchmarks.
+class Bench {
+public:
+    /// Benchmark body; prepares its input, calls the timer around the measured part and returns the number of items.
+    typedef std::function<uint64_t(std::function<void(bool)>&)> Body;
+
+private:
+    const BenchOptions&         opts_;
+    std::vector<BenchResult>    results_;
+
+public:
+    explicit Bench(const BenchOptions& opts) : opts_(opts) {}
+
+    const BenchOptions& options() const { return opts_; }
+    const std::vector<BenchResult>& results() const { return results_; }
+
+    void run(const std::string& name, const std::string& variant, const Body& body);
+    void write_json(std::ostream& out) const;
+};
+
+
+void Bench::run(const std::string& name, const std::string& variant, const Body& body) {
+    const std::string full_name = name + "/" + variant;
+    if(!opts_.filter.empty() && full_name.find(opts_.filter) == std::string::npos) {
+        return;
+    }
+
+    BenchResult result { name, variant, 0, 0, 0.0, std::numeric_limits<double>::infinity() };
+
+    // The body starts and stops the timer itself so that setup is not measured
+    Clock::time_point start;
+    double elapsed = 0.0;
+    std::function<void(bool)> timer = [&start, &elapsed](bool running) {
+        if(running) {
+            start = Clock::now();
+        }
+        else {
+            elapsed = Seconds(Clock::now() - start).count();
+        }
+    };
+
+    while(result.iterations == 0 || result.seconds < opts_.min_time) {
+        elapsed = 0.0;
+        result.items += body(timer);
+        result.seconds += elapsed;
+        result.min_seconds = std::min(result.min_seconds, elapsed);
+        ++result.iterations;
+    }
+
+    std::cerr << "BENCH: " << full_name << ": " << result.iterations << " iterations, "
+              << (result.items ? 1e9 * result.seconds / result.items : 0.0) << " ns/item" << std::endl;
+    results_.push_back(result);
+}
+
+
+void Bench::write_json(std::ostream& out) const {
+    out << "{\"min_time\":" << json_number(opts_.min_time)
+        << ",\"scale\":" << json_number(opts_.scale)
+        << ",\"seed\":" << opts_.seed
+        << ",\"benchmarks\":[";
+    for(size_t i = 0; i < results_.size(); ++i) {
+        const BenchResult& r = results_[i];
+        out << (i ? "," : "") << "\n{\"name\":" << json_string(r.name)
+            << ",\"variant\":" << json_string(r.variant)
+            << ",\"iterations\":" << r.iterations
+            << ",\"items\":" << r.items
+            << ",\"seconds\":" << json_number(r.seconds)
+            << ",\"min_seconds\":" << json_number(r.min_seconds)
+            << ",\"ns_per_item\":" << json_number(r.items ? 1e9 * r.seconds / r.items : 0.0)
+            << ",\"items_per_second\":" << json_number(r.seconds > 0.0 ? r.items / r.seconds : 0.0)
+            << "}";
+    }
+    out << "\n]}" << std::endl;
+}
+
+
+/// Shapes of generated trees
+enum class Shape {
+    Deep,       ///< Single path.
+    Wide,       ///< Root with all other nodes as children.
+    Random      ///< Random recursive tree (parents chosen uniformly among existing nodes).
+};
+
+
+/// Returns the parent of every node 1..n (index 0 is unused).
+static std::vector<size_t> make_parents(size_t n, Shape shape, std::mt19937_64& rng) {
+    std::vector<size_t> parents(n + 1, 0);
+    for(size_t node = 2; node <= n; ++node) {
+        switch(shape) {
+        case Shape::Deep:
+            parents[node] = node - 1;
+            break;
+        case Shape::Wide:
+            parents[node] = 1;
+            break;
+        case Shape::Random:
+            parents[node] = 1 + rng() % (node - 1);
+            break;
+        }
+    }
+    return parents;
+}
+
+
+/// Builds a tree with the given parents and random categories.
+static TreePtr make_tree(const std::vector<size_t>& parents, std::mt19937_64& rng) {
+    TreePtr tree = std::make_shared<Tree>();
+    const size_t categories = tree->style().node_styles.size() - 1;
+    for(size_t node = 1; node < parents.size(); ++node) {
+        tree->add_node(node, parents[node], 1 + rng() % categories);
+    }
+    return tree;
+}
+
+
+/// Opcode mixes of generated VBC files
+enum class Mix {
+    Nodes,      ///< Node creation only.
+    Mixed,      ///< Node creation, category changes and bound updates.
+    Info        ///< Node creation with information strings.
+};
+
+
+/// Writes a VBC file and returns the number of event lines.
+static uint64_t write_vbc(const std::string& path, size_t nodes, Mix mix, std::mt19937_64& rng) {
+    bio::filtering_ostream out;
+    const std::string ext = bfs::extension(path);
+    if(ext == ".gz") {
+        out.push(bio::gzip_compressor());
+    }
+    else if(ext == ".bz2") {
+        out.push(bio::bzip2_compressor());
+    }
+    out.push(bio::file_sink(path, std::ios_base::out | std::ios_base::binary));
+
+    const size_t categories = StyleSheet::standard()->node_styles.size() - 1;
+    const std::vector<size_t> parents = make_parents(nodes, Shape::Random, rng);
+    uint64_t events = 0;
+    double lower = 0.0, upper = 1000.0;
+
+    out << "#TYPE: COMPLETE TREE\n#TIME: SET\n#BOUNDS: NONE\n#INFORMATION: STANDARD\n#NODE_NUMBER: NONE\n";
+    for(size_t node = 1; node <= nodes; ++node) {
+        const double time = 0.01 * node;
+        out << time << " N " << parents[node] << ' ' << node << ' ' << 1 + rng() % categories << '\n';
+        ++events;
+
+        if(mix == Mix::Mixed) {
+            out << time << " P " << 1 + rng() % node << ' ' << 1 + rng() % categories << '\n';
+            ++events;
+            if(node % 10 == 0) {
+                lower += 0.1 * (upper - lower);
+                out << time << " L " << lower << '\n';
+                ++events;
+            }
+        }
+        else if(mix == Mix::Info) {
+            out << time << " I " << node << " \\inode " << node << "\\i depth estimate " << rng() % 1000
+                << " objective " << (rng() % 1000000) / 1000.0 << " branching on x" << rng() % 10000 << '\n';
+            ++events;
+        }
+    }
+
+    return events;
+}
+
+
+/// Parsing of VBC files by the reader thread, per opcode mix and compression.
+static void bench_parse(Bench& bench, const bfs::path& dir) {
+    const char* mix_names[] = { "nodes", "mixed", "info" };
+    const char* extensions[] = { "", ".gz", ".bz2" };
+    const size_t nodes = size_t(200000 * bench.options().scale);
+
+    for(size_t m = 0; m < 3; ++m) {
+        for(const char* ext : extensions) {
+            std::mt19937_64 rng(bench.options().seed);
+            const std::string path = (dir / (std::string("parse-") + mix_names[m] + ".vbc" + ext)).string();
+            const uint64_t events = write_vbc(path, nodes, Mix(m), rng);
+
+            const std::string variant = std::string(mix_names[m]) + "/" + (*ext ? ext + 1 : "plain");
+            bench.run("parse", variant, [&path, events](std::function<void(bool)>& timer) {
+                // Nothing is applied, so the reader thread only parses; the end-of-stream event is counted as well
+                VbcReader reader(false, false);
+                timer(true);
+                reader.open(path);
+                uint64_t parsed = 0, last = 0;
+                Clock::time_point last_change = Clock::now();
+                while((parsed = reader.get_num_parsed()) < events + 1) {
+                    if(parsed != last) {
+                        last = parsed;
+                        last_change = Clock::now();
+                    }
+                    else if(Seconds(Clock::now() - last_change).count() > 5.0) {
+                        throw std::runtime_error("reader stalled while parsing " + path);
+                    }
+                    std::this_thread::yield();
+                }
+                timer(false);
+                reader.close();
+                return events;
+            });
+        }
+    }
+}
+
+
+/// Handoff of events from an in-process producer through the reader to the consumer.
+static void bench_handoff(Bench& bench) {
+    const size_t events = size_t(500000 * bench.options().scale);
+    const size_t capacities[] = { 1024, 65536 };
+
+    for(size_t capacity : capacities) {
+        bench.run("handoff", "ring" + std::to_string(capacity), [events, capacity](std::function<void(bool)>& timer) {
+            // Bound updates are the cheapest events to apply, so the queues dominate
+            EventStreamPtr stream = std::make_shared<EventStream>(capacity);
+            VbcReader reader(false, true);
+            reader.open(stream);
+
+            timer(true);
+            std::thread producer([stream, events]() {
+                for(size_t i = 0; i < events; ++i) {
+                    stream->set_bound(0.01 * i, BoundType::Lower, double(i));
+                }
+                stream->close();
+            });
+            uint64_t applied = 0;
+            while(true) {
+                if(!reader.has_next()) {
+                    reader.wait();
+                    continue;
+                }
+                if(reader.get_state() != VbcReader::Processing) {
+                    break;
+                }
+                reader.advance();
+                ++applied;
+            }
+            producer.join();
+            timer(false);
+            return applied;
+        });
+    }
+}
+
+
+/// Tree modification through add_node and set_category.
+static void bench_tree(Bench& bench) {
+    const size_t nodes = size_t(200000 * bench.options().scale);
+
+    bench.run("tree", "add_node", [&bench, nodes](std::function<void(bool)>& timer) {
+        std::mt19937_64 rng(bench.options().seed);
+        const std::vector<size_t> parents = make_parents(nodes, Shape::Random, rng);
+        TreePtr tree = std::make_shared<Tree>();
+        const size_t categories = tree->style().node_styles.size() - 1;
+
+        timer(true);
+        for(size_t node = 1; node <= nodes; ++node) {
+            tree->add_node(node, parents[node], 1 + node % categories);
+        }
+        timer(false);
+        return nodes;
+    });
+
+    bench.run("tree", "set_category", [&bench, nodes](std::function<void(bool)>& timer) {
+        std::mt19937_64 rng(bench.options().seed);
+        TreePtr tree = make_tree(make_parents(nodes, Shape::Random, rng), rng);
+        const size_t categories = tree->style().node_styles.size() - 1;
+        std::vector<size_t> targets(nodes);
+        for(size_t& node : targets) {
+            node = 1 + rng() % nodes;
+        }
+
+        timer(true);
+        for(size_t i = 0; i < nodes; ++i) {
+            tree->set_category(targets[i], 1 + i % categories);
+        }
+        timer(false);
+        return nodes;
+    });
+}
+
+
+/// Full and incremental layout of deep, wide and random trees.
+static void bench_layout(Bench& bench) {
+    const char* shape_names[] = { "deep", "wide", "random" };
+    const size_t sizes[] = {
+        size_t(10000 * bench.options().scale),      // Deep trees are limited by the recursion of node destruction
+        size_t(200000 * bench.options().scale),
+        size_t(200000 * bench.options().scale)
+    };
+
+    for(size_t s = 0; s < 3; ++s) {
+        std::mt19937_64 rng(bench.options().seed);
+        TreePtr tree = make_tree(make_parents(sizes[s], Shape(s), rng), rng);
+        const size_t nodes = sizes[s];
+
+        bench.run("layout", std::string(shape_names[s]) + "/full", [tree, nodes](std::function<void(bool)>& timer) {
+            tree->set_style(tree->style_sheet());
+            timer(true);
+            tree->update_layout();
+            timer(false);
+            return nodes;
+        });
+
+        bench.run("layout", std::string(shape_names[s]) + "/incremental", [tree, nodes, &rng](std::function<void(bool)>& timer) {
+            // Attach a leaf to a random node, then remove it again outside of the measurement
+            const size_t parent = 1 + rng() % nodes;
+            tree->add_node(nodes + 1, parent, 1);
+            timer(true);
+            tree->update_layout();
+            timer(false);
+            tree->remove_node(nodes + 1);
+            tree->update_layout();
+            return 1;
+        });
+    }
+}
+
+
+/// Drawing of random trees of increasing size onto a full HD surface.
+static void bench_draw(Bench& bench) {
+    const size_t sizes[] = { 1000, 10000, 100000 };
+    const Rect window { 10, 10, 1910, 1070 };
+    cairo_surface_t* surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, 1920, 1080);
+    cairo_t* canvas = cairo_create(surface);
+
+    for(size_t size : sizes) {
+        const size_t nodes = size_t(size * bench.options().scale);
+        std::mt19937_64 rng(bench.options().seed);
+        TreePtr tree = make_tree(make_parents(nodes, Shape::Random, rng), rng);
+        tree->update_layout();
+
+        bench.run("draw", std::to_string(size) + "/full", [canvas, surface, tree, nodes, &window](std::function<void(bool)>& timer) {
+            timer(true);
+            render_tree(canvas, tree, window, true, DetailLevel::Full);
+            cairo_surface_flush(surface);
+            timer(false);
+            return nodes;
+        });
+        bench.run("draw", std::to_string(size) + "/points", [canvas, surface, tree, nodes, &window](std::function<void(bool)>& timer) {
+            timer(true);
+            render_tree(canvas, tree, window, true, DetailLevel::Points);
+            cairo_surface_flush(surface);
+            timer(false);
+            return nodes;
+        });
+    }
+
+    cairo_destroy(canvas);
+    cairo_surface_destroy(surface);
+}
+
+
+/// Rendering, copying and pushing frames into a pipeline that discards them.
+static void bench_push_frame(Bench& bench) {
+    const std::pair<size_t, size_t> dims[] = { { 1280, 720 }, { 1920, 1080 }, { 3840, 2160 } };
+    const size_t frames = 30;
+
+    std::mt19937_64 rng(bench.options().seed);
+    TreePtr tree = make_tree(make_parents(1000, Shape::Random, rng), rng);
+
+    for(const auto& dim : dims) {
+        bench.run("push_frame", std::to_string(dim.first) + "x" + std::to_string(dim.second),
+                  [tree, dim, frames](std::function<void(bool)>& timer) {
+            VideoOutput output;
+            output.set_dim(dim.first, dim.second);
+            output.set_null_sink(true);
+            output.start();
+
+            timer(true);
+            for(size_t i = 0; i < frames; ++i) {
+                output.push_frame(tree);
+            }
+            timer(false);
+            output.stop();
+            return frames;
+        });
+    }
+}
+
+
+int parse_program_options(int argc, char** argv, BenchOptions& opts) {
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help,h", "produce help message")
+        (
+            "output,o",
+            po::value<std::string>(&opts.output_path)->default_value("-"),
+            "specify JSON output file (- for standard output)"
+        )(
+            "filter",
+            po::value<std::string>(&opts.filter),
+            "only run benchmarks whose name/variant contains this string"
+        )(
+            "min-time",
+            po::value<double>(&opts.min_time)->default_value(0.5, "0.5"),
+            "specify minimum measuring time per benchmark in seconds"
+        )(
+            "scale",
+            po::value<double>(&opts.scale)->default_value(1.0, "1"),
+            "specify factor applied to all problem sizes"
+        )(
+            "seed",
+            po::value<uint64_t>(&opts.seed)->default_value(1),
+            "specify seed of generated inputs"
+        )
+    ;
+
+    po::variables_map vm;
+    try {
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        po::notify(vm);
+    } catch(const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    if(vm.count("help")) {
+        std::cout << "Usage: vbcrender_bench [options]" << std::endl
+                  << desc << std::endl;
+        std::exit(0);
+    }
+
+    if(opts.min_time < 0.0 || !(opts.scale > 0.0)) {
+        std::cerr << "Error: minimum time must be non-negative and scale must be positive" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+
+int main(int argc, char** argv) {
+    gst_init(&argc, &argv);
+
+    BenchOptions opts;
+    if(parse_program_options(argc, argv, opts)) {
+        gst_deinit();
+        return 1;
+    }
+
+    // Generated input files are kept in a scratch directory
+    const bfs::path dir = bfs::temp_directory_path() / bfs::unique_path("vbcrender-bench-%%%%-%%%%");
+    int status = 0;
+    Bench bench(opts);
+    try {
+        bfs::create_directories(dir);
+        bench_parse(bench, dir);
+        bench_handoff(bench);
+        bench_tree(bench);
+        bench_layout(bench);
+        bench_draw(bench);
+        bench_push_frame(bench);
+    } catch(const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        status = 1;
+    }
+    boost::system::error_code ec;
+    bfs::remove_all(dir, ec);
+
+    // Write results of all completed benchmarks
+    if(opts.output_path == "-") {
+        bench.write_json(std::cout);
+    }
+    else {
+        std::ofstream out(opts.output_path);
+        bench.write_json(out);
+        if(!out) {
+            std::cerr << "Error: could not write " << opts.output_path << std::endl;
+            status = 1;
+        }
+    }
+
+    gst_deinit();
+    return status;
+}
@@ -0,0 +1,181 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+
+#include "Analysis.hpp"
+#include "Styles.hpp"
+#include "VbcReader.hpp"
+
+
+static const char columnar_magic[8] = { 'V', 'B', 'C', 'S', 'T', 'A', 'T', '1' };
+
+
+template<typename T>
+static void write_value(std::ostream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+
+AnalysisOptions::AnalysisOptions()
+    : interval(1.0),
+      columnar(false)
+{}
+
+
+TreeAnalysis::TreeAnalysis(const AnalysisOptions& options)
+    : options_(options),
+      abort_(nullptr),
+      rows_(0)
+{}
+
+
+void TreeAnalysis::write_header(const StyleSheet& style) {
+    names_ = { "time", "nodes", "leaves", "max_depth", "lower_bound", "upper_bound", "gap" };
+    for(size_t cat = 0; cat < style.node_styles.size(); ++cat) {
+        names_.push_back("category_" + std::to_string(cat));
+    }
+
+    if(options_.columnar) {
+        columns_.assign(names_.size(), std::vector<double>());
+    }
+    else {
+        for(size_t i = 0; i < names_.size(); ++i) {
+            out_ << (i ? "," : "") << names_[i];
+        }
+        out_ << '\n';
+    }
+}
+
+
+void TreeAnalysis::add_sample(double time, const Tree& tree) {
+    double row[7] = {
+        time,
+        double(tree.num_nodes()),
+        double(tree.num_leaves()),
+        double(tree.max_depth()),
+        tree.lower_bound(),
+        tree.upper_bound(),
+        tree.relative_gap()
+    };
+    ++rows_;
+
+    if(options_.columnar) {
+        for(size_t i = 0; i < names_.size(); ++i) {
+            columns_[i].push_back(i < 7 ? row[i] : double(tree.category_count(i - 7)));
+        }
+    }
+    else {
+        for(size_t i = 0; i < 7; ++i) {
+            out_ << (i ? "," : "") << row[i];
+        }
+        for(size_t cat = 0; cat + 7 < names_.size(); ++cat) {
+            out_ << ',' << tree.category_count(cat);
+        }
+        out_ << '\n';
+    }
+}
+
+
+void TreeAnalysis::write_columns() {
+    out_.write(columnar_magic, sizeof(columnar_magic));
+    write_value<uint64_t>(out_, names_.size());
+    write_value<uint64_t>(out_, rows_);
+    for(const std::string& name : names_) {
+        write_value<uint32_t>(out_, name.size());
+        out_.write(name.data(), name.size());
+    }
+    for(const std::vector<double>& column : columns_) {
+        out_.write(reinterpret_cast<const char*>(column.data()), column.size() * sizeof(double));
+    }
+}
+
+
+int TreeAnalysis::run() {
+    if(!(options_.interval > 0.0)) {
+        error_ = "sampling interval must be positive";
+        return 1;
+    }
+
+    out_.open(options_.output_path.c_str(), options_.columnar ? std::ios::binary | std::ios::trunc : std::ios::trunc);
+    if(!out_) {
+        error_ = "could not open " + options_.output_path;
+        return 1;
+    }
+    out_.precision(std::numeric_limits<double>::digits10);
+
+    VbcReaderPtr reader = std::make_shared<VbcReader>(false, true, options_.style);
+    reader->open(options_.input_path);
+    write_header(reader->get_tree()->style());
+
+    // Replay all events, sampling the tree before the first event past each sampling time
+    size_t next_index = 0;
+    double next_time = 0.0;
+    double last_time = -std::numeric_limits<double>::infinity();
+    while(!(abort_ && *abort_)) {
+        if(!reader->has_next()) {
+            reader->wait();
+        }
+
+        VbcReader::State state = reader->get_state();
+        if(state == VbcReader::Error) {
+            reader->advance();
+            error_ = "could not read VBC file";
+            break;
+        }
+        else if(state != VbcReader::Processing) {
+            break;
+        }
+        else if(!reader->has_next()) {
+            continue;
+        }
+
+        double timestamp = reader->get_next_timestamp();
+        while(timestamp > next_time) {
+            add_sample(next_time, *reader->get_tree());
+            last_time = next_time;
+            next_time = ++next_index * options_.interval;
+        }
+
+        if(!reader->advance()) {
+            error_ = "could not advance VBC state";
+            break;
+        }
+    }
+    reader->close();
+    if(error_.empty() && abort_ && *abort_) {
+        error_ = "interrupted";
+    }
+
+    // Sample the final state
+    if(error_.empty() && reader->get_timestamp() > last_time) {
+        add_sample(reader->get_timestamp(), *reader->get_tree());
+    }
+
+    if(options_.columnar) {
+        write_columns();
+    }
+    out_.close();
+    if(error_.empty() && !out_) {
+        error_ = "could not write " + options_.output_path;
+    }
+
+    return error_.empty() ? 0 : 1;
+}
@@ -0,0 +1,77 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VBC_ANALYSIS_HPP
+#define __VBC_ANALYSIS_HPP
+
+#include <atomic>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "Tree.hpp"
+
+/// Options of an analysis run.
+struct AnalysisOptions {
+    std::string input_path;                     ///< Path of VBC input file.
+    std::string output_path;                    ///< Path of statistics output file.
+    double interval;                            ///< Sampling interval in seconds of solver time.
+    bool columnar;                              ///< Write a binary columnar file instead of CSV.
+    StyleSheetPtr style;                        ///< Styles defining the categories (null for standard styles).
+
+    AnalysisOptions();
+};
+
+/// Replays a VBC file through the tree without layout or rendering and samples the tree
+/// statistics at fixed solver-time intervals.
+///
+/// Every sample holds the time, number of nodes and leaves, maximum depth, the bounds,
+/// the relative gap, and the number of nodes per category. CSV output is written row by
+/// row. The binary columnar file consists of the magic "VBCSTAT1", the number of columns
+/// and rows (uint64), the column names (uint32 length followed by the characters), and
+/// finally all values of each column in turn (native double). An interrupted run keeps
+/// the samples taken so far and fails.
+class TreeAnalysis {
+private:
+    AnalysisOptions                     options_;   ///< Options of this run.
+    const std::atomic_bool*             abort_;     ///< External flag requesting early termination.
+    std::string                         error_;     ///< Error message if the run failed.
+
+    std::ofstream                       out_;       ///< Output file.
+    std::vector<std::string>            names_;     ///< Column names.
+    std::vector<std::vector<double>>    columns_;   ///< Buffered columns (columnar output only).
+    size_t                              rows_;      ///< Number of samples taken.
+
+    void write_header(const StyleSheet& style);
+    void add_sample(double time, const Tree& tree);
+    void write_columns();
+
+public:
+    TreeAnalysis(const AnalysisOptions& options);
+    TreeAnalysis(const TreeAnalysis&) = delete;
+    TreeAnalysis(TreeAnalysis&&) = delete;
+
+    const std::string& get_error() const { return error_; }    ///< Returns the error message of a failed run.
+    size_t get_num_samples() const { return rows_; }            ///< Returns the number of samples taken.
+
+    void set_abort_flag(const std::atomic_bool* flag) { abort_ = flag; }
+
+    int run();                                  ///< Replays the input and returns a non-zero status on error or interruption.
+};
+
+#endif /* end of include guard: __VBC_ANALYSIS_HPP */
@@ -0,0 +1,387 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+#include <cairo.h>
+
+#include "Animation.hpp"
+#include "Event.hpp"
+#include "Render.hpp"
+#include "VbcReader.hpp"
+
+
+static const char animation_magic[8] = { 'V', 'B', 'C', 'A', 'N', 'I', 'M', '1' };
+
+
+template<typename T>
+static void write_value(std::ostream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+
+static void write_string(std::ostream& out, const std::string& str) {
+    write_value<uint32_t>(out, uint32_t(str.size()));
+    out.write(str.data(), str.size());
+}
+
+
+AnimationOptions::AnimationOptions()
+    : svg(false),
+      width(1920),
+      height(1080),
+      duration(60.0)
+{}
+
+
+TreeAnimation::TreeAnimation(const AnimationOptions& options)
+    : options_(options),
+      abort_(nullptr),
+      changes_ { { "time", 'd', {} }, { "seq", 'u', {} }, { "category", 'u', {} } },
+      bounds_ { { "time", 'd', {} }, { "which", 'u', {} }, { "value", 'd', {} } },
+      start_(0.0),
+      end_(0.0)
+{}
+
+
+void TreeAnimation::find_removals(const Tree& tree) {
+    const double never = std::numeric_limits<double>::quiet_NaN();
+
+    // Step 1: Time since which the category of each node has been hidden
+    std::vector<double> since(created_.size(), never);
+    std::vector<size_t> current(category_);
+    for(size_t seq = 0; seq < created_.size(); ++seq) {
+        if(created_[seq] >= 0 && !tree.category_visible(category_[seq])) {
+            since[seq] = created_[seq];
+        }
+    }
+    for(size_t i = 0; i < changes_[0].values.size(); ++i) {
+        size_t seq = size_t(changes_[1].values[i]);
+        size_t cat = size_t(changes_[2].values[i]);
+        if(seq >= created_.size() || created_[seq] < 0) {
+            continue;
+        }
+        bool hidden = !tree.category_visible(cat);
+        if(!hidden) {
+            since[seq] = never;
+        }
+        else if(tree.category_visible(current[seq])) {
+            since[seq] = changes_[0].values[i];
+        }
+        current[seq] = cat;
+    }
+
+    // Step 2: Nodes are removed with their first hidden ancestor, but not before creation
+    removed_.assign(created_.size(), never);
+    std::vector<bool> done(created_.size(), false);
+    std::vector<size_t> path;
+    for(size_t seq = 0; seq < created_.size(); ++seq) {
+        for(size_t at = seq; at < created_.size() && created_[at] >= 0 && !done[at]; at = parent_[at]) {
+            path.push_back(at);
+            done[at] = true;
+        }
+        while(!path.empty()) {
+            size_t at = path.back();
+            path.pop_back();
+            size_t parent = parent_[at];
+            double time = since[at];
+            if(parent != at && parent < created_.size() && created_[parent] >= 0 && !std::isnan(removed_[parent])) {
+                time = std::isnan(time) ? removed_[parent] : std::min(time, removed_[parent]);
+            }
+            removed_[at] = std::isnan(time) ? never : std::max(time, created_[at]);
+        }
+    }
+}
+
+
+void TreeAnimation::write_table(std::ostream& out, const std::string& name, const Table& table) {
+    write_string(out, name);
+    write_value<uint64_t>(out, table.size());
+    write_value<uint64_t>(out, table.empty() ? 0 : table.front().values.size());
+    for(const Column& column : table) {
+        write_string(out, column.name);
+        out.put(column.type);
+    }
+    for(const Column& column : table) {
+        for(double value : column.values) {
+            switch(column.type) {
+            case 'u':
+                write_value<uint32_t>(out, uint32_t(value));
+                break;
+            case 'f':
+                write_value<float>(out, float(value));
+                break;
+            default:
+                write_value<double>(out, value);
+                break;
+            }
+        }
+    }
+}
+
+
+void TreeAnimation::write_columnar(Tree& tree) {
+    const StyleSheet& sheet = tree.style();
+
+    // Nodes with final positions, including removed ones
+    Table nodes { { "seq", 'u', {} }, { "parent", 'u', {} }, { "created", 'd', {} }, { "removed", 'd', {} },
+                  { "category", 'u', {} }, { "x", 'd', {} }, { "y", 'd', {} } };
+    for(size_t seq = 0; seq < created_.size(); ++seq) {
+        NodePtr node;
+        if(created_[seq] < 0 || !(node = tree.node(seq))) {
+            continue;
+        }
+        nodes[0].values.push_back(double(seq));
+        nodes[1].values.push_back(double(parent_[seq]));
+        nodes[2].values.push_back(created_[seq]);
+        nodes[3].values.push_back(removed_[seq]);
+        nodes[4].values.push_back(double(category_[seq]));
+        nodes[5].values.push_back(node->x());
+        nodes[6].values.push_back(node->y());
+    }
+
+    Table styles { { "category", 'u', {} }, { "r", 'f', {} }, { "g", 'f', {} }, { "b", 'f', {} }, { "filled", 'u', {} }, { "circle", 'u', {} } };
+    for(size_t cat = 0; cat < sheet.node_styles.size(); ++cat) {
+        const NodeStyle& style = sheet.node_styles[cat];
+        styles[0].values.push_back(double(cat));
+        styles[1].values.push_back(style.node_color.r);
+        styles[2].values.push_back(style.node_color.g);
+        styles[3].values.push_back(style.node_color.b);
+        styles[4].values.push_back(style.draw_filled ? 1.0 : 0.0);
+        styles[5].values.push_back(style.draw_circle ? 1.0 : 0.0);
+    }
+
+    Rect bbox = tree.bounding_box();
+    Table layout { { "x0", 'd', { bbox.x0 } }, { "y0", 'd', { bbox.y0 } }, { "x1", 'd', { bbox.x1 } }, { "y1", 'd', { bbox.y1 } },
+                   { "node_radius", 'd', { sheet.node_radius } } };
+
+    std::ofstream out(options_.output_path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    out.write(animation_magic, sizeof(animation_magic));
+    write_value<uint64_t>(out, 5);
+    write_table(out, "nodes", nodes);
+    write_table(out, "categories", changes_);
+    write_table(out, "bounds", bounds_);
+    write_table(out, "styles", styles);
+    write_table(out, "layout", layout);
+    out.close();
+    if(!out) {
+        throw std::runtime_error("could not write " + options_.output_path);
+    }
+}
+
+
+void TreeAnimation::write_svg(Tree& tree) {
+    const StyleSheet& sheet = tree.style();
+    Rect window { 10, 10, Scalar(options_.width - 10), Scalar(options_.height - 10) };
+    cairo_matrix_t matrix = fit_matrix(tree, window);
+    const Scalar scale = matrix.xx;
+    const double span = end_ > start_ ? end_ - start_ : 1.0;
+
+    auto color = [](const Color& c) {
+        char str[8];
+        std::snprintf(str, sizeof(str), "#%02x%02x%02x", int(c.r * 255 + 0.5), int(c.g * 255 + 0.5), int(c.b * 255 + 0.5));
+        return std::string(str);
+    };
+    auto play_time = [this, span](double time) {
+        return std::max(0.0, (time - start_) / span * options_.duration);
+    };
+    auto hide = [this, &play_time](size_t seq) {
+        if(std::isnan(removed_[seq])) {
+            return std::string();
+        }
+        std::ostringstream set;
+        set << std::fixed << std::setprecision(2)
+            << "<set attributeName=\"visibility\" to=\"hidden\" begin=\"" << play_time(removed_[seq]) << "s\" fill=\"freeze\"/>";
+        return set.str();
+    };
+
+    std::ofstream out(options_.output_path.c_str(), std::ios::out | std::ios::trunc);
+    out << std::fixed << std::setprecision(2);
+    out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        << "<svg xmlns=\"http://www.w3.org/2000/svg\" xmlns:xlink=\"http://www.w3.org/1999/xlink\" "
+        << "width=\"" << options_.width << "\" height=\"" << options_.height << "\" viewBox=\"0 0 " << options_.width << ' ' << options_.height << "\">\n";
+
+    // Styles and markers in layout units
+    out << "<style>\n"
+        << ".e{fill:none;stroke:" << color(sheet.edge_styles[1].edge_color) << ";stroke-width:2}\n";
+    for(size_t cat = 0; cat < sheet.node_styles.size(); ++cat) {
+        const NodeStyle& style = sheet.node_styles[cat];
+        out << ".c" << cat << (style.draw_filled ? "{fill:" : "{fill:none;stroke-width:2;stroke:") << color(style.node_color) << "}\n";
+    }
+    out << "</style>\n<defs>\n";
+    for(size_t cat = 0; cat < sheet.node_styles.size(); ++cat) {
+        if(sheet.node_styles[cat].draw_circle) {
+            out << "<circle id=\"m" << cat << "\" r=\"" << sheet.node_radius << "\"/>\n";
+        }
+        else {
+            out << "<rect id=\"m" << cat << "\" x=\"" << -sheet.node_radius << "\" y=\"" << -sheet.node_radius
+                << "\" width=\"" << 2 * sheet.node_radius << "\" height=\"" << 2 * sheet.node_radius << "\"/>\n";
+        }
+    }
+    out << "</defs>\n"
+        << "<rect width=\"100%\" height=\"100%\" fill=\"" << color(sheet.background) << "\"/>\n"
+        << "<g transform=\"matrix(" << std::setprecision(6) << scale << " 0 0 " << scale << ' ' << matrix.x0 << ' ' << matrix.y0 << ")\">\n"
+        << std::setprecision(2);
+
+    // Edges appear with their child
+    out << "<g class=\"e\">\n";
+    for(size_t seq = 0; seq < created_.size(); ++seq) {
+        NodePtr node, parent;
+        if(created_[seq] < 0 || !(node = tree.node(seq)) || !(parent = node->parent())) {
+            continue;
+        }
+        out << "<path visibility=\"hidden\" d=\"M" << node->x() << ',' << node->y() << 'L' << parent->x() << ',' << parent->y() << "\">"
+            << "<set attributeName=\"visibility\" to=\"visible\" begin=\"" << play_time(created_[seq]) << "s\" fill=\"freeze\"/>"
+            << hide(seq) << "</path>\n";
+    }
+    out << "</g>\n";
+
+    // Nodes appear at creation, switch marker and class on category changes and disappear on removal
+    std::vector<std::vector<size_t>> changes(created_.size());
+    for(size_t i = 0; i < changes_[0].values.size(); ++i) {
+        size_t seq = size_t(changes_[1].values[i]);
+        if(seq < changes.size()) {
+            changes[seq].push_back(i);
+        }
+    }
+    for(size_t seq = 0; seq < created_.size(); ++seq) {
+        NodePtr node;
+        if(created_[seq] < 0 || !(node = tree.node(seq))) {
+            continue;
+        }
+        out << "<use visibility=\"hidden\" xlink:href=\"#m" << category_[seq] << "\" class=\"c" << category_[seq]
+            << "\" x=\"" << node->x() << "\" y=\"" << node->y() << "\">"
+            << "<set attributeName=\"visibility\" to=\"visible\" begin=\"" << play_time(created_[seq]) << "s\" fill=\"freeze\"/>";
+        for(size_t i : changes[seq]) {
+            double begin = play_time(changes_[0].values[i]);
+            size_t cat = size_t(changes_[2].values[i]);
+            out << "<set attributeName=\"xlink:href\" to=\"#m" << cat << "\" begin=\"" << begin << "s\" fill=\"freeze\"/>"
+                << "<set attributeName=\"class\" to=\"c" << cat << "\" begin=\"" << begin << "s\" fill=\"freeze\"/>";
+        }
+        out << hide(seq) << "</use>\n";
+    }
+    out << "</g>\n</svg>\n";
+
+    out.close();
+    if(!out) {
+        throw std::runtime_error("could not write " + options_.output_path);
+    }
+}
+
+
+int TreeAnimation::run() {
+    VbcReaderPtr reader = std::make_shared<VbcReader>(false, true, options_.style);
+    reader->open(options_.input_path);
+
+    bool first = true;
+    while(!(abort_ && *abort_)) {
+        if(!reader->has_next()) {
+            reader->wait();
+        }
+
+        VbcReader::State state = reader->get_state();
+        if(state == VbcReader::Error) {
+            reader->advance();
+            error_ = "could not read VBC file";
+            break;
+        }
+        else if(state != VbcReader::Processing) {
+            break;
+        }
+        else if(!reader->has_next()) {
+            continue;
+        }
+
+        // Record node creation, category changes and bound updates
+        double timestamp = reader->get_next_timestamp();
+        EventPtr event = reader->get_next_event();
+        if(first) {
+            start_ = timestamp;
+            first = false;
+        }
+        if(auto add = std::dynamic_pointer_cast<AddNodeEvent>(event)) {
+            size_t seq = add->get_node_seq();
+            if(created_.size() <= seq) {
+                created_.resize(seq + 1, -1.0);
+                parent_.resize(seq + 1, 0);
+                category_.resize(seq + 1, 0);
+            }
+            created_[seq] = timestamp;
+            parent_[seq] = add->get_parent_seq();
+            category_[seq] = add->get_category();
+        }
+        else if(auto change = std::dynamic_pointer_cast<SetCategoryEvent>(event)) {
+            changes_[0].values.push_back(timestamp);
+            changes_[1].values.push_back(double(change->get_node_seq()));
+            changes_[2].values.push_back(double(change->get_new_category()));
+        }
+        else if(auto bound = std::dynamic_pointer_cast<SetBoundEvent>(event)) {
+            bounds_[0].values.push_back(timestamp);
+            bounds_[1].values.push_back(bound->get_which() == BoundType::Lower ? 0.0 : 1.0);
+            bounds_[2].values.push_back(bound->get_bound());
+        }
+
+        if(!reader->advance()) {
+            error_ = "could not advance VBC state";
+            break;
+        }
+    }
+    reader->close();
+    end_ = reader->get_timestamp();
+
+    if(error_.empty() && abort_ && *abort_) {
+        error_ = "interrupted";
+    }
+    if(!error_.empty()) {
+        return 1;
+    }
+
+    // Record removals, then lay out the final tree once with all nodes and write the output
+    try {
+        TreePtr tree = reader->get_tree();
+        find_removals(*tree);
+        size_t categories = 0;
+        for(size_t cat : category_) {
+            categories = std::max(categories, cat + 1);
+        }
+        for(double cat : changes_[2].values) {
+            categories = std::max(categories, size_t(cat) + 1);
+        }
+        for(size_t cat = 0; cat < categories; ++cat) {
+            tree->set_category_visible(cat, true);
+        }
+        tree->update_layout();
+        if(options_.svg) {
+            write_svg(*tree);
+        }
+        else {
+            write_columnar(*tree);
+        }
+    } catch(const std::exception& err) {
+        error_ = err.what();
+    }
+
+    return error_.empty() ? 0 : 1;
+}
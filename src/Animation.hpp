@@ -0,0 +1,102 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VBC_ANIMATION_HPP
+#define __VBC_ANIMATION_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "Tree.hpp"
+
+/// Options of an animation export.
+struct AnimationOptions {
+    std::string input_path;                     ///< Path of VBC input file.
+    std::string output_path;                    ///< Path of animation output file.
+    bool svg;                                   ///< Write an animated SVG instead of the binary columnar file.
+    size_t width;                               ///< Width of the SVG drawing.
+    size_t height;                              ///< Height of the SVG drawing.
+    double duration;                            ///< Playback duration of the SVG animation in seconds.
+    StyleSheetPtr style;                        ///< Layout parameters and styles (null for standard styles).
+
+    AnimationOptions();
+};
+
+/// Derives a compact description of the whole run for client-side playback from the
+/// event stream and the final layout, without rendering any frames.
+///
+/// The binary columnar file starts with the magic "VBCANIM1" and the number of tables
+/// (uint64). Every table consists of its name (uint32 length followed by the characters),
+/// the number of columns and rows (uint64), the column names (uint32 length followed by
+/// the characters) and types (one character: 'u' uint32, 'f' float, 'd' double), and
+/// finally all values of each column in turn (native byte order). The tables are
+///   - nodes: seq, parent, created, removed, category, x, y (final layout, initial
+///     category; removed is the time a category filter hid the node, NaN if never),
+///   - categories: time, seq, category (category changes),
+///   - bounds: time, which (0 lower, 1 upper), value,
+///   - styles: category, r, g, b, filled, circle, and
+///   - layout: x0, y0, x1, y1, node_radius (bounding box of the final layout).
+///
+/// The final layout includes nodes of hidden categories so that they can be shown until
+/// they are removed. The SVG variant draws this layout and reveals edges and nodes at their
+/// creation time and hides them at their removal with SMIL animations, mapping the run onto
+/// the playback duration.
+class TreeAnimation {
+private:
+    /// Typed column of a table.
+    struct Column {
+        std::string             name;       ///< Column name.
+        char                    type;       ///< Value type ('u', 'f' or 'd').
+        std::vector<double>     values;     ///< Values.
+    };
+    typedef std::vector<Column> Table;
+
+    AnimationOptions                options_;   ///< Options of this run.
+    const std::atomic_bool*         abort_;     ///< External flag requesting early termination.
+    std::string                     error_;     ///< Error message if the run failed.
+
+    std::vector<double>             created_;   ///< Creation time by sequence number (negative if unused).
+    std::vector<size_t>             parent_;    ///< Parent by sequence number.
+    std::vector<size_t>             category_;  ///< Initial category by sequence number.
+    std::vector<double>             removed_;   ///< Removal time by sequence number (NaN if never removed).
+    Table                           changes_;   ///< Category changes.
+    Table                           bounds_;    ///< Bound updates.
+    double                          start_;     ///< Time of first event.
+    double                          end_;       ///< Time of last event.
+
+    void find_removals(const Tree& tree);
+    static void write_table(std::ostream& out, const std::string& name, const Table& table);
+    void write_columnar(Tree& tree);
+    void write_svg(Tree& tree);
+
+public:
+    TreeAnimation(const AnimationOptions& options);
+    TreeAnimation(const TreeAnimation&) = delete;
+    TreeAnimation(TreeAnimation&&) = delete;
+
+    const std::string& get_error() const { return error_; }    ///< Returns the error message of a failed run.
+
+    void set_abort_flag(const std::atomic_bool* flag) { abort_ = flag; }
+
+    int run();                                  ///< Replays the input and returns a non-zero status on error or interruption.
+};
+
+#endif /* end of include guard: __VBC_ANIMATION_HPP */
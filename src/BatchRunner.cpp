@@ -0,0 +1,189 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <iomanip>
+#include <thread>
+
+#include <boost/filesystem.hpp>
+
+#include "BatchRunner.hpp"
+#include "Scheduler.hpp"
+
+namespace bfs = boost::filesystem;
+
+
+BatchRunner::BatchRunner()
+    : max_jobs_(1),
+      budget_(Scheduler::instance().get_threads()),
+      abort_(nullptr),
+      log_(nullptr),
+      active_(0),
+      used_(0)
+{}
+
+
+size_t BatchRunner::min_threads(const RenderOptions& options) {
+    // One parser thread per input, the render loop and one encoder thread
+    return std::max<size_t>(1, options.input_paths.size()) + 2;
+}
+
+
+void BatchRunner::add_job(const RenderOptions& options) {
+    Entry entry;
+    entry.index = jobs_.size();
+    entry.options = options;
+    entry.size = 0;
+    entry.threads = 0;
+    entry.status = -1;
+    entry.result = RenderProgress();
+
+    // Estimate job size from the size of the input files
+    for(const std::string& path : options.input_paths) {
+        boost::system::error_code ec;
+        uintmax_t size = bfs::file_size(path, ec);
+        if(!ec) {
+            entry.size += size;
+        }
+    }
+
+    jobs_.push_back(entry);
+}
+
+
+void BatchRunner::work() {
+    while(true) {
+        Entry* entry;
+        size_t share;
+        {
+            std::unique_lock<std::mutex> lock(m_);
+            if(queue_.empty() || (abort_ && *abort_)) {
+                return;
+            }
+            entry = &jobs_[queue_.back()];
+            queue_.pop_back();
+
+            // Start once the job fits into the budget next to the running jobs (or runs alone)
+            const size_t needed = min_threads(entry->options);
+            cv_.wait(lock, [this, needed] { return !active_ || used_ + needed <= budget_; });
+            if(abort_ && *abort_) {
+                return;
+            }
+
+            // Share the rest of the budget with the jobs that will run concurrently from now on;
+            // each job needs one parser thread per input and a render thread, the rest goes to the encoder
+            size_t concurrent = std::min(max_jobs_, active_ + queue_.size() + 1);
+            size_t left = budget_ > used_ ? budget_ - used_ : 0;
+            share = std::max(needed, std::min(left, budget_ / concurrent));
+            entry->threads = share - needed + 1;
+            entry->options.encoder_threads = entry->threads;
+            used_ += share;
+            ++active_;
+
+            if(log_) {
+                *log_ << "BATCH: starting job " << entry->index + 1 << '/' << jobs_.size()
+                      << " (" << entry->options.output_path << ", "
+                      << entry->threads << " encoder threads)" << std::endl;
+            }
+        }
+
+        RenderJob job(entry->options);
+        job.set_abort_flag(abort_);
+        entry->status = job.run();
+        entry->result = job.get_result();
+        entry->error = job.get_error();
+
+        {
+            std::lock_guard<std::mutex> lock(m_);
+            --active_;
+            used_ -= share;
+            cv_.notify_all();
+
+            if(log_) {
+                *log_ << "BATCH: finished job " << entry->index + 1 << '/' << jobs_.size()
+                      << " (" << entry->options.output_path << "): "
+                      << (entry->status ? "failed" : "ok") << std::endl;
+            }
+        }
+    }
+}
+
+
+size_t BatchRunner::run() {
+    // Queue jobs such that the largest job is started first
+    queue_.clear();
+    for(const Entry& entry : jobs_) {
+        queue_.push_back(entry.index);
+    }
+    std::sort(queue_.begin(), queue_.end(), [this](size_t a, size_t b) {
+        return jobs_[a].size < jobs_[b].size || (jobs_[a].size == jobs_[b].size && a > b);
+    });
+
+    // Spawn one worker per job slot; the threads of each job count against the budget
+    std::vector<std::thread> workers;
+    size_t num_workers = std::max<size_t>(1, std::min(max_jobs_, jobs_.size()));
+    for(size_t i = 0; i < num_workers; ++i) {
+        workers.push_back(Scheduler::instance().spawn("batch job", [this] { work(); }, false));
+    }
+    for(std::thread& worker : workers) {
+        worker.join();
+    }
+
+    return std::count_if(jobs_.begin(), jobs_.end(), [](const Entry& entry) {
+        return entry.status != 0;
+    });
+}
+
+
+void BatchRunner::write_report(std::ostream& out) const {
+    const auto prec = out.precision();
+    out << std::setw(5) << "job" << ' '
+        << std::setw(7) << "status" << ' '
+        << std::setw(12) << "input_bytes" << ' '
+        << std::setw(7) << "threads" << ' '
+        << std::setw(10) << "frames" << ' '
+        << std::setw(12) << "stream_time" << ' '
+        << std::setw(10) << "runtime" << "  output\n";
+
+    size_t failed = 0;
+    double total_runtime = 0.0;
+    for(const Entry& entry : jobs_) {
+        const char* status = entry.status < 0 ? "skipped" : (entry.status ? "failed" : "ok");
+        out << std::setw(5) << entry.index + 1 << ' '
+            << std::setw(7) << status << ' '
+            << std::setw(12) << entry.size << ' '
+            << std::setw(7) << entry.threads << ' '
+            << std::setw(10) << entry.result.frames << ' '
+            << std::fixed << std::setprecision(2)
+            << std::setw(12) << entry.result.stream_time << ' '
+            << std::setw(10) << entry.result.runtime << "  "
+            << entry.options.output_path;
+        if(!entry.error.empty()) {
+            out << " (" << entry.error << ')';
+        }
+        out << '\n';
+
+        failed += entry.status != 0;
+        total_runtime += entry.result.runtime;
+    }
+
+    out << jobs_.size() << " jobs, " << failed << " failed or skipped, "
+        << std::setprecision(2) << total_runtime << " s total job runtime" << std::endl;
+    out.precision(prec);
+    out.unsetf(std::ios_base::floatfield);
+}
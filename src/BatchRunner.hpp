@@ -0,0 +1,79 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VBC_BATCH_RUNNER_HPP
+#define __VBC_BATCH_RUNNER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+#include "RenderJob.hpp"
+
+/// Runs a list of rendering jobs concurrently within a shared thread budget.
+class BatchRunner {
+public:
+    /// Bookkeeping for a single job of the batch.
+    struct Entry {
+        size_t          index;      ///< Position of the job in the job list.
+        RenderOptions   options;    ///< Options of the job.
+        uintmax_t       size;       ///< Total size of input files in bytes.
+        size_t          threads;    ///< Encoder threads assigned when the job was started.
+        int             status;     ///< Exit status of the job (-1 if it never ran).
+        RenderProgress  result;     ///< Progress at end of job.
+        std::string     error;      ///< Error message of a failed job.
+    };
+
+private:
+    std::vector<Entry>      jobs_;      ///< Jobs in the order they were added.
+    size_t                  max_jobs_;  ///< Maximum number of concurrently running jobs.
+    size_t                  budget_;    ///< Total number of threads shared by all running jobs.
+    const std::atomic_bool* abort_;     ///< External flag requesting early termination.
+    std::ostream*           log_;       ///< Stream receiving job start and completion messages.
+
+    std::mutex              m_;         ///< Mutex protecting the scheduling state.
+    std::condition_variable cv_;        ///< Signals finished jobs.
+    std::vector<size_t>     queue_;     ///< Indices of pending jobs, largest job last.
+    size_t                  active_;    ///< Number of currently running jobs.
+    size_t                  used_;      ///< Threads of the budget held by running jobs.
+
+    void work();
+
+public:
+    BatchRunner();
+    BatchRunner(const BatchRunner&) = delete;
+    BatchRunner(BatchRunner&&) = delete;
+
+    void add_job(const RenderOptions& options);
+    void set_max_jobs(size_t jobs) { max_jobs_ = jobs; }
+    void set_thread_budget(size_t threads) { budget_ = threads; }
+    void set_abort_flag(const std::atomic_bool* flag) { abort_ = flag; }
+    void set_log(std::ostream* log) { log_ = log; }
+
+    const std::vector<Entry>& get_jobs() const { return jobs_; }   ///< Returns all jobs with their results.
+
+    static size_t min_threads(const RenderOptions& options);   ///< Returns the number of threads a job needs at least.
+
+    size_t run();                               ///< Runs all jobs, largest first, and returns the number of failed jobs.
+    void write_report(std::ostream& out) const; ///< Writes a summary of all jobs.
+};
+
+#endif /* end of include guard: __VBC_BATCH_RUNNER_HPP */
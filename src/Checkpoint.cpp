@@ -0,0 +1,144 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <boost/filesystem.hpp>
+
+#include "Checkpoint.hpp"
+
+namespace bfs = boost::filesystem;
+
+
+static const char checkpoint_magic[8] = { 'V', 'B', 'C', 'C', 'K', 'P', 'T', '1' };
+
+
+template<typename T>
+static void write_value(std::ostream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+
+template<typename T>
+static T read_value(std::istream& in) {
+    T value;
+    if(!in.read(reinterpret_cast<char*>(&value), sizeof(T))) {
+        throw std::runtime_error("truncated checkpoint file");
+    }
+    return value;
+}
+
+
+static void write_string(std::ostream& out, const std::string& str) {
+    write_value<uint32_t>(out, uint32_t(str.size()));
+    out.write(str.data(), str.size());
+}
+
+
+static std::string read_string(std::istream& in) {
+    std::string str(read_value<uint32_t>(in), '\0');
+    if(!in.read(&str[0], str.size())) {
+        throw std::runtime_error("truncated checkpoint file");
+    }
+    return str;
+}
+
+
+void save_checkpoint(const std::string& path, const Checkpoint& ckpt, TreePtr tree) {
+    const std::string tmp_path = path + ".tmp";
+    std::ofstream out(tmp_path.c_str(), std::ios::binary | std::ios::trunc);
+
+    write_value(out, checkpoint_magic);
+    write_value<uint64_t>(out, ckpt.offset);
+    write_value<double>(out, ckpt.timestamp);
+    write_value<uint64_t>(out, ckpt.frame);
+    write_value<double>(out, tree->lower_bound());
+    write_value<double>(out, tree->upper_bound());
+
+    // Write nodes in pre-order so that parents precede their children
+    Tree::PreOrderIterator it(*tree);
+    const Tree::PreOrderIterator end(tree->children().end(), tree->children().end());
+    for(; it != end; ++it) {
+        const Node* node = it->get();
+        NodePtr parent = node->parent();
+
+        write_value<uint8_t>(out, 1);
+        write_value<uint64_t>(out, node->seq());
+        write_value<uint64_t>(out, parent ? parent->seq() : 0);
+        write_value<uint64_t>(out, node->category());
+        write_string(out, node->main_info());
+        write_string(out, node->general_info());
+    }
+    write_value<uint8_t>(out, 0);
+
+    out.close();
+    if(!out) {
+        throw std::runtime_error("could not write checkpoint file");
+    }
+    bfs::rename(tmp_path, path);
+}
+
+
+TreePtr load_checkpoint(const std::string& path, Checkpoint& ckpt, StyleSheetPtr style) {
+    std::ifstream in(path.c_str(), std::ios::binary);
+    if(!in) {
+        throw std::runtime_error("could not open checkpoint file");
+    }
+
+    char magic[sizeof(checkpoint_magic)];
+    if(!in.read(magic, sizeof(magic)) || std::memcmp(magic, checkpoint_magic, sizeof(magic))) {
+        throw std::runtime_error("not a checkpoint file");
+    }
+
+    TreePtr tree = std::make_shared<Tree>(style);
+    ckpt.offset = read_value<uint64_t>(in);
+    ckpt.timestamp = read_value<double>(in);
+    ckpt.frame = read_value<uint64_t>(in);
+    tree->set_lower_bound(read_value<double>(in));
+    tree->set_upper_bound(read_value<double>(in));
+
+    while(read_value<uint8_t>(in)) {
+        uint64_t seq = read_value<uint64_t>(in);
+        uint64_t parent = read_value<uint64_t>(in);
+        uint64_t category = read_value<uint64_t>(in);
+        std::string main_info = read_string(in);
+        std::string general_info = read_string(in);
+
+        tree->add_node(seq, parent, category);
+        if(!main_info.empty() || !general_info.empty()) {
+            tree->node(seq)->set_info(main_info, general_info);
+        }
+    }
+
+    return tree;
+}
+
+
+void write_file_atomic(const std::string& path, const std::string& contents) {
+    const std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream out(tmp_path.c_str(), std::ios::trunc);
+        out << contents;
+        if(!out) {
+            throw std::runtime_error("could not write " + path);
+        }
+    }
+    bfs::rename(tmp_path, path);
+}
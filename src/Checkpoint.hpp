@@ -0,0 +1,43 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VBC_CHECKPOINT_HPP
+#define __VBC_CHECKPOINT_HPP
+
+#include <cstdint>
+#include <string>
+
+#include "Tree.hpp"
+
+/// Position in the input and the video at which rendering can be resumed.
+struct Checkpoint {
+    uint64_t offset;            ///< Decompressed input offset after the last applied event.
+    double   timestamp;         ///< Timestamp of the last applied event.
+    uint64_t frame;             ///< Index of the next frame to be rendered.
+};
+
+/// Writes the checkpoint and tree state to a file. The file is replaced atomically.
+void save_checkpoint(const std::string& path, const Checkpoint& ckpt, TreePtr tree);
+
+/// Reads a checkpoint and reconstructs the tree state from a file (standard styles if none are given).
+TreePtr load_checkpoint(const std::string& path, Checkpoint& ckpt, StyleSheetPtr style = nullptr);
+
+/// Writes a small text file such that readers never observe partial contents.
+void write_file_atomic(const std::string& path, const std::string& contents);
+
+#endif /* end of include guard: __VBC_CHECKPOINT_HPP */
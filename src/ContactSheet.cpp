@@ -0,0 +1,331 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <stdexcept>
+
+#include <cairo.h>
+
+#include "ContactSheet.hpp"
+#include "Render.hpp"
+#include "VbcReader.hpp"
+
+/// Height of the time label below each thumbnail in pixels.
+static const size_t label_height = 14;
+
+/// Spacing of the first candidates when the end of the run is unknown.
+static const double initial_step = 1e-3;
+
+
+ContactSheetOptions::ContactSheetOptions()
+    : count(16),
+      columns(0),
+      width(1920),
+      height(1080),
+      start_timestamp(0.0),
+      stop_timestamp(std::numeric_limits<double>::infinity()),
+      threads(0)
+{}
+
+
+ContactSheet::Thumbnail::Thumbnail(double time, TreePtr tree)
+    : time(time),
+      tree(tree),
+      image(nullptr)
+{}
+
+
+ContactSheet::Thumbnail::~Thumbnail() {
+    if(image) {
+        cairo_surface_destroy(image);
+    }
+}
+
+
+ContactSheet::ContactSheet(const ContactSheetOptions& options)
+    : options_(options),
+      abort_(nullptr),
+      columns_(0),
+      rows_(0),
+      cell_w_(0),
+      cell_h_(0),
+      threads_(1),
+      running_(0)
+{}
+
+
+void ContactSheet::submit(const ThumbnailPtr& thumbnail) {
+    // Limit the number of tree copies waiting for a renderer, rendering queued ones while waiting
+    std::unique_lock<std::mutex> lock(m_);
+    while(queue_.size() >= 2 * threads_) {
+        lock.unlock();
+        if(!Scheduler::instance().run_one()) {
+            lock.lock();
+            cv_.wait_for(lock, std::chrono::milliseconds(1), [this] { return queue_.size() < 2 * threads_; });
+            continue;
+        }
+        lock.lock();
+    }
+
+    // Start another renderer unless enough are working off the queue
+    queue_.push_back(thumbnail);
+    if(running_ < threads_) {
+        ++running_;
+        renderers_.run([this] { render_thumbnails(); });
+    }
+}
+
+
+void ContactSheet::drop(const std::vector<ThumbnailPtr>& thumbnails) {
+    std::lock_guard<std::mutex> lock(m_);
+    for(const ThumbnailPtr& thumbnail : thumbnails) {
+        queue_.erase(std::remove(queue_.begin(), queue_.end(), thumbnail), queue_.end());
+    }
+    cv_.notify_all();
+}
+
+
+void ContactSheet::render_thumbnails() {
+    while(true) {
+        // Fetch oldest thumbnail until the queue runs dry
+        ThumbnailPtr thumbnail;
+        {
+            std::lock_guard<std::mutex> lock(m_);
+            if(queue_.empty()) {
+                --running_;
+                return;
+            }
+            thumbnail = queue_.front();
+            queue_.pop_front();
+            cv_.notify_all();
+        }
+
+        render_thumbnail(thumbnail);
+    }
+}
+
+
+void ContactSheet::render_thumbnail(const ThumbnailPtr& thumbnail) {
+    // Lay out and rasterize the tree copy
+    Rect window { 2, 2, Scalar(cell_w_ - 2), Scalar(cell_h_ - label_height) };
+    cairo_surface_t* image = cairo_image_surface_create(CAIRO_FORMAT_RGB24, (int)cell_w_, (int)cell_h_);
+    cairo_t* drawctx = cairo_create(image);
+    try {
+        render_tree(drawctx, thumbnail->tree, window);
+    } catch(const std::exception& err) {
+        std::lock_guard<std::mutex> lock(m_);
+        error_ = err.what();
+    }
+    cairo_destroy(drawctx);
+
+    thumbnail->image = image;
+    thumbnail->tree.reset();
+}
+
+
+void ContactSheet::write_sheet(const std::vector<ThumbnailPtr>& thumbnails, const StyleSheet& style) {
+    const Color& background = style.background;
+    cairo_surface_t* surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, (int)options_.width, (int)options_.height);
+    cairo_t* drawctx = cairo_create(surface);
+
+    cairo_set_source_rgb(drawctx, background.r, background.g, background.b);
+    cairo_paint(drawctx);
+
+    // Labels in gray contrasting with the background
+    double luma = 0.299 * background.r + 0.587 * background.g + 0.114 * background.b;
+    double gray = luma > 0.5 ? 0.25 : 0.75;
+    cairo_select_font_face(drawctx, "sans-serif", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+    cairo_set_font_size(drawctx, label_height - 4);
+
+    for(size_t i = 0; i < thumbnails.size(); ++i) {
+        double x = double((i % columns_) * cell_w_);
+        double y = double((i / columns_) * cell_h_);
+
+        cairo_set_source_surface(drawctx, thumbnails[i]->image, x, y);
+        cairo_rectangle(drawctx, x, y, double(cell_w_), double(cell_h_));
+        cairo_fill(drawctx);
+
+        double time = thumbnails[i]->time;
+        char label[32];
+        std::snprintf(label, sizeof(label), "%d:%02d:%05.2f",
+                      int(time / 3600), int(std::fmod(time, 3600.0) / 60), std::fmod(time, 60.0));
+        cairo_set_source_rgb(drawctx, gray, gray, gray);
+        cairo_move_to(drawctx, x + 4, y + double(cell_h_) - 4);
+        cairo_show_text(drawctx, label);
+    }
+    cairo_destroy(drawctx);
+
+    cairo_status_t status = cairo_surface_write_to_png(surface, options_.output_path.c_str());
+    cairo_surface_destroy(surface);
+    if(status != CAIRO_STATUS_SUCCESS) {
+        throw std::runtime_error("could not write " + options_.output_path + ": " + cairo_status_to_string(status));
+    }
+}
+
+
+int ContactSheet::run() {
+    const size_t count = options_.count;
+    const double start = options_.start_timestamp;
+    const bool fixed = std::isfinite(options_.stop_timestamp);
+
+    // Determine grid
+    if(!count) {
+        error_ = "expected at least one thumbnail";
+        return 1;
+    }
+    columns_ = options_.columns ? std::min(options_.columns, count) : size_t(std::ceil(std::sqrt(double(count))));
+    rows_ = (count + columns_ - 1) / columns_;
+    cell_w_ = options_.width / columns_;
+    cell_h_ = options_.height / rows_;
+    if(cell_w_ < 4 * label_height || cell_h_ < 4 * label_height) {
+        error_ = "sheet is too small for the number of thumbnails";
+        return 1;
+    }
+
+    // Render up to the given number of thumbnails at once, queueing two tree copies per renderer
+    threads_ = options_.threads ? options_.threads : Scheduler::instance().get_threads();
+
+    // Sample times are start + k * step; without a known end the candidates are thinned
+    // to every other one and the step doubled whenever the capacity is reached
+    const size_t capacity = fixed ? count : 4 * count;
+    double step = fixed ? (options_.stop_timestamp - start) / count : initial_step;
+    std::vector<ThumbnailPtr> candidates;
+    double next_time = start + step;
+
+    // The replay loop counts against the thread budget
+    BusyScope busy;
+
+    VbcReaderPtr reader = std::make_shared<VbcReader>(false, true, options_.style);
+    reader->open(options_.input_path);
+
+    std::string error;
+    while(!(abort_ && *abort_)) {
+        if(!reader->has_next()) {
+            reader->wait();
+        }
+
+        VbcReader::State state = reader->get_state();
+        if(state == VbcReader::Error) {
+            reader->advance();
+            error = "could not read VBC file";
+            break;
+        }
+        else if(state != VbcReader::Processing) {
+            break;
+        }
+        else if(!reader->has_next()) {
+            continue;
+        }
+
+        double timestamp = reader->get_next_timestamp();
+        if(fixed && timestamp > options_.stop_timestamp) {
+            break;
+        }
+        while(timestamp > next_time && candidates.size() < capacity) {
+            // Copy the tree before waiting for room in the render queue
+            candidates.push_back(std::make_shared<Thumbnail>(next_time, reader->get_tree()->clone()));
+            submit(candidates.back());
+            if(!fixed && candidates.size() == capacity) {
+                std::vector<ThumbnailPtr> thinned;
+                for(size_t i = 0; i < capacity; i += 2) {
+                    thinned.push_back(candidates[i]);
+                    candidates[i / 2] = candidates[i + 1];
+                }
+                drop(thinned);
+                candidates.resize(capacity / 2);
+                step *= 2;
+            }
+            next_time = start + step * double(candidates.size() + 1);
+        }
+
+        if(!reader->advance()) {
+            error = "could not advance VBC state";
+            break;
+        }
+    }
+
+    // Sample the final state
+    std::vector<ThumbnailPtr> thumbnails;
+    if(error.empty() && !(abort_ && *abort_)) {
+        if(fixed) {
+            while(candidates.size() < count) {
+                candidates.push_back(std::make_shared<Thumbnail>(next_time, reader->get_tree()->clone()));
+                submit(candidates.back());
+                next_time = start + step * double(candidates.size() + 1);
+            }
+            thumbnails = candidates;
+        }
+        else {
+            double end = std::max(start, reader->get_timestamp());
+            ThumbnailPtr last = std::make_shared<Thumbnail>(end, reader->get_tree()->clone());
+            submit(last);
+
+            // Place the candidates closest to an even spacing of the actual run
+            for(size_t k = 1; k < count; ++k) {
+                double target = start + (end - start) * double(k) / double(count);
+                ThumbnailPtr best = last;
+                for(const ThumbnailPtr& candidate : candidates) {
+                    if(std::fabs(candidate->time - target) < std::fabs(best->time - target)) {
+                        best = candidate;
+                    }
+                }
+                thumbnails.push_back(best);
+            }
+            thumbnails.push_back(last);
+
+            // Skip candidates that did not make it onto the sheet
+            std::vector<ThumbnailPtr> unused;
+            for(const ThumbnailPtr& candidate : candidates) {
+                if(std::find(thumbnails.begin(), thumbnails.end(), candidate) == thumbnails.end()) {
+                    unused.push_back(candidate);
+                }
+            }
+            drop(unused);
+        }
+    }
+    reader->close();
+
+    // Wait for renderers
+    if(thumbnails.empty()) {
+        std::lock_guard<std::mutex> lock(m_);
+        queue_.clear();
+    }
+    renderers_.wait();
+
+    if(!error.empty()) {
+        error_ = error;
+    }
+    else if(abort_ && *abort_) {
+        error_ = "interrupted";
+    }
+    if(!error_.empty()) {
+        return 1;
+    }
+
+    try {
+        write_sheet(thumbnails, reader->get_tree()->style());
+    } catch(const std::exception& err) {
+        error_ = err.what();
+    }
+
+    return error_.empty() ? 0 : 1;
+}
@@ -0,0 +1,106 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VBC_CONTACT_SHEET_HPP
+#define __VBC_CONTACT_SHEET_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Scheduler.hpp"
+#include "Tree.hpp"
+
+/// Options of a contact sheet.
+struct ContactSheetOptions {
+    std::string input_path;                     ///< Path of VBC input file.
+    std::string output_path;                    ///< Path of PNG output file.
+    size_t count;                               ///< Number of thumbnails.
+    size_t columns;                             ///< Number of grid columns (0 for a square grid).
+    size_t width;                               ///< Width of the sheet in pixels.
+    size_t height;                              ///< Height of the sheet in pixels.
+    double start_timestamp;                     ///< Solver time of the beginning of the sheet.
+    double stop_timestamp;                      ///< Solver time of the end of the sheet (infinity for end of input).
+    size_t threads;                             ///< Maximum number of thumbnails rendered at once (0 for the scheduler's thread budget).
+    StyleSheetPtr style;                        ///< Layout parameters and styles (null for standard styles).
+
+    ContactSheetOptions();
+};
+
+/// Renders a grid of thumbnails of the tree evenly spaced over the solver run.
+///
+/// The input is replayed once. At each sample point the tree is copied and handed to the
+/// scheduler, whose workers lay out and rasterize the thumbnails concurrently. Unless the
+/// end of the sheet is given, the length of the run is unknown during replay: the tree is
+/// then sampled at up to four times the number of thumbnails, halving the sampling rate
+/// whenever the candidates are used up, and the candidates closest to the final spacing are
+/// placed on the sheet. Candidates are rendered right away; thinned ones that still wait for
+/// a renderer are dropped, so that only the queued tree copies and the rendered thumbnails
+/// stay in memory. Each thumbnail is labeled with the solver time it shows.
+class ContactSheet {
+private:
+    /// Sampled tree state and its thumbnail.
+    struct Thumbnail {
+        double              time;       ///< Solver time of the tree state.
+        TreePtr             tree;       ///< Copy of the tree state (released once rendered).
+        cairo_surface_t*    image;      ///< Rendered thumbnail (null until rendered).
+
+        Thumbnail(double time, TreePtr tree);
+        ~Thumbnail();
+    };
+    typedef std::shared_ptr<Thumbnail> ThumbnailPtr;
+
+    ContactSheetOptions         options_;   ///< Options of this run.
+    const std::atomic_bool*     abort_;     ///< External flag requesting early termination.
+    std::string                 error_;     ///< Error message if the run failed.
+
+    size_t                      columns_;   ///< Number of grid columns.
+    size_t                      rows_;      ///< Number of grid rows.
+    size_t                      cell_w_;    ///< Width of a grid cell in pixels.
+    size_t                      cell_h_;    ///< Height of a grid cell in pixels.
+
+    std::mutex                  m_;         ///< Mutex protecting the render queue and error.
+    std::condition_variable     cv_;        ///< Signals changes of the render queue.
+    std::deque<ThumbnailPtr>    queue_;     ///< Thumbnails waiting to be rendered.
+    size_t                      threads_;   ///< Maximum number of render tasks.
+    size_t                      running_;   ///< Number of started render tasks.
+    TaskGroup                   renderers_; ///< Render tasks working off the queue.
+
+    void submit(const ThumbnailPtr& thumbnail);
+    void drop(const std::vector<ThumbnailPtr>& thumbnails);
+    void render_thumbnails();
+    void render_thumbnail(const ThumbnailPtr& thumbnail);
+    void write_sheet(const std::vector<ThumbnailPtr>& thumbnails, const StyleSheet& style);
+
+public:
+    ContactSheet(const ContactSheetOptions& options);
+    ContactSheet(const ContactSheet&) = delete;
+    ContactSheet(ContactSheet&&) = delete;
+
+    const std::string& get_error() const { return error_; }    ///< Returns the error message of a failed run.
+
+    void set_abort_flag(const std::atomic_bool* flag) { abort_ = flag; }
+
+    int run();                                  ///< Renders the sheet and returns a non-zero status on error or interruption.
+};
+
+#endif /* end of include guard: __VBC_CONTACT_SHEET_HPP */
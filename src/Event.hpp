@@ -19,6 +19,7 @@
 #ifndef __VBC_EVENT_HPP
 #define __VBC_EVENT_HPP
 
+#include <cstdint>
 #include <memory>
 
 #include "Tree.hpp"
@@ -33,14 +34,17 @@ class Event {
 private:
     const size_t seq_num;
     const double time;
+    uint64_t offset;            ///< Input offset after the line that produced the event.
 
 public:
-    Event(size_t seq, double time) : seq_num(seq), time(time) {}
+    Event(size_t seq, double time) : seq_num(seq), time(time), offset(0) {}
     Event(const Event&) = delete;
     Event(Event&&) = delete;
 
     size_t get_seq_num() const { return seq_num; }
     double get_time() const { return time; }
+    uint64_t get_offset() const { return offset; }
+    void set_offset(uint64_t off) { offset = off; }
 
     virtual void apply(TreePtr tree) = 0;
     virtual void revert(TreePtr tree) = 0;
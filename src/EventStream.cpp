@@ -0,0 +1,165 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdexcept>
+
+#include "EventStream.hpp"
+#include "VbcReader.hpp"
+
+
+/// Rounds the ring capacity up to the next power of two.
+static size_t ring_capacity(size_t capacity) {
+    if(capacity == 0) {
+        throw std::invalid_argument("event stream capacity must be positive");
+    }
+
+    size_t result = 1;
+    while(result < capacity) {
+        result <<= 1;
+    }
+    return result;
+}
+
+
+EventStream::EventStream(size_t capacity)
+    : slots_(ring_capacity(capacity)),
+      mask_(slots_.size() - 1),
+      seq_(0),
+      head_(0),
+      tail_(0),
+      closed_(false),
+      abandoned_(false),
+      attached_(false),
+      waiters_(0)
+{}
+
+
+void EventStream::wake() {
+    // Pairs with the fence of a thread about to sleep, so either it sees the change or it is woken
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(waiters_.load(std::memory_order_relaxed)) {
+        {
+            std::lock_guard<std::mutex> lock(wait_m_);
+        }
+        wait_cv_.notify_all();
+    }
+}
+
+
+bool EventStream::push(EventPtr event) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+
+    // Sleep until the reader frees a slot
+    if(tail - head_.load(std::memory_order_acquire) == slots_.size()) {
+        std::unique_lock<std::mutex> lock(wait_m_);
+        ++waiters_;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        wait_cv_.wait(lock, [this, tail] {
+            return tail - head_.load(std::memory_order_acquire) < slots_.size() || abandoned_.load(std::memory_order_acquire);
+        });
+        --waiters_;
+    }
+    if(closed_.load(std::memory_order_relaxed) || abandoned_.load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    // Publish the event to the reader
+    slots_[tail & mask_] = std::move(event);
+    tail_.store(tail + 1, std::memory_order_release);
+    wake();
+    return true;
+}
+
+
+EventPtr EventStream::pop() {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if(head == tail_.load(std::memory_order_acquire)) {
+        return nullptr;
+    }
+
+    // Move the event out so the slot does not keep it alive
+    EventPtr event = std::move(slots_[head & mask_]);
+    head_.store(head + 1, std::memory_order_release);
+    wake();
+    return event;
+}
+
+
+EventPtr EventStream::wait_pop() {
+    while(true) {
+        // Check for the end first so that events pushed before close() are still taken
+        const bool closed = is_closed();
+        EventPtr event = pop();
+        if(event || closed || abandoned_.load(std::memory_order_acquire)) {
+            return event;
+        }
+
+        // Sleep until the solver pushes, closes or the reader stops
+        std::unique_lock<std::mutex> lock(wait_m_);
+        ++waiters_;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        wait_cv_.wait(lock, [this] {
+            return head_.load(std::memory_order_relaxed) != tail_.load(std::memory_order_acquire)
+                || is_closed() || abandoned_.load(std::memory_order_acquire);
+        });
+        --waiters_;
+    }
+}
+
+
+bool EventStream::add_node(double time, size_t node, size_t parent, size_t category) {
+    return push(std::make_shared<AddNodeEvent>(seq_++, time, node, parent, category));
+}
+
+
+bool EventStream::set_category(double time, size_t node, size_t category) {
+    return push(std::make_shared<SetCategoryEvent>(seq_++, time, node, category));
+}
+
+
+bool EventStream::set_bound(double time, BoundType which, double bound) {
+    return push(std::make_shared<SetBoundEvent>(seq_++, time, which, bound));
+}
+
+
+bool EventStream::set_info(double time, size_t node, const std::string& main_info, const std::string& general_info) {
+    return push(std::make_shared<SetInfoEvent>(seq_++, time, node, main_info, general_info));
+}
+
+
+bool EventStream::append_info(double time, size_t node, const std::string& main_info, const std::string& general_info) {
+    return push(std::make_shared<AppendInfoEvent>(seq_++, time, node, main_info, general_info));
+}
+
+
+void EventStream::close() {
+    closed_.store(true, std::memory_order_release);
+    wake();
+}
+
+
+void EventStream::abandon() {
+    abandoned_.store(true, std::memory_order_release);
+    wake();
+}
+
+
+void EventStream::fail(const std::string& what) {
+    push(std::make_shared<VbcReader::IOErrorEvent>(what));
+    close();
+}
@@ -0,0 +1,92 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VBC_EVENT_STREAM_HPP
+#define __VBC_EVENT_STREAM_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Event.hpp"
+
+class EventStream;
+typedef std::shared_ptr<EventStream> EventStreamPtr;
+
+/// Push interface through which a solver linked against the library reports tree events.
+///
+/// The stream replaces the VBC file for in-process use: the solver calls add_node(),
+/// set_category(), set_bound() and set_info() as its search progresses, and a VbcReader
+/// opened on the stream applies the events exactly as if they had been parsed from a
+/// file, so the video renders while the solver runs. Events travel through a bounded
+/// single-producer, single-consumer ring without locks; a side only takes a lock to
+/// sleep when the ring is full (solver) or empty (reader), and to wake the other. The
+/// reader queues at most capacity() events ahead of the renderer and leaves the rest in
+/// the ring, so if the ring is full, the solver sleeps until the renderer has caught up.
+/// All push methods must be called from the same thread. Call close() when the search is
+/// done (or fail() if it was aborted), otherwise the reader waits for further events
+/// indefinitely.
+class EventStream {
+private:
+    std::vector<EventPtr> slots_;           ///< Ring buffer of pending events.
+    const size_t          mask_;            ///< Index mask of the ring buffer (capacity - 1).
+    size_t                seq_;             ///< Sequence number of the next event (producer only).
+
+    alignas(64) std::atomic<size_t> head_;  ///< Number of events taken by the reader.
+    alignas(64) std::atomic<size_t> tail_;  ///< Number of events pushed by the solver.
+    std::atomic_bool      closed_;          ///< Solver has pushed its last event.
+    std::atomic_bool      abandoned_;       ///< Reader has stopped taking events.
+    std::atomic_bool      attached_;        ///< Stream is consumed by a reader.
+
+    std::mutex              wait_m_;        ///< Guards sleeping on a full or empty ring.
+    std::condition_variable wait_cv_;       ///< Wakes the solver or reader.
+    std::atomic<int>        waiters_;       ///< Number of threads sleeping or about to sleep.
+
+    bool push(EventPtr event);
+    void wake();
+
+public:
+    explicit EventStream(size_t capacity = 65536);
+    EventStream(const EventStream&) = delete;
+    EventStream(EventStream&&) = delete;
+
+    // Producer side (solver thread); each method returns false once the reader has stopped
+    bool add_node(double time, size_t node, size_t parent, size_t category);
+    bool set_category(double time, size_t node, size_t category);
+    bool set_bound(double time, BoundType which, double bound);
+    bool set_info(double time, size_t node, const std::string& main_info, const std::string& general_info = std::string());
+    bool append_info(double time, size_t node, const std::string& main_info, const std::string& general_info = std::string());
+    void close();                                   ///< Marks the end of the event stream.
+    void fail(const std::string& what);             ///< Reports an error to the reader and closes the stream.
+
+    // Consumer side (reader thread)
+    bool attach() { return !attached_.exchange(true); }                    ///< Claims the stream for a reader.
+    EventPtr pop();                                                         ///< Takes the next event (or null if none is pending).
+    EventPtr wait_pop();                                                    ///< Takes the next event, waiting for it (null once closed and drained or abandoned).
+    bool is_closed() const { return closed_.load(std::memory_order_acquire); } ///< Indicates that no further events will be pushed.
+    void abandon();                                                         ///< Releases a waiting solver (and reader) when the reader stops.
+
+    size_t capacity() const { return slots_.size(); }                      ///< Returns the capacity of the ring buffer.
+    uint64_t get_num_pushed() const { return tail_.load(std::memory_order_relaxed); } ///< Returns the number of events pushed so far.
+};
+
+#endif /* end of include guard: __VBC_EVENT_STREAM_HPP */
@@ -0,0 +1,171 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+#include "FrameHash.hpp"
+
+
+static const uint64_t hash_prime_1 = 0x9e3779b185ebca87ull;
+static const uint64_t hash_prime_2 = 0xc2b2ae3d27d4eb4full;
+
+
+static inline uint64_t rotate_left(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+
+/// Mixes a word into the hash state.
+static inline uint64_t mix(uint64_t state, uint64_t word) {
+    return rotate_left(state ^ (word * hash_prime_2), 31) * hash_prime_1;
+}
+
+
+uint64_t hash_surface(cairo_surface_t* surface) {
+    cairo_surface_flush(surface);
+    const unsigned char* data = cairo_image_surface_get_data(surface);
+    const size_t width = size_t(cairo_image_surface_get_width(surface));
+    const size_t height = size_t(cairo_image_surface_get_height(surface));
+    const size_t stride = size_t(cairo_image_surface_get_stride(surface));
+    const uint32_t mask = cairo_image_surface_get_format(surface) == CAIRO_FORMAT_RGB24 ? 0x00ffffffu : 0xffffffffu;
+    if(!data) {
+        throw std::invalid_argument("cannot hash a surface without pixel data");
+    }
+
+    // Seed with the frame size so that differently sized blank frames differ
+    uint64_t state = mix(hash_prime_1, (uint64_t(width) << 32) | height);
+    std::vector<uint32_t> row(width + 1, 0);
+    for(size_t y = 0; y < height; ++y) {
+        // Pixels are native 32-bit words; pairs are combined by value, independent of byte order
+        std::memcpy(row.data(), data + y * stride, width * sizeof(uint32_t));
+        for(size_t x = 0; x < width; x += 2) {
+            state = mix(state, uint64_t(row[x] & mask) | (uint64_t(row[x + 1] & mask) << 32));
+        }
+    }
+
+    // Final avalanche
+    state ^= state >> 33;
+    state *= hash_prime_2;
+    state ^= state >> 29;
+    state *= hash_prime_1;
+    state ^= state >> 32;
+    return state;
+}
+
+
+FrameHashLog::FrameHashLog(const std::string& output_path, const std::string& reference_path, size_t width, size_t height)
+    : checking_(!reference_path.empty()),
+      frames_(0),
+      mismatches_(0),
+      first_mismatch_(std::numeric_limits<size_t>::max())
+{
+    std::ostringstream size;
+    size << width << 'x' << height;
+
+    // Load reference hashes
+    if(checking_) {
+        std::ifstream in(reference_path.c_str());
+        if(!in) {
+            throw std::runtime_error("could not open reference hashes " + reference_path);
+        }
+
+        std::string line;
+        size_t line_num = 0;
+        while(std::getline(in, line)) {
+            ++line_num;
+            std::istringstream fields(line);
+            std::string first;
+            if(!(fields >> first)) {
+                continue;
+            }
+            else if(first == "#") {
+                // Frames of different sizes cannot be compared
+                std::string key, value;
+                if(fields >> key >> value && key == "size" && value != size.str()) {
+                    throw std::invalid_argument("reference hashes were recorded at " + value + ", not " + size.str());
+                }
+                continue;
+            }
+
+            size_t frame;
+            uint64_t hash;
+            std::istringstream frame_field(first);
+            if(!(frame_field >> frame) || !(fields >> std::hex >> hash)) {
+                throw std::invalid_argument("malformed reference hash in line " + std::to_string(line_num) + " of " + reference_path);
+            }
+            if(frame >= reference_.size()) {
+                reference_.resize(frame + 1, 0);
+            }
+            reference_[frame] = hash;
+        }
+    }
+
+    // Open output and write header
+    if(!output_path.empty()) {
+        out_.open(output_path.c_str());
+        if(!out_) {
+            throw std::runtime_error("could not open frame hash output " + output_path);
+        }
+        out_ << "# size " << size.str() << '\n';
+    }
+}
+
+
+bool FrameHashLog::record(size_t frame, uint64_t hash) {
+    ++frames_;
+    if(out_.is_open()) {
+        out_ << frame << ' ' << std::hex << std::setw(16) << std::setfill('0') << hash << std::dec << '\n';
+    }
+
+    if(checking_ && (frame >= reference_.size() || reference_[frame] != hash)) {
+        if(!mismatches_++) {
+            first_mismatch_ = frame;
+        }
+        return false;
+    }
+    return true;
+}
+
+
+void FrameHashLog::finish() {
+    if(out_.is_open()) {
+        out_.flush();
+        if(!out_) {
+            throw std::runtime_error("could not write frame hashes");
+        }
+    }
+}
+
+
+std::string FrameHashLog::summary() const {
+    std::ostringstream out;
+    if(mismatches_) {
+        out << mismatches_ << " of " << frames_ << " frames differ from the reference (first at frame " << first_mismatch_ << ")";
+    }
+    else if(frames_ != reference_.size()) {
+        out << "rendered " << frames_ << " frames, reference has " << reference_.size();
+    }
+    else {
+        out << "all " << frames_ << " frames match the reference";
+    }
+    return out.str();
+}
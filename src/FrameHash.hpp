@@ -0,0 +1,66 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VBC_FRAME_HASH_HPP
+#define __VBC_FRAME_HASH_HPP
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <cairo.h>
+
+/// Returns a hash of the visible pixels of an RGB24 or ARGB32 image surface.
+///
+/// Row padding and the unused byte of RGB24 pixels are ignored, so the hash only changes
+/// if the picture does. The hash does not depend on the byte order of the machine.
+uint64_t hash_surface(cairo_surface_t* surface);
+
+/// Records frame hashes to a file and/or checks them against a reference list.
+///
+/// Hash files hold one "frame hash" line per frame (hash as 16 hex digits) after a
+/// comment line with the frame size. Frames are compared by index, so two render
+/// configurations of the same input can be diffed frame by frame.
+class FrameHashLog {
+private:
+    std::ofstream           out_;           ///< Hash output (not open if not recording).
+    std::vector<uint64_t>   reference_;     ///< Reference hashes by frame index.
+    bool                    checking_;      ///< Hashes are compared with the reference.
+    size_t                  frames_;        ///< Number of frames recorded.
+    size_t                  mismatches_;    ///< Number of frames that differ from the reference.
+    size_t                  first_mismatch_;///< Index of the first differing frame.
+
+public:
+    FrameHashLog(const std::string& output_path, const std::string& reference_path, size_t width, size_t height);
+    FrameHashLog(const FrameHashLog&) = delete;
+    FrameHashLog(FrameHashLog&&) = delete;
+
+    bool record(size_t frame, uint64_t hash);   ///< Records the hash of a frame; returns false if it differs from the reference.
+    void finish();                              ///< Flushes the output file.
+
+    bool is_checking() const { return checking_; }                      ///< Indicates that hashes are compared with a reference.
+    size_t get_num_frames() const { return frames_; }                   ///< Returns the number of recorded frames.
+    size_t get_num_reference() const { return reference_.size(); }      ///< Returns the number of reference frames.
+    size_t get_num_mismatches() const { return mismatches_; }           ///< Returns the number of frames that differ from the reference.
+    size_t get_first_mismatch() const { return first_mismatch_; }       ///< Returns the index of the first differing frame.
+    bool matches() const { return !mismatches_ && frames_ == reference_.size(); } ///< Indicates that all frames match the complete reference.
+    std::string summary() const;                                        ///< Describes the result of the comparison.
+};
+
+#endif /* end of include guard: __VBC_FRAME_HASH_HPP */
@@ -0,0 +1,75 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <sstream>
+
+#include "Json.hpp"
+
+
+std::string json_string(const std::string& str) {
+    std::string out;
+    out.reserve(str.size() + 2);
+
+    out.push_back('"');
+    for(char ch : str) {
+        switch(ch) {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        case '\r':
+            out += "\\r";
+            break;
+        case '\t':
+            out += "\\t";
+            break;
+        default:
+            if((unsigned char)ch < 0x20) {
+                char escape[8];
+                std::snprintf(escape, sizeof(escape), "\\u%04x", (unsigned)ch);
+                out += escape;
+            }
+            else {
+                out.push_back(ch);
+            }
+        }
+    }
+    out.push_back('"');
+
+    return out;
+}
+
+
+std::string json_number(double value) {
+    if(!std::isfinite(value)) {
+        return "null";
+    }
+
+    std::ostringstream str;
+    str.precision(std::numeric_limits<double>::digits10);
+    str << value;
+    return str.str();
+}
@@ -0,0 +1,30 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VBC_JSON_HPP
+#define __VBC_JSON_HPP
+
+#include <string>
+
+/// Returns the string as a quoted JSON string literal.
+std::string json_string(const std::string& str);
+
+/// Returns the number as a JSON number literal (null if not finite).
+std::string json_number(double value);
+
+#endif /* end of include guard: __VBC_JSON_HPP */
@@ -0,0 +1,184 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "PerfCounters.hpp"
+
+
+static const size_t num_events = size_t(PerfEvent::Count);
+
+static const uint64_t event_config[num_events] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES
+};
+
+static std::atomic_bool counters_enabled(false);
+static bool event_available[num_events] = { false };
+
+
+/// Counter group of a single thread.
+struct ThreadCounters {
+    int     fds[num_events];    ///< File descriptors of the counters (-1 if unavailable).
+    int     slot[num_events];   ///< Position of each counter in a group read (-1 if unavailable).
+    int     leader;             ///< File descriptor of the group leader.
+    size_t  opened;             ///< Number of counters in the group.
+    int     error;              ///< Error number of the last failed open.
+
+    ThreadCounters()
+        : leader(-1),
+          opened(0),
+          error(0)
+    {
+        for(size_t i = 0; i < num_events; ++i) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = event_config[i];
+            attr.disabled = (leader < 0);
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            fds[i] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, leader, PERF_FLAG_FD_CLOEXEC);
+            if(fds[i] < 0) {
+                error = errno;
+                slot[i] = -1;
+                continue;
+            }
+            if(leader < 0) {
+                leader = fds[i];
+            }
+            slot[i] = int(opened++);
+        }
+
+        if(leader >= 0) {
+            ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+    }
+
+    ~ThreadCounters() {
+        for(size_t i = 0; i < num_events; ++i) {
+            if(fds[i] >= 0) {
+                close(fds[i]);
+            }
+        }
+    }
+};
+
+
+/// Returns the counter group of the calling thread, opening it on first use.
+static ThreadCounters& thread_counters() {
+    thread_local ThreadCounters counters;
+    return counters;
+}
+
+
+const char* perf_event_name(PerfEvent event) {
+    switch(event) {
+    case PerfEvent::Cycles:         return "cycles";
+    case PerfEvent::Instructions:   return "instructions";
+    case PerfEvent::CacheMisses:    return "cache-misses";
+    case PerfEvent::BranchMisses:   return "branch-misses";
+    default:                        return "unknown";
+    }
+}
+
+
+bool PerfCounters::enable(std::string& error) {
+    ThreadCounters& counters = thread_counters();
+    if(counters.leader < 0) {
+        error = std::strerror(counters.error);
+        return false;
+    }
+
+    for(size_t i = 0; i < num_events; ++i) {
+        event_available[i] = (counters.fds[i] >= 0);
+    }
+    counters_enabled = true;
+    return true;
+}
+
+
+bool PerfCounters::is_enabled() {
+    return counters_enabled.load(std::memory_order_relaxed);
+}
+
+
+bool PerfCounters::is_available(PerfEvent event) {
+    return event_available[size_t(event)];
+}
+
+
+PerfCounts PerfCounters::read() {
+    PerfCounts counts;
+    std::memset(&counts, 0, sizeof(counts));
+    if(!is_enabled()) {
+        return counts;
+    }
+
+    ThreadCounters& counters = thread_counters();
+    if(counters.leader < 0) {
+        return counts;
+    }
+
+    // A group read returns the number of counters, the times the group was enabled and
+    // running, and the values of the counters
+    uint64_t data[3 + num_events];
+    ssize_t size = ::read(counters.leader, data, sizeof(data));
+    if(size < 0) {
+        return counts;
+    }
+    return decode(data, size_t(size) / sizeof(uint64_t), counters.slot);
+}
+
+
+PerfCounts PerfCounters::decode(const uint64_t* data, size_t words, const int* slots) {
+    PerfCounts counts;
+    std::memset(&counts, 0, sizeof(counts));
+
+    // Reject short reads, groups of a different size and groups that never ran
+    size_t opened = 0;
+    for(size_t i = 0; i < num_events; ++i) {
+        opened += (slots[i] >= 0);
+    }
+    if(words < 3 || data[0] != opened || words < 3 + opened || !data[2]) {
+        return counts;
+    }
+
+    // Extrapolate the counts over the time the group was multiplexed out
+    const double scale = double(data[1]) / double(data[2]);
+    for(size_t i = 0; i < num_events; ++i) {
+        if(slots[i] >= 0) {
+            uint64_t value = data[3 + slots[i]];
+            counts.values[i] = data[1] == data[2] ? value : uint64_t(double(value) * scale + 0.5);
+        }
+    }
+    counts.valid = true;
+    return counts;
+}
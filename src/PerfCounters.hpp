@@ -0,0 +1,64 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VBC_PERF_COUNTERS_HPP
+#define __VBC_PERF_COUNTERS_HPP
+
+#include <cstdint>
+#include <string>
+
+/// Hardware events counted per pipeline stage.
+enum class PerfEvent {
+    Cycles,
+    Instructions,
+    CacheMisses,
+    BranchMisses,
+    Count
+};
+
+const char* perf_event_name(PerfEvent event);  ///< Returns a short lowercase name of the event.
+
+/// Snapshot of hardware event counts of the calling thread.
+struct PerfCounts {
+    uint64_t values[size_t(PerfEvent::Count)];  ///< Event counts (0 for unavailable events).
+    bool     valid;                             ///< Indicates that the counters could be read.
+};
+
+/// Hardware performance counters read through perf_event_open.
+///
+/// Counters are opened lazily as one group per thread, so that all events of a group are
+/// scheduled together and their ratios stay meaningful under multiplexing. Counts are scaled
+/// by the ratio of the time the group was enabled to the time it was running, so that they
+/// estimate the full counts when the kernel multiplexes the counters. Events that the
+/// CPU or kernel does not support are left out. If no counter can be opened at all (e.g.
+/// in containers or with a restrictive perf_event_paranoid), reading fails and callers
+/// continue without counts.
+class PerfCounters {
+public:
+    static bool enable(std::string& error);     ///< Enables counting; returns false with a reason if counters are unavailable.
+    static bool is_enabled();                   ///< Indicates that counting is enabled.
+    static bool is_available(PerfEvent event);  ///< Indicates that the event could be opened on the main thread.
+    static PerfCounts read();                   ///< Reads the counters of the calling thread.
+
+    /// Decodes a group read (number of counters, times enabled and running, counter values)
+    /// of the given number of words into scaled counts. The slots give the position of each
+    /// event in the group (-1 for events that were not opened).
+    static PerfCounts decode(const uint64_t* data, size_t words, const int* slots);
+};
+
+#endif /* end of include guard: __VBC_PERF_COUNTERS_HPP */
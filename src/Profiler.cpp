@@ -0,0 +1,351 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+#include "Profiler.hpp"
+
+
+const char* stage_name(Stage stage) {
+    switch(stage) {
+    case Stage::Parse:  return "parse";
+    case Stage::Apply:  return "apply";
+    case Stage::Layout: return "layout";
+    case Stage::Draw:   return "draw";
+    case Stage::Copy:   return "copy";
+    case Stage::Push:   return "push";
+    default:            return "unknown";
+    }
+}
+
+
+LatencyHistogram::LatencyHistogram()
+    : max_(0)
+{
+    for(size_t i = 0; i < num_buckets; ++i) {
+        buckets_[i] = 0;
+    }
+}
+
+
+size_t LatencyHistogram::bucket_index(uint64_t value) {
+    // Values below 2^(sub_bits + 1) get a bucket each
+    if(value < (uint64_t(2) << sub_bits)) {
+        return size_t(value);
+    }
+
+    // Otherwise, keep the sub_bits bits below the most significant bit
+    unsigned msb = 63 - __builtin_clzll(value);
+    unsigned shift = msb - sub_bits;
+    return (size_t(shift) << sub_bits) + size_t(value >> shift);
+}
+
+
+uint64_t LatencyHistogram::bucket_value(size_t index) {
+    if(index < (size_t(2) << sub_bits)) {
+        return uint64_t(index);
+    }
+
+    // Report the middle of the bucket
+    unsigned shift = unsigned(index >> sub_bits) - 1;
+    uint64_t mantissa = (index & ((size_t(1) << sub_bits) - 1)) + (uint64_t(1) << sub_bits);
+    return (mantissa << shift) + ((uint64_t(1) << shift) >> 1);
+}
+
+
+/// Adds to a counter that has a single writer without a locked read-modify-write.
+static void add_relaxed(std::atomic<uint64_t>& counter, uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+
+void LatencyHistogram::record(uint64_t value) {
+    add_relaxed(buckets_[bucket_index(value)], 1);
+    if(value > max_.load(std::memory_order_relaxed)) {
+        max_.store(value, std::memory_order_relaxed);
+    }
+}
+
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for(size_t i = 0; i < num_buckets; ++i) {
+        add_relaxed(buckets_[i], other.buckets_[i].load(std::memory_order_relaxed));
+    }
+    uint64_t max = other.get_max();
+    if(max > max_.load(std::memory_order_relaxed)) {
+        max_.store(max, std::memory_order_relaxed);
+    }
+}
+
+
+uint64_t LatencyHistogram::get_count() const {
+    uint64_t count = 0;
+    for(size_t i = 0; i < num_buckets; ++i) {
+        count += buckets_[i].load(std::memory_order_relaxed);
+    }
+    return count;
+}
+
+
+uint64_t LatencyHistogram::get_percentile(double q) const {
+    uint64_t count = get_count();
+    if(!count) {
+        return 0;
+    }
+
+    // Find the bucket holding the sample of the requested rank
+    uint64_t rank = std::max<uint64_t>(1, uint64_t(q * count + 0.5));
+    uint64_t seen = 0;
+    for(size_t i = 0; i < num_buckets; ++i) {
+        seen += buckets_[i].load(std::memory_order_relaxed);
+        if(seen >= rank) {
+            return std::min(bucket_value(i), get_max());
+        }
+    }
+    return get_max();
+}
+
+
+Profiler::ThreadTotals::ThreadTotals() {
+    for(size_t i = 0; i < num_stages; ++i) {
+        samples[i] = 0;
+        items[i] = 0;
+        nanoseconds[i] = 0;
+        counted[i] = 0;
+        for(size_t j = 0; j < num_events; ++j) {
+            events[i][j] = 0;
+        }
+    }
+}
+
+
+void Profiler::ThreadTotals::merge(const ThreadTotals& other) {
+    for(size_t i = 0; i < num_stages; ++i) {
+        add_relaxed(samples[i], other.samples[i].load(std::memory_order_relaxed));
+        add_relaxed(items[i], other.items[i].load(std::memory_order_relaxed));
+        add_relaxed(nanoseconds[i], other.nanoseconds[i].load(std::memory_order_relaxed));
+        latency[i].merge(other.latency[i]);
+        add_relaxed(counted[i], other.counted[i].load(std::memory_order_relaxed));
+        for(size_t j = 0; j < num_events; ++j) {
+            add_relaxed(events[i][j], other.events[i][j].load(std::memory_order_relaxed));
+        }
+    }
+}
+
+
+Profiler::ThreadSlot::~ThreadSlot() {
+    if(totals) {
+        Profiler::instance().retire(totals);
+    }
+}
+
+
+Profiler::Profiler()
+    : enabled_(false)
+{}
+
+
+Profiler& Profiler::instance() {
+    // Never destroyed: scheduler workers retire their counters when they are joined by the
+    // scheduler's destructor, which may run after the destructors of other statics
+    static Profiler* profiler = new Profiler;
+    return *profiler;
+}
+
+
+Profiler::ThreadTotals& Profiler::local_totals() {
+    thread_local ThreadSlot slot;
+    if(!slot.totals) {
+        slot.totals = std::make_shared<ThreadTotals>();
+
+        std::lock_guard<std::mutex> lock(m_);
+        threads_.push_back(slot.totals);
+    }
+    return *slot.totals;
+}
+
+
+void Profiler::retire(const ThreadTotalsPtr& totals) {
+    std::lock_guard<std::mutex> lock(m_);
+    retired_.merge(*totals);
+    threads_.erase(std::remove(threads_.begin(), threads_.end(), totals), threads_.end());
+}
+
+
+void Profiler::record(Stage stage, uint64_t ns, uint64_t items) {
+    if(!is_enabled()) {
+        return;
+    }
+
+    ThreadTotals& totals = local_totals();
+    size_t i = size_t(stage);
+    add_relaxed(totals.samples[i], 1);
+    add_relaxed(totals.items[i], items);
+    add_relaxed(totals.nanoseconds[i], ns);
+    totals.latency[i].record(ns);
+}
+
+
+bool Profiler::is_counted(Stage stage) {
+    return stage == Stage::Parse || stage == Stage::Layout || stage == Stage::Draw;
+}
+
+
+void Profiler::record_counts(Stage stage, const PerfCounts& start, const PerfCounts& end) {
+    if(!is_enabled() || !start.valid || !end.valid) {
+        return;
+    }
+
+    ThreadTotals& totals = local_totals();
+    size_t i = size_t(stage);
+    add_relaxed(totals.counted[i], 1);
+    for(size_t j = 0; j < num_events; ++j) {
+        add_relaxed(totals.events[i][j], end.values[j] - start.values[j]);
+    }
+}
+
+
+StageTotals Profiler::get_totals(Stage stage) const {
+    size_t i = size_t(stage);
+    std::lock_guard<std::mutex> lock(m_);
+    StageTotals result {
+        retired_.samples[i].load(std::memory_order_relaxed),
+        retired_.items[i].load(std::memory_order_relaxed),
+        retired_.nanoseconds[i].load(std::memory_order_relaxed)
+    };
+    for(const ThreadTotalsPtr& totals : threads_) {
+        result.samples += totals->samples[i].load(std::memory_order_relaxed);
+        result.items += totals->items[i].load(std::memory_order_relaxed);
+        result.nanoseconds += totals->nanoseconds[i].load(std::memory_order_relaxed);
+    }
+    return result;
+}
+
+
+void Profiler::get_latency(Stage stage, LatencyHistogram& latency) const {
+    size_t i = size_t(stage);
+    std::lock_guard<std::mutex> lock(m_);
+    latency.merge(retired_.latency[i]);
+    for(const ThreadTotalsPtr& totals : threads_) {
+        latency.merge(totals->latency[i]);
+    }
+}
+
+
+uint64_t Profiler::sum_events(size_t stage, size_t event) const {
+    std::lock_guard<std::mutex> lock(m_);
+    uint64_t sum = retired_.events[stage][event].load(std::memory_order_relaxed);
+    for(const ThreadTotalsPtr& totals : threads_) {
+        sum += totals->events[stage][event].load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+
+void Profiler::print_report(std::ostream& out) const {
+    const auto fill = out.fill();
+    const auto prec = out.precision();
+    const auto flags = out.flags();
+
+    out << "-----------+-------------+-------------+-------------+-------------+-------------\n"
+        << std::setw(10) << "stage" << " | "
+        << std::setw(11) << "samples" << " | "
+        << std::setw(11) << "total [s]" << " | "
+        << std::setw(11) << "p50 [us]" << " | "
+        << std::setw(11) << "p99 [us]" << " | "
+        << std::setw(11) << "max [us]" << '\n'
+        << "-----------+-------------+-------------+-------------+-------------+-------------\n";
+
+    uint64_t total_samples = 0;
+    uint64_t total_ns = 0;
+    out << std::fixed;
+    for(size_t i = 0; i < num_stages; ++i) {
+        StageTotals totals = get_totals(Stage(i));
+        LatencyHistogram latency;
+        get_latency(Stage(i), latency);
+        total_samples += totals.samples;
+        total_ns += totals.nanoseconds;
+
+        out << std::setw(10) << stage_name(Stage(i)) << " | "
+            << std::setw(11) << totals.samples << " | "
+            << std::setprecision(3)
+            << std::setw(11) << totals.nanoseconds / 1e9 << " | "
+            << std::setprecision(1)
+            << std::setw(11) << latency.get_percentile(0.5) / 1e3 << " | "
+            << std::setw(11) << latency.get_percentile(0.99) / 1e3 << " | "
+            << std::setw(11) << latency.get_max() / 1e3 << '\n';
+    }
+    out << "-----------+-------------+-------------+-------------+-------------+-------------\n"
+        << std::setw(10) << "total" << " | "
+        << std::setw(11) << total_samples << " | "
+        << std::setprecision(3)
+        << std::setw(11) << total_ns / 1e9 << " |\n"
+        << "Parse samples cover batches of lines; stages of side-by-side panes overlap in time." << std::endl;
+
+    // Hardware events of the counted stages
+    if(PerfCounters::is_enabled()) {
+        out << "-----------+-------------+-------------+-------------+-------------+-------------\n"
+            << std::setw(10) << "stage" << " | "
+            << std::setw(11) << "cycles [M]" << " | "
+            << std::setw(11) << "instr [M]" << " | "
+            << std::setw(11) << "IPC" << " | "
+            << std::setw(11) << "cache MPKI" << " | "
+            << std::setw(11) << "branch MPKI" << '\n'
+            << "-----------+-------------+-------------+-------------+-------------+-------------\n";
+
+        auto print_value = [&out](bool available, double value) {
+            if(available && std::isfinite(value)) {
+                out << std::setw(11) << value;
+            }
+            else {
+                out << std::setw(11) << "n/a";
+            }
+        };
+        for(size_t i = 0; i < num_stages; ++i) {
+            if(!is_counted(Stage(i))) {
+                continue;
+            }
+
+            double cycles = sum_events(i, size_t(PerfEvent::Cycles));
+            double instr = sum_events(i, size_t(PerfEvent::Instructions));
+            double cache = sum_events(i, size_t(PerfEvent::CacheMisses));
+            double branch = sum_events(i, size_t(PerfEvent::BranchMisses));
+            bool have_cycles = PerfCounters::is_available(PerfEvent::Cycles);
+            bool have_instr = PerfCounters::is_available(PerfEvent::Instructions);
+
+            out << std::setw(10) << stage_name(Stage(i)) << " | " << std::setprecision(1);
+            print_value(have_cycles, cycles / 1e6);
+            out << " | ";
+            print_value(have_instr, instr / 1e6);
+            out << " | " << std::setprecision(2);
+            print_value(have_cycles && have_instr, instr / cycles);
+            out << " | ";
+            print_value(have_instr && PerfCounters::is_available(PerfEvent::CacheMisses), 1e3 * cache / instr);
+            out << " | ";
+            print_value(have_instr && PerfCounters::is_available(PerfEvent::BranchMisses), 1e3 * branch / instr);
+            out << '\n';
+        }
+        out << "MPKI = misses per thousand instructions (user space only)." << std::endl;
+    }
+
+    out.fill(fill);
+    out.precision(prec);
+    out.flags(flags);
+}
@@ -0,0 +1,160 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VBC_PROFILER_HPP
+#define __VBC_PROFILER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#include "PerfCounters.hpp"
+#include "Stage.hpp"
+#include "Trace.hpp"
+
+/// Accumulated time spent in a pipeline stage.
+struct StageTotals {
+    uint64_t samples;                       ///< Number of recorded samples.
+    uint64_t items;                         ///< Number of items processed (lines for batched stages).
+    uint64_t nanoseconds;                   ///< Total time spent in the stage.
+};
+
+/// Histogram of durations with logarithmic buckets.
+///
+/// Like an HDR histogram, every power of two is split into 16 linear sub-buckets, so
+/// percentiles are exact for values below 32ns and within about 3% above. A histogram
+/// is written by a single thread at a time; other threads may read it concurrently.
+class LatencyHistogram {
+private:
+    static const unsigned sub_bits = 4;
+    static const size_t num_buckets = (65 - sub_bits) << sub_bits;
+
+    std::atomic<uint64_t> buckets_[num_buckets];
+    std::atomic<uint64_t> max_;
+
+    static size_t bucket_index(uint64_t value);
+    static uint64_t bucket_value(size_t index);
+
+public:
+    LatencyHistogram();
+    LatencyHistogram(const LatencyHistogram&) = delete;
+
+    void record(uint64_t value);
+    void merge(const LatencyHistogram& other);  ///< Adds all samples of another histogram.
+    uint64_t get_count() const;
+    uint64_t get_max() const { return max_.load(std::memory_order_relaxed); }
+    uint64_t get_percentile(double q) const;    ///< Returns the value below which the given fraction of samples lies.
+};
+
+/// Process-wide accumulator of the time spent in each pipeline stage.
+///
+/// Recording is disabled until enable() is called; callers check is_enabled() before
+/// taking timestamps. Every thread accumulates into its own counters, which are merged
+/// when totals or reports are requested, so recording threads never share cache lines.
+/// Counters of terminated threads are folded into a common set.
+class Profiler {
+private:
+    static const size_t num_stages = size_t(Stage::Count);
+    static const size_t num_events = size_t(PerfEvent::Count);
+
+    /// Counters of a single thread, written only by that thread.
+    struct ThreadTotals {
+        std::atomic<uint64_t> samples[num_stages];
+        std::atomic<uint64_t> items[num_stages];
+        std::atomic<uint64_t> nanoseconds[num_stages];
+        LatencyHistogram      latency[num_stages];
+        std::atomic<uint64_t> counted[num_stages];              ///< Number of samples with hardware counts.
+        std::atomic<uint64_t> events[num_stages][num_events];   ///< Accumulated hardware event counts.
+
+        ThreadTotals();
+        void merge(const ThreadTotals& other);
+    };
+    typedef std::shared_ptr<ThreadTotals> ThreadTotalsPtr;
+
+    /// Registers the counters of a thread and retires them when the thread exits.
+    struct ThreadSlot {
+        ThreadTotalsPtr totals;
+        ~ThreadSlot();
+    };
+
+    std::atomic_bool                enabled_;   ///< Indicates that samples are recorded.
+    mutable std::mutex              m_;         ///< Guards the thread list and retired counters.
+    std::vector<ThreadTotalsPtr>    threads_;   ///< Counters of running threads.
+    ThreadTotals                    retired_;   ///< Counters of terminated threads.
+
+    Profiler();
+    ThreadTotals& local_totals();
+    void retire(const ThreadTotalsPtr& totals);
+    uint64_t sum_events(size_t stage, size_t event) const;
+
+public:
+    Profiler(const Profiler&) = delete;
+    Profiler(Profiler&&) = delete;
+
+    static Profiler& instance();            ///< Returns the process-wide profiler.
+
+    void enable() { enabled_ = true; }      ///< Starts recording samples.
+    bool is_enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    void record(Stage stage, uint64_t ns, uint64_t items = 1);
+    StageTotals get_totals(Stage stage) const;
+    void get_latency(Stage stage, LatencyHistogram& latency) const; ///< Adds the durations recorded for a stage to a histogram.
+
+    static bool is_counted(Stage stage);    ///< Indicates that hardware events are counted for the stage.
+    void record_counts(Stage stage, const PerfCounts& start, const PerfCounts& end);
+
+    void print_report(std::ostream& out) const; ///< Prints count, total time, p50, p99 and maximum of every stage.
+};
+
+/// Records the time between construction and destruction for a stage and traces it as a span.
+/// Hardware events are counted as well if enabled for the stage. Nothing is measured
+/// unless profiling or tracing is enabled.
+class StageTimer {
+private:
+    Stage       stage_;
+    bool        active_;
+    bool        counted_;
+    PerfCounts  counts_;
+    uint64_t    start_;
+
+public:
+    explicit StageTimer(Stage stage)
+        : stage_(stage),
+          active_(Profiler::instance().is_enabled() || Tracer::instance().is_enabled()),
+          counted_(active_ && PerfCounters::is_enabled() && Profiler::is_counted(stage)),
+          counts_(counted_ ? PerfCounters::read() : PerfCounts()),
+          start_(active_ ? Tracer::instance().now() : 0)
+    {}
+    StageTimer(const StageTimer&) = delete;
+    ~StageTimer() {
+        if(!active_) {
+            return;
+        }
+        uint64_t end = Tracer::instance().now();
+        if(counted_) {
+            Profiler::instance().record_counts(stage_, counts_, PerfCounters::read());
+        }
+        Profiler::instance().record(stage_, end - start_);
+        Tracer::instance().complete(stage_name(stage_), "stage", start_, end);
+    }
+};
+
+#endif /* end of include guard: __VBC_PROFILER_HPP */
@@ -0,0 +1,82 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include <cairo.h>
+
+#include "Profiler.hpp"
+#include "Render.hpp"
+#include "Styles.hpp"
+
+
+cairo_matrix_t fit_matrix(const Tree& tree, const Rect& window) {
+    // Without visible nodes the bounding box is empty; keep the matrix finite
+    Rect bbox = tree.bounding_box();
+    if(!tree.has_visible_nodes() || !(bbox.x1 > bbox.x0) || !(bbox.y1 > bbox.y0)) {
+        cairo_matrix_t matrix;
+        cairo_matrix_init(&matrix, 1, 0, 0, 1, 0.5 * (window.x0 + window.x1), 0.5 * (window.y0 + window.y1));
+        return matrix;
+    }
+
+    // Adjust transformation to center tree
+    Scalar scale = std::min(
+            (window.x1 - window.x0) / (bbox.x1 - bbox.x0),
+            (window.y1 - window.y0) / (bbox.y1 - bbox.y0)
+            );
+    Scalar scaled_bbox_mid_x = 0.5 * scale * (bbox.x0 + bbox.x1);
+    Scalar scaled_bbox_mid_y = 0.5 * scale * (bbox.y0 + bbox.y1);
+    Scalar window_mid_x = 0.5 * (window.x0 + window.x1);
+    Scalar window_mid_y = 0.5 * (window.y0 + window.y1);
+
+    cairo_matrix_t matrix;
+    cairo_matrix_init(&matrix, scale, 0, 0, scale, window_mid_x - scaled_bbox_mid_x, window_mid_y - scaled_bbox_mid_y);
+    return matrix;
+}
+
+
+void fit_tree(Canvas* canvas, const Tree& tree, const Rect& window) {
+    cairo_matrix_t matrix = fit_matrix(tree, window);
+    cairo_set_matrix(canvas, &matrix);
+}
+
+
+void render_tree(Canvas* canvas, TreePtr tree, const Rect& window, bool raster_protect, DetailLevel detail) {
+    // Update layout and center tree in window
+    {
+        StageTimer timer(Stage::Layout);
+        tree->update_layout();
+    }
+
+    // Fill surface with background color and draw the tree unless all nodes are hidden
+    StageTimer timer(Stage::Draw);
+    const Color& background = tree->style().background;
+    cairo_set_source_rgb(canvas, background.r, background.g, background.b);
+    cairo_set_operator(canvas, CAIRO_OPERATOR_OVER);
+    cairo_paint(canvas);
+    if(!tree->has_visible_nodes()) {
+        return;
+    }
+    fit_tree(canvas, *tree, window);
+    if(detail == DetailLevel::Points) {
+        tree->draw_points(canvas);
+    }
+    else {
+        tree->draw(canvas, raster_protect);
+    }
+}
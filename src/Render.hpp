@@ -0,0 +1,40 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VBC_RENDER_HPP
+#define __VBC_RENDER_HPP
+
+#include "Tree.hpp"
+#include "Types.hpp"
+
+/// Returns the transformation that centers the tree's bounding box in the window.
+cairo_matrix_t fit_matrix(const Tree& tree, const Rect& window);
+
+/// Sets the transformation of the canvas such that the tree's bounding box is centered in the window.
+void fit_tree(Canvas* canvas, const Tree& tree, const Rect& window);
+
+/// Level of detail for drawing trees.
+enum class DetailLevel {
+    Full,       ///< Styled node markers.
+    Points      ///< Pixel-sized points and hairline edges (draft previews).
+};
+
+/// Updates the layout, fills the window with the background color, and draws the tree centered in the window.
+void render_tree(Canvas* canvas, TreePtr tree, const Rect& window, bool raster_protect = true, DetailLevel detail = DetailLevel::Full);
+
+#endif /* end of include guard: __VBC_RENDER_HPP */
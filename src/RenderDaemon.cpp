@@ -0,0 +1,351 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include "Json.hpp"
+#include "RenderDaemon.hpp"
+#include "Scheduler.hpp"
+
+namespace bpt = boost::property_tree;
+
+
+/// Sends a complete line to the socket and returns false if the peer is gone.
+static bool send_line(int fd, const std::string& line) {
+    std::string msg = line + '\n';
+    const char* data = msg.data();
+    size_t remaining = msg.size();
+    while(remaining) {
+        ssize_t sent = send(fd, data, remaining, MSG_NOSIGNAL);
+        if(sent < 0 && errno == EINTR) {
+            continue;
+        }
+        else if(sent <= 0) {
+            return false;
+        }
+        data += sent;
+        remaining -= sent;
+    }
+    return true;
+}
+
+
+static bool send_error(int fd, const std::string& message) {
+    return send_line(fd, "{\"event\":\"error\",\"message\":" + json_string(message) + "}");
+}
+
+
+RenderDaemon::RenderDaemon(const std::string& socket_path, const ArgumentParser& parser)
+    : path_(socket_path),
+      max_jobs_(1),
+      max_conns_(64),
+      interval_(5.0),
+      parser_(parser),
+      abort_(nullptr),
+      running_(0),
+      queued_(0),
+      next_id_(1)
+{}
+
+
+void RenderDaemon::render(int fd, const std::vector<std::string>& args) {
+    // Parse job arguments
+    RenderOptions opts;
+    std::ostringstream parse_errors;
+    if(parser_(args, opts, parse_errors)) {
+        std::string message = parse_errors.str();
+        while(!message.empty() && message.back() == '\n') {
+            message.pop_back();
+        }
+        send_error(fd, message.empty() ? "invalid job arguments" : message);
+        return;
+    }
+
+    // Wait for a free job slot; messages are sent without holding the lock, so that a slow
+    // client does not hold up the other connections
+    size_t id;
+    std::string queued;
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        if(is_aborted()) {
+            return;
+        }
+        id = next_id_++;
+        if(running_ >= max_jobs_) {
+            ++queued_;
+            std::ostringstream msg;
+            msg << "{\"event\":\"queued\",\"job\":" << id << ",\"position\":" << queued_ << '}';
+            queued = msg.str();
+        }
+        else {
+            ++running_;
+        }
+    }
+    if(!queued.empty()) {
+        const bool sent = send_line(fd, queued);
+
+        std::unique_lock<std::mutex> lock(m_);
+        while(sent && running_ >= max_jobs_ && !is_aborted()) {
+            cv_.wait_for(lock, std::chrono::milliseconds(500));
+        }
+        --queued_;
+        if(!sent || is_aborted()) {
+            return;
+        }
+        ++running_;
+    }
+
+    RenderJob job(opts);
+    job.set_abort_flag(abort_);
+
+    // Report progress at fixed intervals and cancel the job when the client disconnects
+    double next_report = interval_;
+    job.set_progress_callback([&](const RenderProgress& progress) {
+        if(progress.runtime < next_report) {
+            return;
+        }
+        next_report = progress.runtime + interval_;
+
+        std::ostringstream msg;
+        msg << "{\"event\":\"progress\",\"job\":" << id
+            << ",\"runtime\":" << json_number(progress.runtime)
+            << ",\"clock_time\":" << json_number(progress.clock_time)
+            << ",\"stream_time\":" << json_number(progress.stream_time)
+            << ",\"frames\":" << progress.frames << '}';
+        if(!send_line(fd, msg.str())) {
+            job.cancel();
+        }
+    });
+
+    std::ostringstream started;
+    started << "{\"event\":\"started\",\"job\":" << id
+            << ",\"output\":" << json_string(opts.output_path) << '}';
+    int status = send_line(fd, started.str()) ? job.run() : 1;
+
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        --running_;
+    }
+    cv_.notify_one();
+
+    // Report result
+    const RenderProgress& result = job.get_result();
+    std::ostringstream done;
+    done << "{\"event\":\"done\",\"job\":" << id
+         << ",\"status\":" << json_string(job.was_cancelled() ? "cancelled" : (status ? "failed" : "ok"))
+         << ",\"runtime\":" << json_number(result.runtime)
+         << ",\"stream_time\":" << json_number(result.stream_time)
+         << ",\"frames\":" << result.frames;
+    if(!job.get_error().empty()) {
+        done << ",\"error\":" << json_string(job.get_error());
+    }
+    done << '}';
+    send_line(fd, done.str());
+}
+
+
+void RenderDaemon::handle_request(int fd, const std::string& line) {
+    bpt::ptree request;
+    try {
+        std::istringstream in(line);
+        bpt::read_json(in, request);
+    } catch(const bpt::json_parser_error& err) {
+        send_error(fd, std::string("malformed request: ") + err.message());
+        return;
+    }
+
+    std::string command = request.get<std::string>("command", "render");
+    if(command == "status") {
+        std::ostringstream msg;
+        {
+            std::lock_guard<std::mutex> lock(m_);
+            msg << "{\"event\":\"status\",\"running\":" << running_
+                << ",\"queued\":" << queued_
+                << ",\"max_jobs\":" << max_jobs_ << '}';
+        }
+        send_line(fd, msg.str());
+    }
+    else if(command == "render") {
+        // Assemble command line arguments of the job
+        std::vector<std::string> args;
+        for(const auto& arg : request.get_child("args", bpt::ptree())) {
+            args.push_back(arg.second.data());
+        }
+        if(request.count("output")) {
+            args.push_back("--output");
+            args.push_back(request.get<std::string>("output"));
+        }
+        if(request.count("input")) {
+            const bpt::ptree& input = request.get_child("input");
+            if(input.empty()) {
+                args.push_back(input.data());
+            }
+            for(const auto& path : input) {
+                args.push_back(path.second.data());
+            }
+        }
+
+        render(fd, args);
+    }
+    else {
+        send_error(fd, "unknown command '" + command + "'");
+    }
+}
+
+
+void RenderDaemon::serve(Connection* conn) {
+    std::string buffer;
+    char chunk[4096];
+
+    while(!is_aborted()) {
+        // Wait for data with timeout to notice shutdown requests
+        pollfd pfd { conn->fd, POLLIN, 0 };
+        int ready = poll(&pfd, 1, 500);
+        if(ready < 0 && errno != EINTR) {
+            break;
+        }
+        else if(ready <= 0) {
+            continue;
+        }
+
+        ssize_t received = recv(conn->fd, chunk, sizeof(chunk), 0);
+        if(received < 0 && errno == EINTR) {
+            continue;
+        }
+        else if(received <= 0) {
+            break;
+        }
+        buffer.append(chunk, received);
+
+        // Process all complete lines
+        size_t eol;
+        while((eol = buffer.find('\n')) != std::string::npos) {
+            std::string line = buffer.substr(0, eol);
+            buffer.erase(0, eol + 1);
+            if(line.find_first_not_of(" \t\r") != std::string::npos) {
+                handle_request(conn->fd, line);
+            }
+        }
+    }
+
+    close(conn->fd);
+    conn->done = true;
+}
+
+
+int RenderDaemon::run() {
+    // Create listening socket, replacing stale sockets of previous runs
+    sockaddr_un addr;
+    if(path_.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "DAEMON: socket path too long" << std::endl;
+        return 1;
+    }
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path_.c_str(), sizeof(addr.sun_path) - 1);
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listen_fd < 0) {
+        std::cerr << "DAEMON: could not create socket: " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+
+    // Only ever remove a stale socket, never a file that happens to have the same name
+    struct stat st;
+    if(lstat(path_.c_str(), &st) == 0) {
+        if(!S_ISSOCK(st.st_mode)) {
+            std::cerr << "DAEMON: " << path_ << " exists and is not a socket" << std::endl;
+            close(listen_fd);
+            return 1;
+        }
+        unlink(path_.c_str());
+    }
+
+    // Create the socket accessible by the owner only; other users could submit jobs writing anywhere we can
+    mode_t old_mask = umask(0177);
+    int bound = bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    int bind_errno = errno;
+    umask(old_mask);
+    if(bound < 0 || listen(listen_fd, 16) < 0) {
+        std::cerr << "DAEMON: could not listen on " << path_ << ": " << std::strerror(bound < 0 ? bind_errno : errno) << std::endl;
+        close(listen_fd);
+        return 1;
+    }
+    std::cout << "DAEMON: listening on " << path_ << " (" << max_jobs_ << " concurrent jobs)" << std::endl;
+
+    while(!is_aborted()) {
+        // Reap finished connections
+        for(auto it = connections_.begin(); it != connections_.end();) {
+            if((*it)->done) {
+                (*it)->thread.join();
+                it = connections_.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+
+        // Wait for new connections with timeout to notice shutdown requests
+        pollfd pfd { listen_fd, POLLIN, 0 };
+        int ready = poll(&pfd, 1, 500);
+        if(ready <= 0) {
+            continue;
+        }
+
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if(fd < 0) {
+            continue;
+        }
+
+        // Refuse clients beyond the connection limit instead of starting ever more threads
+        if(connections_.size() >= max_conns_) {
+            send_error(fd, "too many connections");
+            close(fd);
+            continue;
+        }
+
+        connections_.emplace_back(new Connection());
+        Connection* conn = connections_.back().get();
+        conn->fd = fd;
+        conn->done = false;
+        // Clients mostly wait; only the render loop of a running job counts against the budget
+        conn->thread = Scheduler::instance().spawn("daemon client", std::bind(&RenderDaemon::serve, this, conn), false);
+    }
+
+    // Shut down: running jobs observe the abort flag and terminate early
+    close(listen_fd);
+    unlink(path_.c_str());
+    cv_.notify_all();
+    for(auto& conn : connections_) {
+        conn->thread.join();
+    }
+    connections_.clear();
+
+    return 0;
+}
@@ -0,0 +1,94 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VBC_RENDER_DAEMON_HPP
+#define __VBC_RENDER_DAEMON_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "RenderJob.hpp"
+
+/// Accepts rendering jobs on a Unix domain socket and runs them with a concurrency limit.
+///
+/// Clients send one JSON object per line. A render request has the form
+///
+///     {"command": "render", "args": ["-o", "out.avi", "--clock", "in.vbc"]}
+///
+/// where "args" uses the command line syntax of a single rendering job; the convenience keys
+/// "input" (string or array) and "output" are appended to the arguments if present. The daemon
+/// answers with JSON lines whose "event" member is one of "queued", "started", "progress",
+/// "done", or "error". A request {"command": "status"} returns the number of running and
+/// queued jobs. Closing the connection cancels the job of that connection.
+///
+/// The socket is only accessible by the owner (mode 0600). At most a fixed number of
+/// connections are served at once; further clients receive an error and are disconnected.
+class RenderDaemon {
+public:
+    typedef std::function<int(const std::vector<std::string>&, RenderOptions&, std::ostream&)> ArgumentParser;
+
+private:
+    /// State of a single client connection.
+    struct Connection {
+        int                 fd;         ///< Socket of the connection.
+        std::thread         thread;     ///< Thread serving the connection.
+        std::atomic_bool    done;       ///< Indicates that the serving thread has finished.
+    };
+
+    std::string             path_;      ///< Path of the listening socket.
+    size_t                  max_jobs_;  ///< Maximum number of concurrently running jobs.
+    size_t                  max_conns_; ///< Maximum number of concurrently served connections.
+    double                  interval_;  ///< Interval between progress messages in seconds.
+    ArgumentParser          parser_;    ///< Parser for job arguments.
+    const std::atomic_bool* abort_;     ///< External flag requesting shutdown.
+
+    std::mutex              m_;         ///< Mutex protecting job counters.
+    std::condition_variable cv_;        ///< Signals a free job slot.
+    size_t                  running_;   ///< Number of running jobs.
+    size_t                  queued_;    ///< Number of jobs waiting for a slot.
+    size_t                  next_id_;   ///< Identifier of the next job.
+
+    std::list<std::unique_ptr<Connection>> connections_;   ///< Connections being served.
+
+    bool is_aborted() const { return abort_ && *abort_; }
+    void serve(Connection* conn);
+    void handle_request(int fd, const std::string& line);
+    void render(int fd, const std::vector<std::string>& args);
+
+public:
+    RenderDaemon(const std::string& socket_path, const ArgumentParser& parser);
+    RenderDaemon(const RenderDaemon&) = delete;
+    RenderDaemon(RenderDaemon&&) = delete;
+
+    void set_max_jobs(size_t jobs) { max_jobs_ = jobs; }
+    void set_max_connections(size_t connections) { max_conns_ = connections; }
+    void set_report_interval(double seconds) { interval_ = seconds; }
+    void set_abort_flag(const std::atomic_bool* flag) { abort_ = flag; }
+
+    int run();                                  ///< Serves requests until shutdown is requested and returns a non-zero status on error.
+};
+
+#endif /* end of include guard: __VBC_RENDER_DAEMON_HPP */
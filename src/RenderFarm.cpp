@@ -0,0 +1,400 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <boost/filesystem.hpp>
+
+#include "Checkpoint.hpp"
+#include "RenderFarm.hpp"
+#include "VbcReader.hpp"
+#include "VideoOutput.hpp"
+
+namespace bfs = boost::filesystem;
+
+
+static const std::chrono::milliseconds poll_interval(200);
+
+
+static void write_options(const bfs::path& path, const RenderOptions& opts) {
+    std::ostringstream out;
+    out.precision(17);
+    for(const std::string& input : opts.input_paths) {
+        out << "input " << bfs::absolute(input).string() << '\n';
+    }
+    out << "width " << opts.video_width << '\n'
+        << "height " << opts.video_height << '\n'
+        << "fps " << opts.video_fps_n << ' ' << opts.video_fps_d << '\n'
+        << "condense " << opts.video_condense_n << ' ' << opts.video_condense_d << '\n'
+        << "start " << opts.start_timestamp << '\n'
+        << "stop " << opts.stop_timestamp << '\n'
+        << "clock " << opts.clock << '\n'
+        << "bounds " << opts.bounds << '\n'
+        << "align " << opts.text_align.first << ' ' << opts.text_align.second << '\n'
+        << "encoder-threads " << opts.encoder_threads << '\n'
+        << "draft " << opts.draft << '\n';
+    if(!opts.style_path.empty()) {
+        out << "styles " << bfs::absolute(opts.style_path).string() << '\n';
+    }
+    if(!opts.palette_path.empty()) {
+        out << "palette " << bfs::absolute(opts.palette_path).string() << '\n';
+    }
+    if(!opts.hidden_categories.empty()) {
+        out << "hide";
+        for(size_t category : opts.hidden_categories) {
+            out << ' ' << category;
+        }
+        out << '\n';
+    }
+    write_file_atomic(path.string(), out.str());
+}
+
+
+static bool read_options(const bfs::path& path, RenderOptions& opts) {
+    std::ifstream in(path.c_str());
+    std::string key;
+    while(in >> key) {
+        if(key == "input") {
+            std::string input;
+            std::getline(in >> std::ws, input);
+            opts.input_paths.push_back(input);
+        }
+        else if(key == "width") { in >> opts.video_width; }
+        else if(key == "height") { in >> opts.video_height; }
+        else if(key == "fps") { in >> opts.video_fps_n >> opts.video_fps_d; }
+        else if(key == "condense") { in >> opts.video_condense_n >> opts.video_condense_d; }
+        else if(key == "start") { in >> opts.start_timestamp; }
+        else if(key == "stop") { in >> opts.stop_timestamp; }
+        else if(key == "clock") { in >> opts.clock; }
+        else if(key == "bounds") { in >> opts.bounds; }
+        else if(key == "align") { in >> opts.text_align.first >> opts.text_align.second; }
+        else if(key == "encoder-threads") { in >> opts.encoder_threads; }
+        else if(key == "draft") { in >> opts.draft; }
+        else if(key == "styles") { std::getline(in >> std::ws, opts.style_path); }
+        else if(key == "palette") { std::getline(in >> std::ws, opts.palette_path); }
+        else if(key == "hide") {
+            std::string line;
+            std::getline(in, line);
+            std::istringstream categories(line);
+            size_t category;
+            while(categories >> category) {
+                opts.hidden_categories.push_back(category);
+            }
+        }
+        else {
+            return false;
+        }
+    }
+    return in.eof() && !opts.input_paths.empty();
+}
+
+
+RenderFarm::RenderFarm(const RenderOptions& options, const std::string& dir)
+    : options_(options),
+      dir_(dir),
+      workers_(1),
+      seg_frames_(1800),
+      keep_dir_(false),
+      abort_(nullptr)
+{}
+
+
+std::string RenderFarm::segment_path(size_t index, const char* ext) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "segment-%04zu.%s", index, ext);
+    return (bfs::path(dir_) / name).string();
+}
+
+
+void RenderFarm::spawn_workers() {
+    for(size_t i = 0; i < workers_; ++i) {
+        pid_t pid = fork();
+        if(pid == 0) {
+            execl("/proc/self/exe", "vbcrender", "--farm-worker", dir_.c_str(), (char*)NULL);
+            std::perror("FARM: could not start worker");
+            _exit(127);
+        }
+        else if(pid > 0) {
+            pids_.push_back(pid);
+        }
+        else {
+            std::perror("FARM: could not fork worker");
+        }
+    }
+}
+
+
+void RenderFarm::reap_workers(bool wait) {
+    for(auto it = pids_.begin(); it != pids_.end();) {
+        int status;
+        if(waitpid(*it, &status, wait ? 0 : WNOHANG) != 0) {
+            it = pids_.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+
+bool RenderFarm::prescan(size_t& num_segments) {
+    // Frame duration in nanoseconds, truncated exactly like the video output does
+    const uint64_t frame_ns = options_.video_fps_d * 1000000000ull / options_.video_fps_n;
+
+    VbcReaderPtr reader = std::make_shared<VbcReader>(false, true, options_.style);
+    reader->open(options_.input_paths.front());
+
+    // Replay the timeline of the render loop without drawing anything
+    uint64_t frame = 0;
+    double stream_time = 0.0;
+    num_segments = 0;
+    while(!is_aborted()) {
+        if(!reader->has_next()) {
+            reader->wait();
+        }
+
+        VbcReader::State state = reader->get_state();
+        if(state == VbcReader::Error) {
+            reader->advance();
+            return false;
+        }
+        else if(state != VbcReader::Processing) {
+            break;
+        }
+        else if(!reader->has_next()) {
+            continue;
+        }
+
+        if(reader->get_next_timestamp() > stream_time + options_.start_timestamp) {
+            // Publish a segment starting at this frame
+            if(frame % seg_frames_ == 0) {
+                Checkpoint ckpt { reader->get_offset(), reader->get_timestamp(), frame };
+                save_checkpoint(segment_path(num_segments, "ckpt"), ckpt, reader->get_tree());
+
+                std::ostringstream job;
+                job << "first_frame " << frame << '\n'
+                    << "frame_limit " << seg_frames_ << '\n';
+                write_file_atomic(segment_path(num_segments, "job"), job.str());
+                ++num_segments;
+            }
+
+            ++frame;
+            stream_time = double(frame * frame_ns) / 1e9;
+
+            if(options_.stop_timestamp > options_.start_timestamp && stream_time > options_.stop_timestamp - options_.start_timestamp) {
+                break;
+            }
+        }
+        else {
+            reader->advance();
+        }
+    }
+    reader->close();
+
+    std::cout << "FARM: prescan found " << frame << " frames in " << num_segments << " segments" << std::endl;
+    return !is_aborted();
+}
+
+
+bool RenderFarm::collect(size_t num_segments) {
+    size_t next = 0;
+    while(next < num_segments) {
+        if(is_aborted()) {
+            return false;
+        }
+
+        if(bfs::exists(segment_path(next, "failed"))) {
+            std::ifstream in(segment_path(next, "failed").c_str());
+            std::string message;
+            std::getline(in, message);
+            std::cerr << "FARM: segment " << next << " failed: " << message << std::endl;
+            return false;
+        }
+        else if(bfs::exists(segment_path(next, "done"))) {
+            ++next;
+            continue;
+        }
+
+        // Give up if all local workers have exited and the segment is still pending
+        reap_workers(false);
+        if(pids_.empty()) {
+            std::cerr << "FARM: all workers exited before segment " << next << " was rendered" << std::endl;
+            return false;
+        }
+        std::this_thread::sleep_for(poll_interval);
+    }
+    return true;
+}
+
+
+bool RenderFarm::concatenate(size_t num_segments) {
+    std::vector<std::string> segments;
+    for(size_t i = 0; i < num_segments; ++i) {
+        segments.push_back(segment_path(i, "ts"));
+    }
+
+    try {
+        VideoOutput::concatenate(segments, options_.output_path);
+    } catch(const std::exception& err) {
+        std::cerr << "FARM: " << err.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+
+int RenderFarm::run() {
+    if(options_.input_paths.size() != 1) {
+        std::cerr << "FARM: distributed rendering requires exactly one input" << std::endl;
+        return 1;
+    }
+    seg_frames_ = std::max<size_t>(1, seg_frames_);
+
+    // Use a new or empty working directory only; files found there are never deleted
+    boost::system::error_code ec;
+    if(bfs::exists(dir_, ec)) {
+        if(!bfs::is_directory(dir_, ec) || !bfs::is_empty(dir_, ec) || ec) {
+            std::cerr << "FARM: working directory " << dir_ << " is not an empty directory; remove it or choose another one" << std::endl;
+            return 1;
+        }
+    }
+    else if(!bfs::create_directories(dir_, ec) || ec) {
+        std::cerr << "FARM: could not create working directory " << dir_ << ": " << ec.message() << std::endl;
+        return 1;
+    }
+    write_options(bfs::path(dir_) / "farm.options", options_);
+
+    // Workers start rendering as soon as the first segment is published
+    spawn_workers();
+    size_t num_segments = 0;
+    bool ok = prescan(num_segments);
+    write_file_atomic((bfs::path(dir_) / "prescan.done").string(), std::to_string(num_segments) + '\n');
+    ok = ok && collect(num_segments);
+
+    // Terminate workers on failure and wait for all of them
+    if(!ok) {
+        for(pid_t pid : pids_) {
+            kill(pid, SIGTERM);
+        }
+    }
+    reap_workers(true);
+
+    ok = ok && concatenate(num_segments);
+    if(ok && !keep_dir_) {
+        bfs::remove_all(dir_);
+    }
+
+    return ok ? 0 : 1;
+}
+
+
+int RenderFarm::work(const std::string& dir, const std::atomic_bool* abort) {
+    RenderOptions base;
+    if(!read_options(bfs::path(dir) / "farm.options", base)) {
+        std::cerr << "FARM: could not read job options from " << dir << std::endl;
+        return 1;
+    }
+    if(!base.style_path.empty()) {
+        try {
+            base.style = StyleSheet::load(base.style_path, base.palette_path);
+        } catch(const std::exception& err) {
+            std::cerr << "FARM: could not load styles: " << err.what() << std::endl;
+            return 1;
+        }
+    }
+    if(!base.hidden_categories.empty()) {
+        try {
+            base.style = (base.style ? base.style : StyleSheet::standard())->hide_categories(base.hidden_categories);
+        } catch(const std::exception& err) {
+            std::cerr << "FARM: could not hide categories: " << err.what() << std::endl;
+            return 1;
+        }
+    }
+
+    const std::string suffix = ".claimed-" + std::to_string(getpid());
+    int status = 0;
+    while(!(abort && *abort)) {
+        // Check for completion before listing jobs so that no job published in between is missed
+        bool scan_done = bfs::exists(bfs::path(dir) / "prescan.done");
+
+        // Find the first unclaimed segment
+        std::vector<bfs::path> jobs;
+        for(bfs::directory_iterator it(dir), end; it != end; ++it) {
+            if(it->path().extension() == ".job") {
+                jobs.push_back(it->path());
+            }
+        }
+        std::sort(jobs.begin(), jobs.end());
+
+        bfs::path claimed;
+        for(const bfs::path& job : jobs) {
+            boost::system::error_code ec;
+            bfs::path target = job;
+            target += suffix;
+            bfs::rename(job, target, ec);
+            if(!ec) {
+                claimed = target;
+                break;
+            }
+        }
+        if(claimed.empty()) {
+            if(scan_done) {
+                break;
+            }
+            std::this_thread::sleep_for(poll_interval);
+            continue;
+        }
+
+        // Read segment parameters
+        bfs::path segment = bfs::path(dir) / bfs::path(claimed.filename()).stem().stem();
+        RenderOptions opts = base;
+        std::ifstream in(claimed.c_str());
+        std::string key;
+        size_t first_frame = 0;
+        while(in >> key) {
+            if(key == "first_frame") { in >> first_frame; }
+            else if(key == "frame_limit") { in >> opts.frame_limit; }
+        }
+        opts.checkpoint_path = segment.string() + ".ckpt";
+        opts.output_path = segment.string() + ".ts";
+
+        // Render segment and report result
+        std::cout << "FARM: worker " << getpid() << " rendering " << segment.filename().string()
+                  << " from frame " << first_frame << std::endl;
+        RenderJob job(opts);
+        job.set_abort_flag(abort);
+        if(job.run() || job.was_cancelled()) {
+            write_file_atomic(segment.string() + ".failed", job.get_error() + '\n');
+            status = 1;
+            break;
+        }
+        write_file_atomic(segment.string() + ".done", std::to_string(job.get_result().frames) + '\n');
+    }
+
+    return status;
+}
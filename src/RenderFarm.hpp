@@ -0,0 +1,77 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VBC_RENDER_FARM_HPP
+#define __VBC_RENDER_FARM_HPP
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "RenderJob.hpp"
+
+/// Splits a rendering job into segments that are rendered by separate worker processes.
+///
+/// The coordinator and its workers communicate through a shared directory. The coordinator
+/// writes the job options to "farm.options" and scans the input once without rendering. At
+/// every segment boundary it writes the tree state to "segment-NNNN.ckpt" and publishes the
+/// segment by creating "segment-NNNN.job". Workers claim a segment by renaming its job file,
+/// render the segment from its checkpoint into the MPEG-TS file "segment-NNNN.ts", and
+/// create "segment-NNNN.done" (or "segment-NNNN.failed"). When the scan is complete, the
+/// coordinator creates "prescan.done"; workers exit once no unclaimed segments remain.
+/// Finally, the coordinator concatenates the segments into the output file.
+///
+/// Additional workers, e.g. on other hosts sharing the directory, can join at any time.
+/// The working directory must be new or empty, so that the farm never deletes files it
+/// did not create; unless kept, it is removed after the job succeeds.
+class RenderFarm {
+private:
+    RenderOptions           options_;   ///< Options of the overall job.
+    std::string             dir_;       ///< Shared working directory.
+    size_t                  workers_;   ///< Number of local worker processes.
+    size_t                  seg_frames_;///< Number of frames per segment.
+    bool                    keep_dir_;  ///< Keep working directory after success.
+    const std::atomic_bool* abort_;     ///< External flag requesting early termination.
+    std::vector<pid_t>      pids_;      ///< Process IDs of running local workers.
+
+    bool is_aborted() const { return abort_ && *abort_; }
+    std::string segment_path(size_t index, const char* ext) const;
+    void spawn_workers();
+    void reap_workers(bool wait);
+    bool prescan(size_t& num_segments);
+    bool collect(size_t num_segments);
+    bool concatenate(size_t num_segments);
+
+public:
+    RenderFarm(const RenderOptions& options, const std::string& dir);
+    RenderFarm(const RenderFarm&) = delete;
+    RenderFarm(RenderFarm&&) = delete;
+
+    void set_workers(size_t workers) { workers_ = workers; }
+    void set_segment_frames(size_t frames) { seg_frames_ = frames; }
+    void set_keep_directory(bool keep) { keep_dir_ = keep; }
+    void set_abort_flag(const std::atomic_bool* flag) { abort_ = flag; }
+
+    int run();                                  ///< Runs the coordinator and returns a non-zero status on error.
+
+    static int work(const std::string& dir, const std::atomic_bool* abort); ///< Runs a worker on the shared directory.
+};
+
+#endif /* end of include guard: __VBC_RENDER_FARM_HPP */
@@ -0,0 +1,463 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+#include <boost/filesystem.hpp>
+
+#include "Checkpoint.hpp"
+#include "FrameHash.hpp"
+#include "RenderJob.hpp"
+#include "Scheduler.hpp"
+#include "Styles.hpp"
+#include "Trace.hpp"
+#include "Tree.hpp"
+#include "VbcReader.hpp"
+#include "VideoOutput.hpp"
+
+namespace bfs = boost::filesystem;
+
+
+RenderOptions::RenderOptions()
+    : output_path("vbcrender.avi"),
+      video_width(1920),
+      video_height(1080),
+      video_fps_n(30),
+      video_fps_d(1),
+      video_condense_n(1),
+      video_condense_d(1),
+      start_timestamp(0.0),
+      stop_timestamp(0.0),
+      clock(false),
+      bounds(false),
+      text_align(0, 2),
+      encoder_threads(0),
+      draft(false),
+      null_sink(false),
+      frame_limit(0),
+      segment_frames(1800),
+      resume(false)
+{}
+
+
+RenderJob::RenderJob(const RenderOptions& options)
+    : options_(options),
+      abort_(nullptr),
+      cancel_(false),
+      result_(),
+      error_()
+{}
+
+
+std::string RenderJob::resume_signature(const RenderOptions& opts) {
+    std::ostringstream out;
+    out.precision(17);
+    out << "input " << bfs::absolute(opts.input_paths.front()).string() << '\n'
+        << "checkpoint " << (opts.checkpoint_path.empty() ? std::string() : bfs::absolute(opts.checkpoint_path).string()) << '\n'
+        << "size " << opts.video_width << ' ' << opts.video_height << '\n'
+        << "fps " << opts.video_fps_n << ' ' << opts.video_fps_d << '\n'
+        << "condense " << opts.video_condense_n << ' ' << opts.video_condense_d << '\n'
+        << "start " << opts.start_timestamp << '\n'
+        << "stop " << opts.stop_timestamp << '\n'
+        << "frames " << opts.frame_limit << '\n'
+        << "segment " << opts.segment_frames << '\n'
+        << "overlay " << opts.clock << ' ' << opts.bounds << ' ' << opts.text_align.first << ' ' << opts.text_align.second << '\n'
+        << "encoder " << opts.encoder_threads << ' ' << opts.draft << '\n';
+
+    // Styles are compared by content, which also covers hidden categories and styles set through the library
+    const StyleSheetPtr style = opts.style ? opts.style : StyleSheet::standard();
+    out << "layout " << style->level_sep << ' ' << style->subtree_sep << ' ' << style->sibling_sep << ' ' << style->node_radius << '\n'
+        << "background " << style->background.r << ' ' << style->background.g << ' ' << style->background.b << '\n';
+    for(const NodeStyle& node_style : style->node_styles) {
+        out << "node " << node_style.node_color.r << ' ' << node_style.node_color.g << ' ' << node_style.node_color.b << ' '
+            << node_style.font_color.r << ' ' << node_style.font_color.g << ' ' << node_style.font_color.b << ' '
+            << node_style.draw_number << node_style.draw_filled << node_style.draw_circle << node_style.hidden << '\n';
+    }
+    for(const EdgeStyle& edge_style : style->edge_styles) {
+        out << "edge " << edge_style.edge_color.r << ' ' << edge_style.edge_color.g << ' ' << edge_style.edge_color.b << '\n';
+    }
+    return out.str();
+}
+
+
+std::string RenderJob::resume_file(size_t segment, const char* ext) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "segment-%04zu.%s", segment, ext);
+    return (bfs::path(options_.resume_dir) / name).string();
+}
+
+
+bool RenderJob::prepare_resume(size_t& segment, std::string& checkpoint_path) {
+    const bfs::path dir(options_.resume_dir);
+    const bfs::path progress_path = dir / "render.progress";
+    segment = 0;
+
+    // Continue after the last complete segment of the same job
+    if(options_.resume && bfs::exists(progress_path)) {
+        std::ifstream in(progress_path.c_str());
+        std::string signature, line;
+        while(std::getline(in, line)) {
+            if(line.compare(0, 9, "segments ") == 0) {
+                segment = std::stoul(line.substr(9));
+            }
+            else {
+                signature += line + '\n';
+            }
+        }
+        if(signature != resume_signature(options_)) {
+            error_ = "resume state in " + dir.string() + " belongs to a different job";
+            return false;
+        }
+        if(segment) {
+            checkpoint_path = resume_file(segment, "ckpt");
+        }
+        return true;
+    }
+
+    // Otherwise, start over in a new or empty directory, so that files found there are never deleted
+    if(bfs::exists(dir)) {
+        if(!bfs::is_directory(dir) || !bfs::is_empty(dir)) {
+            error_ = dir.string() + (options_.resume ? " holds no resumable state; remove it to start over" : " is not empty; resume the job or remove the directory");
+            return false;
+        }
+    }
+    else {
+        bfs::create_directories(dir);
+    }
+    write_file_atomic(progress_path.string(), resume_signature(options_) + "segments 0\n");
+    return true;
+}
+
+
+void RenderJob::save_resume(size_t segment, const Checkpoint& ckpt, TreePtr tree) {
+    // Progress is recorded last so that it never refers to incomplete files
+    save_checkpoint(resume_file(segment, "ckpt"), ckpt, tree);
+    write_file_atomic(
+        (bfs::path(options_.resume_dir) / "render.progress").string(),
+        resume_signature(options_) + "segments " + std::to_string(segment) + '\n'
+    );
+}
+
+
+void RenderJob::finish_resume(size_t num_segments) {
+    std::vector<std::string> segments;
+    for(size_t i = 0; i < num_segments; ++i) {
+        segments.push_back(resume_file(i, "ts"));
+    }
+    VideoOutput::concatenate(segments, options_.output_path);
+
+    // Remove the files of this job only, and the directory if nothing else is left in it
+    boost::system::error_code ec;
+    for(size_t i = 0; i < num_segments; ++i) {
+        bfs::remove(resume_file(i, "ts"), ec);
+        bfs::remove(resume_file(i, "ckpt"), ec);
+    }
+    bfs::remove(bfs::path(options_.resume_dir) / "render.progress", ec);
+    bfs::remove(options_.resume_dir, ec);
+}
+
+
+VideoOutputPtr RenderJob::start_output(const std::string& path, size_t first_frame) const {
+    VideoOutputPtr vid_out = std::make_shared<VideoOutput>();
+    vid_out->set_file_path(path);
+    vid_out->set_dim(options_.video_width, options_.video_height);
+    vid_out->set_frame_rate(
+        options_.video_fps_n,
+        options_.video_fps_d
+    );
+    vid_out->set_time_condensation(
+        options_.video_condense_n,
+        options_.video_condense_d
+    );
+    vid_out->set_time_adjustment(options_.start_timestamp);
+    vid_out->set_clock(options_.clock);
+    vid_out->set_bounds(options_.bounds);
+    vid_out->set_text_align(options_.text_align.first, options_.text_align.second);
+    vid_out->set_encoder_threads(options_.encoder_threads);
+    vid_out->set_draft(options_.draft);
+    vid_out->set_null_sink(options_.null_sink);
+    vid_out->set_hash_frames(!options_.hash_path.empty() || !options_.hash_reference_path.empty());
+    vid_out->set_first_frame(first_frame);
+    vid_out->start();
+    return vid_out;
+}
+
+
+int RenderJob::run() {
+    typedef std::chrono::steady_clock Clock;
+    typedef typename Clock::time_point TimePoint;
+    typedef std::chrono::duration<double> Seconds;
+
+    Clock clock;
+    TimePoint start_time;
+    double stream_time;
+
+    VideoOutputPtr vid_out;
+    std::vector<VbcReaderPtr> vbc_in;
+    std::vector<TreePtr> trees;
+
+    result_ = RenderProgress();
+    error_.clear();
+    hash_summary_.clear();
+
+    // The render loop counts against the thread budget
+    BusyScope busy;
+
+    // Pick up resumable state of an interrupted run
+    const bool segmented = !options_.resume_dir.empty();
+    std::string checkpoint_path = options_.checkpoint_path;
+    size_t segment = 0;
+    if(options_.null_sink && segmented) {
+        error_ = "resumable rendering requires an output file";
+        return 1;
+    }
+    if(segmented && !(options_.hash_path.empty() && options_.hash_reference_path.empty())) {
+        error_ = "frame hashes cannot be recorded in resumable rendering";
+        return 1;
+    }
+    if(options_.stream && (segmented || !checkpoint_path.empty())) {
+        error_ = "in-process event streams cannot be resumed";
+        return 1;
+    }
+    if(segmented) {
+        if(options_.input_paths.size() != 1) {
+            error_ = "resumable rendering requires exactly one input";
+            return 1;
+        }
+
+        try {
+            if(!prepare_resume(segment, checkpoint_path)) {
+                return 1;
+            }
+        } catch(const std::exception& err) {
+            error_ = err.what();
+            return 1;
+        }
+    }
+
+    // Configure VBC inputs; each reader parses its file (or drains its event stream) on a separate thread
+    Checkpoint ckpt = Checkpoint();
+    if(!checkpoint_path.empty()) {
+        if(options_.input_paths.size() != 1) {
+            error_ = "resuming from a checkpoint requires exactly one input";
+            return 1;
+        }
+
+        TreePtr tree;
+        try {
+            tree = load_checkpoint(checkpoint_path, ckpt, options_.style);
+        } catch(const std::exception& err) {
+            error_ = err.what();
+            return 1;
+        }
+        vbc_in.push_back(std::make_shared<VbcReader>(false, true, options_.style));
+        vbc_in.back()->open(options_.input_paths.front(), tree, ckpt.offset, ckpt.timestamp);
+    }
+    else if(options_.stream) {
+        vbc_in.push_back(std::make_shared<VbcReader>(false, true, options_.style));
+        if(!vbc_in.back()->open(options_.stream)) {
+            error_ = "event stream is already consumed by another reader";
+            return 1;
+        }
+    }
+    else {
+        for(const std::string& input_path : options_.input_paths) {
+            vbc_in.push_back(std::make_shared<VbcReader>(false, true, options_.style));
+            vbc_in.back()->open(input_path);
+        }
+    }
+    for(const VbcReaderPtr& reader : vbc_in) {
+        reader->wait();
+        if(reader->get_state() == VbcReader::Error) {
+            reader->advance();
+            error_ = "could not read VBC file";
+            return 1;
+        }
+        trees.push_back(reader->get_tree());
+    }
+
+    try {
+        // Configure video output and frame hashes
+        vid_out = start_output(segmented ? resume_file(segment, "ts") : options_.output_path, ckpt.frame);
+        std::unique_ptr<FrameHashLog> hashes;
+        if(vid_out->get_hash_frames()) {
+            hashes.reset(new FrameHashLog(options_.hash_path, options_.hash_reference_path, options_.video_width, options_.video_height));
+        }
+        size_t rendered = 0;
+
+        Tracer& tracer = Tracer::instance();
+        tracer.set_thread_name("render job");
+        uint64_t batch_start = 0;
+        size_t batch_events = 0;
+
+        start_time = clock.now();
+        stream_time = vid_out->get_stream_time();
+        while(true) {
+            // Check if termination has been requested
+            if(was_cancelled()) {
+                break;
+            }
+
+            // Find the reader that is furthest behind on the shared timeline
+            VbcReaderPtr next_reader;
+            bool processing = false;
+            bool error = false;
+            double next_timestamp = std::numeric_limits<double>::infinity();
+            for(const VbcReaderPtr& reader : vbc_in) {
+                VbcReader::State state = reader->get_state();
+                if(state == VbcReader::Error) {
+                    error = true;
+                    break;
+                }
+                else if(state != VbcReader::Processing) {
+                    continue;
+                }
+
+                processing = true;
+                if(!reader->has_next()) {
+                    // Wait for the event queue to be populated
+                    next_reader = reader;
+                    break;
+                }
+                else if(reader->get_next_timestamp() < next_timestamp) {
+                    next_reader = reader;
+                    next_timestamp = reader->get_next_timestamp();
+                }
+            }
+            if(error) {
+                // Report I/O error of the reader
+                for(const VbcReaderPtr& reader : vbc_in) {
+                    if(reader->get_state() == VbcReader::Error) {
+                        reader->advance();
+                    }
+                }
+                error_ = "could not read VBC file";
+                break;
+            }
+            else if(!processing) {
+                break;
+            }
+
+            if(!next_reader->has_next()) {
+                next_reader->wait();
+            }
+            else if(next_timestamp > stream_time + options_.start_timestamp) {
+                // Close the batch of events applied since the last frame
+                if(batch_events) {
+                    if(tracer.is_enabled()) {
+                        tracer.complete("apply batch", "render", batch_start, tracer.now(), batch_events);
+                    }
+                    batch_events = 0;
+                }
+
+                // Continue in a new segment once the current one is full
+                if(segmented && vid_out->get_num_frames() >= options_.segment_frames) {
+                    vid_out->stop();
+                    ++segment;
+
+                    Checkpoint next { vbc_in.front()->get_offset(), vbc_in.front()->get_timestamp(), vid_out->get_first_frame() + vid_out->get_num_frames() };
+                    save_resume(segment, next, trees.front());
+                    vid_out = start_output(resume_file(segment, "ts"), next.frame);
+                }
+
+                // Render a video frame
+                {
+                    TraceSpan span("frame", "render");
+                    vid_out->push_frame(trees);
+                }
+                if(hashes && !hashes->record(vid_out->get_first_frame() + vid_out->get_num_frames() - 1, vid_out->get_frame_hash())) {
+                    // Stop at the first frame that differs from the reference
+                    break;
+                }
+                ++rendered;
+                stream_time = vid_out->get_stream_time();
+
+                // Report progress
+                result_.runtime = std::chrono::duration_cast<Seconds>(clock.now() - start_time).count();
+                result_.clock_time = vid_out->get_clock_time();
+                result_.stream_time = stream_time;
+                result_.frames = vid_out->get_first_frame() + vid_out->get_num_frames();
+                result_.events_parsed = 0;
+                result_.events_applied = 0;
+                result_.queue_depth = 0;
+                result_.input_position = 0;
+                result_.input_applied = 0;
+                result_.input_size = 0;
+                for(const VbcReaderPtr& reader : vbc_in) {
+                    result_.events_parsed += reader->get_num_parsed();
+                    result_.events_applied += reader->get_num_applied();
+                    result_.queue_depth += reader->get_queue_depth();
+                    result_.input_position += reader->get_input_position();
+                    result_.input_applied += reader->get_applied_position();
+                    result_.input_size += reader->get_input_size();
+                }
+                if(progress_) {
+                    progress_(result_);
+                }
+            }
+            else {
+                if(!batch_events++ && tracer.is_enabled()) {
+                    batch_start = tracer.now();
+                }
+                if(!next_reader->advance()) {
+                    error_ = "could not advance VBC state";
+                    break;
+                }
+            }
+
+            // Check for early termination
+            if(options_.stop_timestamp > options_.start_timestamp && stream_time > options_.stop_timestamp - options_.start_timestamp) {
+                break;
+            }
+            if(options_.frame_limit && rendered >= options_.frame_limit) {
+                break;
+            }
+        }
+
+        vid_out->stop();
+
+        // Report frames that differ from the reference; partial runs are only compared up to their last frame
+        if(hashes) {
+            hashes->finish();
+            hash_summary_ = hashes->is_checking() ? hashes->summary() : std::string();
+            const bool partial = was_cancelled() || options_.frame_limit || options_.stop_timestamp > options_.start_timestamp;
+            if(hashes->is_checking() && error_.empty() && (hashes->get_num_mismatches() || (!partial && !hashes->matches()))) {
+                error_ = hash_summary_;
+            }
+        }
+
+        // Join segments unless the job has to be resumed later
+        if(segmented && error_.empty() && !was_cancelled()) {
+            finish_resume(segment + 1);
+        }
+    } catch(const std::exception& err) {
+        error_ = err.what();
+    }
+
+    for(const VbcReaderPtr& reader : vbc_in) {
+        reader->close();
+    }
+
+    return error_.empty() ? 0 : 1;
+}
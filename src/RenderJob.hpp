@@ -0,0 +1,142 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VBC_RENDER_JOB_HPP
+#define __VBC_RENDER_JOB_HPP
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Checkpoint.hpp"
+#include "EventStream.hpp"
+#include "VideoOutput.hpp"
+
+/// Options describing a single rendering job.
+struct RenderOptions {
+    std::vector<std::string> input_paths;       ///< Paths of VBC input files (rendered side by side).
+    EventStreamPtr stream;                      ///< Events of an in-process solver (rendered instead of input files).
+    std::string output_path;                    ///< Path of video output file.
+
+    size_t video_width;                         ///< Width of video output in pixels.
+    size_t video_height;                        ///< Height of video output in pixels.
+    size_t video_fps_n;                         ///< Numerator of frame rate.
+    size_t video_fps_d;                         ///< Denominator of frame rate.
+    size_t video_condense_n;                    ///< Numerator of time condensation factor.
+    size_t video_condense_d;                    ///< Denominator of time condensation factor.
+
+    double start_timestamp;                     ///< VBC timestamp to start rendering.
+    double stop_timestamp;                      ///< VBC timestamp to stop rendering.
+
+    bool                        clock;          ///< Render clock overlay.
+    bool                        bounds;         ///< Render bound overlay.
+    std::pair<size_t, size_t>   text_align;     ///< Alignment code for text overlay.
+
+    size_t encoder_threads;                     ///< Number of encoder threads (0 for encoder default).
+    bool draft;                                 ///< Render draft quality for quick previews.
+    bool null_sink;                             ///< Discard frames instead of encoding them (benchmarks; no output file).
+    std::string hash_path;                      ///< File to write a hash of every frame to (empty to disable).
+    std::string hash_reference_path;            ///< File of reference frame hashes to compare with (empty to disable).
+
+    std::string checkpoint_path;                ///< Checkpoint to resume rendering from (single input only).
+    size_t frame_limit;                         ///< Maximum number of frames to render (0 for no limit).
+
+    std::string resume_dir;                     ///< Directory of resumable render state (empty to disable, single input only).
+    size_t segment_frames;                      ///< Number of frames per resumable output segment.
+    bool resume;                                ///< Continue from the state in the resume directory.
+
+    StyleSheetPtr style;                        ///< Layout parameters and styles (null for standard styles).
+    std::string style_path;                     ///< VBCTOOL style resource the styles were loaded from (empty for standard styles).
+    std::string palette_path;                   ///< Palette the styles were loaded with (empty for the default palette).
+    std::vector<size_t> hidden_categories;      ///< Categories hidden with their subtrees (already applied to the styles).
+
+    RenderOptions();
+};
+
+/// Snapshot of the progress of a rendering job.
+struct RenderProgress {
+    double runtime;                             ///< Wall time since rendering started in seconds.
+    double clock_time;                          ///< Clock time at end of last rendered frame in seconds.
+    double stream_time;                         ///< Stream time at end of last rendered frame in seconds.
+    size_t frames;                              ///< Number of rendered frames.
+
+    uint64_t events_parsed;                     ///< Number of events parsed from all inputs.
+    uint64_t events_applied;                    ///< Number of events applied to the trees.
+    size_t   queue_depth;                       ///< Number of parsed events waiting to be applied.
+    uint64_t input_position;                    ///< Number of bytes read from all input files.
+    uint64_t input_applied;                     ///< Number of input bytes up to the last applied events.
+    uint64_t input_size;                        ///< Total size of all input files in bytes.
+};
+
+class RenderJob;
+typedef std::shared_ptr<RenderJob> RenderJobPtr;
+
+/// Drives VBC readers and a video output from start to end of a single rendering job.
+///
+/// If a resume directory is set, the video is rendered into MPEG-TS segments
+/// "segment-NNNN.ts" in that directory. Whenever a segment is complete, the tree state
+/// at the start of the next segment is written to "segment-NNNN.ckpt" and the number of
+/// complete segments is recorded in "render.progress". An interrupted job can continue
+/// from the last complete segment; all options that affect the output must be the same.
+/// A new job requires a new or empty directory. When the job finishes, the segments are
+/// joined into the output file and the files of the job are removed, and the directory
+/// is removed if nothing else is left in it.
+class RenderJob {
+public:
+    typedef std::function<void(const RenderProgress&)> ProgressCallback;
+
+private:
+    RenderOptions           options_;   ///< Options of this job.
+    ProgressCallback        progress_;  ///< Callback invoked after every frame.
+    const std::atomic_bool* abort_;     ///< External flag requesting early termination.
+    std::atomic_bool        cancel_;    ///< Job-specific termination request.
+
+    RenderProgress          result_;    ///< Progress at end of job.
+    std::string             error_;     ///< Error message if job failed.
+    std::string             hash_summary_; ///< Result of the comparison with reference frame hashes.
+
+    std::string resume_file(size_t segment, const char* ext) const;
+    bool prepare_resume(size_t& segment, std::string& checkpoint_path);
+    void save_resume(size_t segment, const Checkpoint& ckpt, TreePtr tree);
+    void finish_resume(size_t num_segments);
+    VideoOutputPtr start_output(const std::string& path, size_t first_frame) const;
+
+public:
+    RenderJob(const RenderOptions& options);
+    RenderJob(const RenderJob&) = delete;
+    RenderJob(RenderJob&&) = delete;
+
+    const RenderOptions& get_options() const { return options_; }   ///< Returns the job options.
+    const RenderProgress& get_result() const { return result_; }    ///< Returns the progress at the end of the job.
+    const std::string& get_error() const { return error_; }         ///< Returns the error message of a failed job.
+    const std::string& get_hash_summary() const { return hash_summary_; } ///< Returns the result of the frame hash comparison (empty if none).
+    bool was_cancelled() const { return cancel_ || (abort_ && *abort_); } ///< Indicates that the job was terminated early.
+
+    void set_progress_callback(const ProgressCallback& callback) { progress_ = callback; }
+    void set_abort_flag(const std::atomic_bool* flag) { abort_ = flag; }
+    void cancel() { cancel_ = true; }
+
+    int run();                                  ///< Renders the video and returns a non-zero status on error.
+
+    static std::string resume_signature(const RenderOptions& options);  ///< Describes the options that must match for a job to continue from resumable state.
+};
+
+#endif /* end of include guard: __VBC_RENDER_JOB_HPP */
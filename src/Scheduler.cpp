@@ -0,0 +1,336 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <limits>
+#include <stdexcept>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "Scheduler.hpp"
+
+
+/// Index of the worker running on the calling thread (npos for other threads).
+static const size_t npos = std::numeric_limits<size_t>::max();
+static thread_local size_t worker_index = npos;
+
+
+Scheduler::Scheduler()
+    : threads_(std::max(1u, std::thread::hardware_concurrency())),
+      pin_(false),
+      started_(false),
+      queued_(0),
+      dedicated_(0),
+      stop_(false)
+{}
+
+
+Scheduler::~Scheduler() {
+    {
+        std::lock_guard<std::mutex> lock(idle_m_);
+        stop_ = true;
+    }
+    idle_cv_.notify_all();
+    for(std::thread& worker : workers_) {
+        worker.join();
+    }
+}
+
+
+Scheduler& Scheduler::instance() {
+    static Scheduler scheduler;
+    return scheduler;
+}
+
+
+void Scheduler::configure(size_t threads, bool pin) {
+    std::lock_guard<std::mutex> lock(config_m_);
+    if(started_) {
+        throw std::logic_error("scheduler cannot be configured after it has started");
+    }
+    threads_ = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+    pin_ = pin;
+}
+
+
+size_t Scheduler::get_threads() const {
+    std::lock_guard<std::mutex> lock(config_m_);
+    return threads_;
+}
+
+
+bool Scheduler::get_pin() const {
+    std::lock_guard<std::mutex> lock(config_m_);
+    return pin_;
+}
+
+
+void Scheduler::start() {
+    if(started_.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(config_m_);
+    if(started_.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    // All queues exist before any worker or helper looks at them
+    for(size_t i = 0; i < threads_; ++i) {
+        queues_.emplace_back(new Queues);
+    }
+    for(size_t i = 0; i < threads_; ++i) {
+        workers_.emplace_back(&Scheduler::work, this, i);
+    }
+    started_.store(true, std::memory_order_release);
+}
+
+
+void Scheduler::work(size_t index) {
+    worker_index = index;
+
+    char name[16];
+    std::snprintf(name, sizeof(name), "worker %zu", index);
+    pthread_setname_np(pthread_self(), name);
+
+    // Pin to the CPUs the process may run on, one worker per CPU in turn
+    if(pin_) {
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if(!sched_getaffinity(0, sizeof(allowed), &allowed) && CPU_COUNT(&allowed) > 0) {
+            size_t skip = index % size_t(CPU_COUNT(&allowed));
+            for(int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                if(CPU_ISSET(cpu, &allowed) && !skip--) {
+                    cpu_set_t set;
+                    CPU_ZERO(&set);
+                    CPU_SET(cpu, &set);
+                    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+                    break;
+                }
+            }
+        }
+    }
+
+    while(true) {
+        Task task;
+        if(index < active_workers() && take(index, task)) {
+            task();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(idle_m_);
+        idle_cv_.wait(lock, [this, index] {
+            return stop_ || (queued_.load() && index < active_workers());
+        });
+        if(stop_) {
+            return;
+        }
+    }
+}
+
+
+size_t Scheduler::active_workers() const {
+    // Busy dedicated threads take the place of workers; once they use up the budget, threads
+    // waiting for tasks run them themselves
+    const size_t workers = queues_.size();
+    return workers - std::min(workers, dedicated_.load());
+}
+
+
+bool Scheduler::pop(Queues& queues, bool back, Task& task) {
+    std::lock_guard<std::mutex> lock(queues.m);
+    std::deque<Task>& tasks = queues.tasks;
+    if(tasks.empty()) {
+        return false;
+    }
+    if(back) {
+        task = std::move(tasks.back());
+        tasks.pop_back();
+    }
+    else {
+        task = std::move(tasks.front());
+        tasks.pop_front();
+    }
+    --queued_;
+    return true;
+}
+
+
+bool Scheduler::take(size_t index, Task& task) {
+    // Own tasks first (most recent, so their data is likely cached), then shared ones
+    if(index != npos && pop(*queues_[index], true, task)) {
+        return true;
+    }
+    if(pop(shared_, false, task)) {
+        return true;
+    }
+
+    // Steal the oldest task of another worker
+    const size_t workers = queues_.size();
+    const size_t first = index != npos ? index + 1 : 0;
+    for(size_t i = 0; i < workers; ++i) {
+        const size_t victim = (first + i) % workers;
+        if(victim != index && pop(*queues_[victim], false, task)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+void Scheduler::wake() {
+    // Taking the lock orders the wake-up after the check of a worker about to sleep
+    {
+        std::lock_guard<std::mutex> lock(idle_m_);
+    }
+    idle_cv_.notify_all();
+}
+
+
+void Scheduler::submit(Task task) {
+    start();
+
+    Queues& queues = worker_index < queues_.size() ? *queues_[worker_index] : shared_;
+    {
+        std::lock_guard<std::mutex> lock(queues.m);
+        queues.tasks.push_back(std::move(task));
+        ++queued_;
+    }
+    wake();
+}
+
+
+bool Scheduler::run_one() {
+    Task task;
+    if(!started_.load(std::memory_order_acquire) || !take(worker_index, task)) {
+        return false;
+    }
+    task();
+    return true;
+}
+
+
+void Scheduler::acquire(size_t threads) {
+    start();
+    dedicated_ += threads;
+}
+
+
+void Scheduler::release(size_t threads) {
+    dedicated_ -= threads;
+    wake();
+}
+
+
+std::thread Scheduler::spawn(const std::string& name, Task loop, bool busy) {
+    // Count the thread from now on so that the budget holds while it starts
+    const size_t threads = busy ? 1 : 0;
+    acquire(threads);
+
+    return std::thread([this, name, loop, threads]() {
+        pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+
+        // Return the budget even if the loop ends with an exception
+        struct Release {
+            Scheduler* scheduler;
+            size_t threads;
+            ~Release() {
+                if(threads) {
+                    scheduler->release(threads);
+                }
+            }
+        } release { this, threads };
+
+        loop();
+    });
+}
+
+
+BusyScope::BusyScope(size_t threads)
+    : threads_(threads)
+{
+    if(threads_) {
+        Scheduler::instance().acquire(threads_);
+    }
+}
+
+
+BusyScope::~BusyScope() {
+    if(threads_) {
+        Scheduler::instance().release(threads_);
+    }
+}
+
+
+TaskGroup::TaskGroup()
+    : pending_(0)
+{}
+
+
+TaskGroup::~TaskGroup() {
+    try {
+        wait();
+    } catch(...) {
+    }
+}
+
+
+void TaskGroup::run(Scheduler::Task task) {
+    ++pending_;
+    Scheduler::instance().submit([this, task]() {
+        std::exception_ptr error;
+        try {
+            task();
+        } catch(...) {
+            error = std::current_exception();
+        }
+
+        // Complete under the lock so that the group outlives the notification
+        std::lock_guard<std::mutex> lock(m_);
+        if(error && !error_) {
+            error_ = error;
+        }
+        if(--pending_ == 0) {
+            cv_.notify_all();
+        }
+    });
+}
+
+
+void TaskGroup::wait() {
+    // Help with queued tasks instead of sleeping while any are left
+    while(pending_.load()) {
+        if(Scheduler::instance().run_one()) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(m_);
+        cv_.wait_for(lock, std::chrono::milliseconds(1), [this] { return !pending_.load(); });
+    }
+
+    std::exception_ptr error;
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        std::swap(error, error_);
+    }
+    if(error) {
+        std::rethrow_exception(error);
+    }
+}
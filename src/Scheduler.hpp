@@ -0,0 +1,135 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VBC_SCHEDULER_HPP
+#define __VBC_SCHEDULER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// Process-wide work-stealing task scheduler shared by all pipeline stages.
+///
+/// Every worker owns a deque. Tasks submitted by a worker go to the back of its
+/// own deque and are taken LIFO; idle workers steal from the front of other deques, and tasks
+/// submitted by other threads go to a shared queue. Stage loops that block (readers, the
+/// encoder's main loop) run on dedicated threads started with spawn(). Threads outside the
+/// pool that do work, i.e. busy dedicated threads, render loops and encoder threads, are
+/// counted with BusyScope; for each of them one worker less takes tasks so that the thread
+/// budget holds. If they use up the whole budget, no worker takes tasks and the tasks run
+/// in the threads that wait for them (see TaskGroup).
+class Scheduler {
+public:
+    typedef std::function<void()> Task;
+
+private:
+    /// Task queue of a worker or the shared queue.
+    struct Queues {
+        std::mutex          m;                          ///< Guards the deque.
+        std::deque<Task>    tasks;                      ///< Queued tasks.
+    };
+
+    mutable std::mutex                  config_m_;      ///< Guards configuration and worker startup.
+    size_t                              threads_;       ///< Thread budget.
+    bool                                pin_;           ///< Pin workers to CPUs.
+    std::atomic_bool                    started_;       ///< Indicates that workers are running.
+
+    std::vector<std::unique_ptr<Queues>>    queues_;    ///< Queues of the workers.
+    Queues                              shared_;        ///< Queue of tasks submitted by other threads.
+    std::vector<std::thread>            workers_;       ///< Worker threads.
+    std::atomic<size_t>                 queued_;        ///< Number of queued tasks.
+    std::atomic<size_t>                 dedicated_;     ///< Number of busy dedicated threads.
+
+    std::mutex                          idle_m_;        ///< Guards sleeping workers.
+    std::condition_variable             idle_cv_;       ///< Wakes workers on new tasks or budget changes.
+    bool                                stop_;          ///< Tells workers to exit.
+
+    Scheduler();
+    ~Scheduler();
+
+    void start();
+    void work(size_t index);
+    size_t active_workers() const;
+    bool take(size_t index, Task& task);
+    bool pop(Queues& queues, bool back, Task& task);
+    void wake();
+    void acquire(size_t threads);
+    void release(size_t threads);
+
+    friend class BusyScope;
+
+public:
+    Scheduler(const Scheduler&) = delete;
+    Scheduler(Scheduler&&) = delete;
+
+    static Scheduler& instance();               ///< Returns the process-wide scheduler.
+
+    /// Sets the thread budget (0 for one thread per core) and CPU pinning of the workers.
+    /// Throws std::logic_error once the workers have been started by the first task.
+    void configure(size_t threads, bool pin);
+    size_t get_threads() const;                 ///< Returns the thread budget.
+    bool get_pin() const;                       ///< Returns whether workers are pinned to CPUs.
+
+    void submit(Task task);                     ///< Queues a task; tasks must not throw (see TaskGroup).
+    bool run_one();                             ///< Runs one queued task on the calling thread; returns false if there is none.
+
+    /// Starts a dedicated thread for a stage loop that blocks. Busy threads count against the budget;
+    /// threads that are only busy at times pass false and use BusyScope.
+    std::thread spawn(const std::string& name, Task loop, bool busy = true);
+};
+
+/// Counts threads outside the scheduler's pool against the thread budget during its lifetime.
+class BusyScope {
+private:
+    size_t threads_;    ///< Number of threads counted.
+
+public:
+    explicit BusyScope(size_t threads = 1);
+    BusyScope(const BusyScope&) = delete;
+    ~BusyScope();
+};
+
+/// Set of tasks that can be waited for.
+///
+/// Waiting threads run queued tasks instead of sleeping, so nested groups and small budgets
+/// cannot deadlock. The first exception thrown by a task is rethrown by wait().
+class TaskGroup {
+private:
+    std::atomic<size_t>     pending_;   ///< Number of unfinished tasks.
+    std::mutex              m_;         ///< Guards the error and completion.
+    std::condition_variable cv_;        ///< Signals completion of tasks.
+    std::exception_ptr      error_;     ///< First exception thrown by a task.
+
+public:
+    TaskGroup();
+    TaskGroup(const TaskGroup&) = delete;
+    ~TaskGroup();                               ///< Waits for all tasks, discarding their errors.
+
+    void run(Scheduler::Task task);             ///< Submits a task of the group.
+    void wait();                                ///< Waits for all tasks and rethrows the first error.
+};
+
+#endif /* end of include guard: __VBC_SCHEDULER_HPP */
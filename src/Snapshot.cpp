@@ -0,0 +1,153 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include <boost/filesystem.hpp>
+#include <cairo.h>
+
+#include "Render.hpp"
+#include "Scheduler.hpp"
+#include "Snapshot.hpp"
+#include "TilePyramid.hpp"
+#include "VbcReader.hpp"
+#include "VectorExport.hpp"
+
+namespace bfs = boost::filesystem;
+
+
+static std::string lowercase_extension(const std::string& path) {
+    std::string ext = bfs::extension(path);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext;
+}
+
+
+bool is_snapshot_format(const std::string& path) {
+    std::string ext = lowercase_extension(path);
+    return ext == ".png" || ext == ".pdf" || ext == ".svg" || is_tile_format(path);
+}
+
+
+void write_snapshot(const std::string& path, TreePtr tree, size_t width, size_t height) {
+    // Vector formats are streamed to keep memory bounded for large trees
+    if(is_vector_format(path)) {
+        write_vector(path, tree, width, height);
+        return;
+    }
+    if(lowercase_extension(path) != ".png") {
+        throw std::invalid_argument("unsupported snapshot format " + lowercase_extension(path));
+    }
+
+    cairo_surface_t* surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, (int)width, (int)height);
+    cairo_t* drawctx = cairo_create(surface);
+    Rect window { 10, 10, Scalar(width - 10), Scalar(height - 10) };
+    render_tree(drawctx, tree, window);
+    cairo_destroy(drawctx);
+
+    cairo_status_t status = cairo_surface_write_to_png(surface, path.c_str());
+    cairo_surface_destroy(surface);
+    if(status != CAIRO_STATUS_SUCCESS) {
+        throw std::runtime_error("could not write " + path + ": " + cairo_status_to_string(status));
+    }
+}
+
+
+SnapshotRenderer::SnapshotRenderer(const std::string& input_path, size_t width, size_t height)
+    : input_path_(input_path),
+      width_(width),
+      height_(height),
+      tile_scale_(1.0),
+      abort_(nullptr)
+{}
+
+
+void SnapshotRenderer::add_snapshot(double time, const std::string& path) {
+    shots_.push_back(std::make_pair(time, path));
+}
+
+
+int SnapshotRenderer::run() {
+    std::stable_sort(shots_.begin(), shots_.end(), [](const std::pair<double, std::string>& a, const std::pair<double, std::string>& b) {
+        return a.first < b.first;
+    });
+
+    // The replay loop counts against the thread budget
+    BusyScope busy;
+
+    VbcReaderPtr reader = std::make_shared<VbcReader>(false, true, style_);
+    reader->open(input_path_);
+
+    try {
+        for(const auto& shot : shots_) {
+            // Apply all events up to the requested time
+            while(!(abort_ && *abort_)) {
+                if(!reader->has_next()) {
+                    reader->wait();
+                }
+
+                VbcReader::State state = reader->get_state();
+                if(state == VbcReader::Error) {
+                    reader->advance();
+                    throw std::runtime_error("could not read VBC file");
+                }
+                else if(state != VbcReader::Processing) {
+                    break;
+                }
+                else if(!reader->has_next()) {
+                    continue;
+                }
+                else if(reader->get_next_timestamp() > shot.first) {
+                    break;
+                }
+                else if(!reader->advance()) {
+                    throw std::runtime_error("could not advance VBC state");
+                }
+            }
+            if(abort_ && *abort_) {
+                break;
+            }
+
+            uint64_t tiles = 0;
+            if(is_tile_format(shot.second)) {
+                TilePyramid pyramid(tile_scale_);
+                pyramid.set_abort_flag(abort_);
+                tiles = pyramid.write(shot.second, reader->get_tree());
+                if(abort_ && *abort_) {
+                    break;
+                }
+            }
+            else {
+                write_snapshot(shot.second, reader->get_tree(), width_, height_);
+            }
+            if(written_) {
+                written_(shot.second, std::isfinite(shot.first) ? shot.first : reader->get_timestamp(), tiles);
+            }
+        }
+    } catch(const std::exception& err) {
+        error_ = err.what();
+    }
+    reader->close();
+    if(error_.empty() && abort_ && *abort_) {
+        error_ = "interrupted";
+    }
+
+    return error_.empty() ? 0 : 1;
+}
@@ -0,0 +1,75 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VBC_SNAPSHOT_HPP
+#define __VBC_SNAPSHOT_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Tree.hpp"
+
+/// Indicates that the file extension denotes a supported still image format (PNG, PDF, SVG or DZI).
+bool is_snapshot_format(const std::string& path);
+
+/// Writes an image of the tree to a PNG, PDF or SVG file, depending on the file extension.
+void write_snapshot(const std::string& path, TreePtr tree, size_t width, size_t height);
+
+/// Renders still images of the tree at given solver times.
+///
+/// DeepZoom (.dzi) outputs are written as tile pyramids; all other formats are single
+/// images of the given size. The input is replayed once in order of the requested times,
+/// so every snapshot starts from the tree state reached for the previous one. Snapshots at
+/// times past the end of the input show the final tree.
+class SnapshotRenderer {
+public:
+    /// Receives the path, the solver time and the number of tiles (0 for single images) of every written snapshot.
+    typedef std::function<void(const std::string&, double, uint64_t)> WrittenCallback;
+
+private:
+    std::string                                 input_path_;    ///< Path of VBC input file.
+    size_t                                      width_;         ///< Image width in pixels (points for PDF).
+    size_t                                      height_;        ///< Image height in pixels (points for PDF).
+    double                                      tile_scale_;    ///< Pixels per layout unit at the deepest tile level.
+    StyleSheetPtr                               style_;         ///< Layout parameters and styles (null for standard styles).
+    std::vector<std::pair<double, std::string>> shots_;         ///< Requested snapshot times and paths.
+    WrittenCallback                             written_;       ///< Callback invoked after every snapshot.
+    const std::atomic_bool*                     abort_;         ///< External flag requesting early termination.
+    std::string                                 error_;         ///< Error message if rendering failed.
+
+public:
+    SnapshotRenderer(const std::string& input_path, size_t width, size_t height);
+    SnapshotRenderer(const SnapshotRenderer&) = delete;
+    SnapshotRenderer(SnapshotRenderer&&) = delete;
+
+    const std::string& get_error() const { return error_; }    ///< Returns the error message of a failed run.
+
+    void add_snapshot(double time, const std::string& path);
+    void set_tile_scale(double scale) { tile_scale_ = scale; }
+    void set_style(StyleSheetPtr style) { style_ = style; }
+    void set_written_callback(const WrittenCallback& callback) { written_ = callback; }
+    void set_abort_flag(const std::atomic_bool* flag) { abort_ = flag; }
+
+    int run();                                  ///< Renders all snapshots and returns a non-zero status on error or interruption.
+};
+
+#endif /* end of include guard: __VBC_SNAPSHOT_HPP */
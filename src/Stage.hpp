@@ -0,0 +1,35 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VBC_STAGE_HPP
+#define __VBC_STAGE_HPP
+
+/// Stages of the rendering pipeline.
+enum class Stage {
+    Parse,      ///< Parsing VBC lines into events (reader thread, in batches).
+    Apply,      ///< Applying a single event to the tree.
+    Layout,     ///< Updating the tree layout.
+    Draw,       ///< Drawing the tree onto the surface.
+    Copy,       ///< Copying pixels into the encoder buffer.
+    Push,       ///< Pushing a buffer into the encoding pipeline (includes backpressure).
+    Count
+};
+
+const char* stage_name(Stage stage);        ///< Returns a short lowercase name of the stage.
+
+#endif /* end of include guard: __VBC_STAGE_HPP */
@@ -0,0 +1,262 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+#include <boost/filesystem.hpp>
+
+#include "Styles.hpp"
+
+namespace bfs = boost::filesystem;
+
+
+/// Name of the palette file in the VBCTOOL resource directory.
+static const char* const default_palette_name = "GRAPHrgb.txt";
+
+
+static std::string trim(const std::string& str) {
+    const size_t begin = str.find_first_not_of(" \t\r\n");
+    if(begin == std::string::npos) {
+        return std::string();
+    }
+    const size_t end = str.find_last_not_of(" \t\r\n");
+    return str.substr(begin, end - begin + 1);
+}
+
+
+/// Splits a style value into the fields between '-' and '_' separators, dropping everything before the first one.
+static std::vector<std::string> split_fields(const std::string& value) {
+    std::vector<std::string> fields;
+    size_t start = value.find_first_of("-_");
+    while(start != std::string::npos && start < value.size()) {
+        start = value.find_first_not_of("-_", start);
+        if(start == std::string::npos) {
+            break;
+        }
+        const size_t end = std::min(value.find_first_of("-_", start), value.size());
+        fields.push_back(value.substr(start, end - start));
+        start = end;
+    }
+    return fields;
+}
+
+
+static SourcePtr make_source(const Color& color) {
+    return SourcePtr(cairo_pattern_create_rgb(color.r, color.g, color.b), cairo_pattern_destroy);
+}
+
+
+void StyleSheet::compile() {
+    for(NodeStyle& style : node_styles) {
+        style.source = make_source(style.node_color);
+    }
+    for(EdgeStyle& style : edge_styles) {
+        style.source = make_source(style.edge_color);
+    }
+}
+
+
+StyleSheetPtr StyleSheet::hide_categories(const std::vector<size_t>& categories) const {
+    StyleSheet sheet(*this);
+    for(size_t category : categories) {
+        if(category >= sheet.node_styles.size()) {
+            throw std::invalid_argument("unknown category " + std::to_string(category));
+        }
+        sheet.node_styles[category].hidden = true;
+    }
+    return std::make_shared<const StyleSheet>(std::move(sheet));
+}
+
+
+StyleSheetPtr StyleSheet::standard() {
+    // Built and compiled once from the generated tables
+    static const StyleSheetPtr sheet = [] {
+        StyleSheet standard {
+            tree_level_sep,
+            tree_subtree_sep,
+            tree_sibling_sep,
+            tree_node_radius,
+            background_color,
+            node_style_table,
+            edge_style_table
+        };
+        standard.compile();
+        return std::make_shared<const StyleSheet>(std::move(standard));
+    }();
+    return sheet;
+}
+
+
+StyleSheetPtr StyleSheet::load(const std::string& resource_path, const std::string& palette_path) {
+    // Load palette of named colors
+    const std::string palette_file = palette_path.empty()
+        ? (bfs::path(resource_path).parent_path() / default_palette_name).string()
+        : palette_path;
+    std::ifstream palette_in(palette_file.c_str());
+    if(!palette_in) {
+        throw std::runtime_error("could not open palette " + palette_file);
+    }
+
+    std::map<std::string, Color> palette;
+    std::string line;
+    while(std::getline(palette_in, line)) {
+        std::istringstream fields(line);
+        int r, g, b;
+        std::string name, extra;
+        if(fields >> r >> g >> b >> name && !(fields >> extra)) {
+            palette[name] = Color { r / Scalar(255), g / Scalar(255), b / Scalar(255) };
+        }
+    }
+
+    // Start from the defaults of the VBCTOOL resource format
+    StyleSheet sheet {
+        Scalar(4.0),
+        Scalar(6.0),
+        Scalar(6.0),
+        Scalar(20.0),
+        Color { 1, 1, 1 },
+        std::vector<NodeStyle>(),
+        std::vector<EdgeStyle>()
+    };
+
+    std::ifstream in(resource_path.c_str());
+    if(!in) {
+        throw std::runtime_error("could not open style resource " + resource_path);
+    }
+
+    size_t line_num = 0;
+    auto lookup = [&](const std::string& name) {
+        auto it = palette.find(trim(name));
+        if(it == palette.end()) {
+            throw std::invalid_argument("unknown color '" + trim(name) + "' in line " + std::to_string(line_num) + " of " + resource_path);
+        }
+        return it->second;
+    };
+    auto number = [&](const std::string& value) {
+        try {
+            return Scalar(std::stod(value));
+        } catch(const std::exception&) {
+            throw std::invalid_argument("invalid number in line " + std::to_string(line_num) + " of " + resource_path);
+        }
+    };
+    auto index = [&](const std::string& name) {
+        std::istringstream fields(name);
+        std::string key;
+        size_t idx;
+        if(!(fields >> key >> idx) || idx > 4096) {
+            throw std::invalid_argument("invalid style number in line " + std::to_string(line_num) + " of " + resource_path);
+        }
+        return idx;
+    };
+    auto flag = [](const std::string& flags, size_t i) {
+        return flags.size() > i && (flags[i] == 'y' || flags[i] == 'Y');
+    };
+
+    while(std::getline(in, line)) {
+        ++line_num;
+
+        // Skip comments and lines without a value
+        line = trim(line);
+        if(line.empty() || line[0] == '#') {
+            continue;
+        }
+        const size_t colon = line.find(':');
+        if(colon == std::string::npos) {
+            continue;
+        }
+        const std::string name = trim(line.substr(0, colon));
+        const std::string value = line.substr(colon + 1);
+
+        if(name == "DrawAreaBackgroundColor") {
+            sheet.background = lookup(value);
+        }
+        else if(name == "TreeLevelSeparationValue") {
+            sheet.level_sep = number(value);
+        }
+        else if(name == "TreeSubtreeSeparationValue") {
+            sheet.subtree_sep = number(value);
+        }
+        else if(name == "TreeSiblingSeparationValue") {
+            sheet.sibling_sep = number(value);
+        }
+        else if(name == "TreeNodeRadiusValue") {
+            sheet.node_radius = number(value);
+        }
+        else if(name.compare(0, 5, "Nodes") == 0) {
+            const size_t idx = index(name);
+            const std::vector<std::string> fields = split_fields(value);
+            if(fields.size() < 4) {
+                continue;
+            }
+
+            const std::string flags = trim(fields[3]);
+            NodeStyle style {
+                lookup(fields[0]),
+                lookup(fields[1]),
+                flag(flags, 0),
+                flag(flags, 1),
+                flag(flags, 2),
+                fields.size() < 5 ? std::string() : trim(fields[4]),
+                SourcePtr(),
+                false
+            };
+
+            // Undefined styles up to this one are drawn as filled black circles
+            while(sheet.node_styles.size() <= idx) {
+                sheet.node_styles.push_back(NodeStyle {
+                    Color { 0, 0, 0 }, Color { 1, 1, 1 }, false, true, true,
+                    "Undefined Node Type " + std::to_string(sheet.node_styles.size()), SourcePtr(), false
+                });
+            }
+            sheet.node_styles[idx] = style;
+        }
+        else if(name.compare(0, 5, "Edges") == 0) {
+            const size_t idx = index(name);
+            const std::vector<std::string> fields = split_fields(value);
+            if(fields.empty()) {
+                continue;
+            }
+
+            while(sheet.edge_styles.size() <= idx) {
+                sheet.edge_styles.push_back(EdgeStyle { Color { 0, 0, 0 }, SourcePtr() });
+            }
+            sheet.edge_styles[idx].edge_color = lookup(fields[0]);
+        }
+    }
+
+    // Trees are drawn with edge style 1 and start with nodes of style 1
+    if(sheet.node_styles.empty()) {
+        throw std::invalid_argument("style resource " + resource_path + " defines no node styles");
+    }
+    while(sheet.node_styles.size() < 2) {
+        sheet.node_styles.push_back(NodeStyle {
+            Color { 0, 0, 0 }, Color { 1, 1, 1 }, false, true, true,
+            "Undefined Node Type " + std::to_string(sheet.node_styles.size()), SourcePtr(), false
+        });
+    }
+    while(sheet.edge_styles.size() < 2) {
+        sheet.edge_styles.push_back(EdgeStyle { Color { 0, 0, 0 }, SourcePtr() });
+    }
+
+    sheet.compile();
+    return std::make_shared<const StyleSheet>(std::move(sheet));
+}
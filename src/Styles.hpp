@@ -19,11 +19,15 @@
 #ifndef __VBC_STYLES_HPP
 #define __VBC_STYLES_HPP
 
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "Types.hpp"
 
+/// Shared Cairo source pattern.
+typedef std::shared_ptr<cairo_pattern_t> SourcePtr;
+
 struct NodeStyle {
     Color       node_color;     ///< Color of node marker
     Color       font_color;     ///< Color of node text
@@ -31,10 +35,13 @@ struct NodeStyle {
     bool        draw_filled;    ///< Indicates whether the node marker should be filled
     bool        draw_circle;    ///< Indicates whether the node marker is a circle or square
     std::string name;           ///< Name of the style
+    SourcePtr   source;         ///< Precompiled Cairo source of the node color (null until compiled)
+    bool        hidden;         ///< Indicates whether nodes of this style are hidden together with their subtrees
 };
 
 struct EdgeStyle {
-    Color edge_color;           ///< Color of the edge
+    Color       edge_color;     ///< Color of the edge
+    SourcePtr   source;         ///< Precompiled Cairo source of the edge color (null until compiled)
 };
 
 extern Scalar tree_level_sep;   ///< Vertical separation between nodes on subsequent levels of the tree
@@ -46,4 +53,34 @@ extern Color background_color;  ///< Background color
 extern std::vector<NodeStyle> node_style_table; ///< Table of node styles
 extern std::vector<EdgeStyle> edge_style_table; ///< Table of edge styles
 
+/// Layout parameters and styles used to lay out and draw a tree.
+struct StyleSheet {
+    Scalar                  level_sep;      ///< Vertical separation between nodes on subsequent levels of the tree
+    Scalar                  subtree_sep;    ///< Horizontal separation between contour nodes in adjacent subtrees
+    Scalar                  sibling_sep;    ///< Horizontal separation between adjacent siblings
+    Scalar                  node_radius;    ///< Radius (or half of side length) of node markers
+    Color                   background;     ///< Background color
+    std::vector<NodeStyle>  node_styles;    ///< Node styles by category
+    std::vector<EdgeStyle>  edge_styles;    ///< Edge styles
+
+    void compile();                                         ///< Creates the Cairo sources of all styles.
+    std::shared_ptr<const StyleSheet> hide_categories(const std::vector<size_t>& categories) const;   ///< Returns a copy with the given node styles hidden.
+
+    static std::shared_ptr<const StyleSheet> standard();   ///< Returns the shared VBCTOOL standard styles.
+
+    /// Loads a VBCTOOL style resource (.rsc) using the given palette, or GRAPHrgb.txt next to the resource.
+    static std::shared_ptr<const StyleSheet> load(const std::string& resource_path, const std::string& palette_path = std::string());
+};
+typedef std::shared_ptr<const StyleSheet> StyleSheetPtr;
+
+/// Selects the precompiled source of a style, or its color if the style sheet was not compiled.
+inline void set_style_source(Canvas* canvas, const SourcePtr& source, const Color& color) {
+    if(source) {
+        cairo_set_source(canvas, source.get());
+    }
+    else {
+        cairo_set_source_rgb(canvas, color.r, color.g, color.b);
+    }
+}
+
 #endif /* end of include guard: __VBC_STYLES_HPP */
@@ -0,0 +1,197 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "Json.hpp"
+#include "Profiler.hpp"
+#include "Telemetry.hpp"
+
+
+/// Reads virtual and resident memory size of this process in bytes.
+static bool read_memory_usage(uint64_t& vm_bytes, uint64_t& rss_bytes) {
+    std::ifstream in("/proc/self/statm");
+    uint64_t vm_pages, rss_pages;
+    if(!(in >> vm_pages >> rss_pages)) {
+        return false;
+    }
+
+    uint64_t page_size = sysconf(_SC_PAGESIZE);
+    vm_bytes = vm_pages * page_size;
+    rss_bytes = rss_pages * page_size;
+    return true;
+}
+
+
+/// Returns the rate of change between two samples.
+static double rate(uint64_t prev, uint64_t cur, double seconds) {
+    return seconds > 0.0 ? double(cur - prev) / seconds : 0.0;
+}
+
+
+Telemetry::Telemetry(const std::string& target)
+    : fd_(-1),
+      own_fd_(true),
+      socket_(false),
+      samples_(0),
+      first_(),
+      last_()
+{
+    if(target == "-") {
+        fd_ = STDOUT_FILENO;
+        own_fd_ = false;
+    }
+    else if(target.compare(0, 3, "fd:") == 0) {
+        try {
+            fd_ = std::stoi(target.substr(3));
+        } catch(const std::exception&) {
+            throw std::invalid_argument("invalid telemetry file descriptor: " + target);
+        }
+        own_fd_ = false;
+    }
+    else if(target.compare(0, 5, "unix:") == 0) {
+        sockaddr_un addr;
+        std::string path = target.substr(5);
+        if(path.size() >= sizeof(addr.sun_path)) {
+            throw std::invalid_argument("telemetry socket path too long: " + path);
+        }
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+        fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+        if(fd_ < 0 || connect(fd_, (const sockaddr*)&addr, sizeof(addr)) < 0) {
+            std::string err = std::strerror(errno);
+            if(fd_ >= 0) {
+                ::close(fd_);
+            }
+            throw std::runtime_error("could not connect to telemetry socket " + path + ": " + err);
+        }
+        socket_ = true;
+    }
+    else {
+        fd_ = open(target.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if(fd_ < 0) {
+            throw std::runtime_error("could not open telemetry file " + target + ": " + std::strerror(errno));
+        }
+    }
+}
+
+
+Telemetry::~Telemetry() {
+    if(fd_ >= 0 && own_fd_) {
+        ::close(fd_);
+    }
+}
+
+
+void Telemetry::send_line(const std::string& line) {
+    const char* data = line.data();
+    size_t remaining = line.size();
+    while(fd_ >= 0 && remaining) {
+        ssize_t sent = socket_ ? send(fd_, data, remaining, MSG_NOSIGNAL) : ::write(fd_, data, remaining);
+        if(sent < 0 && errno == EINTR) {
+            continue;
+        }
+        else if(sent <= 0) {
+            // Stop reporting instead of failing the render
+            std::cerr << "TELEMETRY: " << std::strerror(errno) << ", telemetry disabled" << std::endl;
+            if(own_fd_) {
+                ::close(fd_);
+            }
+            fd_ = -1;
+            return;
+        }
+        data += sent;
+        remaining -= sent;
+    }
+}
+
+
+void Telemetry::write(const RenderProgress& progress, const std::string& type) {
+    if(fd_ < 0) {
+        return;
+    }
+    if(samples_++ == 0) {
+        first_ = progress;
+    }
+
+    std::ostringstream out;
+    double interval = progress.runtime - last_.runtime;
+    out << "{\"type\":" << json_string(type)
+        << ",\"runtime\":" << json_number(progress.runtime)
+        << ",\"clock_time\":" << json_number(progress.clock_time)
+        << ",\"stream_time\":" << json_number(progress.stream_time)
+        << ",\"frames\":" << progress.frames
+        << ",\"frames_per_sec\":" << json_number(rate(last_.frames, progress.frames, interval))
+        << ",\"events_parsed\":" << progress.events_parsed
+        << ",\"events_applied\":" << progress.events_applied
+        << ",\"parsed_per_sec\":" << json_number(rate(last_.events_parsed, progress.events_parsed, interval))
+        << ",\"applied_per_sec\":" << json_number(rate(last_.events_applied, progress.events_applied, interval))
+        << ",\"queue_depth\":" << progress.queue_depth
+        << ",\"input_bytes\":" << progress.input_position
+        << ",\"input_applied\":" << progress.input_applied
+        << ",\"input_size\":" << progress.input_size;
+
+    // Extrapolate progress and remaining time from the input applied so far; the reader
+    // may be far ahead of the renderer, so the bytes read would underestimate the ETA
+    double fraction = std::numeric_limits<double>::quiet_NaN();
+    double eta = std::numeric_limits<double>::quiet_NaN();
+    if(progress.input_size && progress.input_size >= progress.input_applied) {
+        fraction = double(progress.input_applied) / double(progress.input_size);
+        if(progress.input_applied > first_.input_applied) {
+            double input_rate = rate(first_.input_applied, progress.input_applied, progress.runtime - first_.runtime);
+            if(input_rate > 0.0) {
+                eta = double(progress.input_size - progress.input_applied) / input_rate;
+            }
+        }
+    }
+    out << ",\"progress\":" << json_number(fraction)
+        << ",\"eta\":" << json_number(eta);
+
+    // Time spent per pipeline stage
+    out << ",\"stages\":{";
+    for(size_t i = 0; i < size_t(Stage::Count); ++i) {
+        StageTotals totals = Profiler::instance().get_totals(Stage(i));
+        out << (i ? "," : "") << json_string(stage_name(Stage(i)))
+            << ":{\"samples\":" << totals.samples
+            << ",\"items\":" << totals.items
+            << ",\"seconds\":" << json_number(totals.nanoseconds / 1e9) << '}';
+    }
+    out << '}';
+
+    uint64_t vm_bytes, rss_bytes;
+    if(read_memory_usage(vm_bytes, rss_bytes)) {
+        out << ",\"vm_bytes\":" << vm_bytes << ",\"rss_bytes\":" << rss_bytes;
+    }
+    out << "}\n";
+
+    send_line(out.str());
+    last_ = progress;
+}
@@ -0,0 +1,53 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VBC_TELEMETRY_HPP
+#define __VBC_TELEMETRY_HPP
+
+#include <string>
+
+#include "RenderJob.hpp"
+
+/// Writes progress samples of a rendering job as JSON lines.
+///
+/// The target is "-" for standard output, "fd:N" for an inherited file descriptor,
+/// "unix:PATH" for a Unix stream socket to connect to, or the path of a file to append to.
+/// Each line holds the progress counters, rates since the previous sample, the fraction of
+/// the input applied and an ETA estimated from it, the accumulated time per pipeline stage,
+/// and memory usage.
+class Telemetry {
+private:
+    int             fd_;        ///< Output file descriptor (-1 when disabled).
+    bool            own_fd_;    ///< Close file descriptor on destruction.
+    bool            socket_;    ///< Output is a socket.
+    size_t          samples_;   ///< Number of samples written.
+    RenderProgress  first_;     ///< First sample (baseline for the ETA).
+    RenderProgress  last_;      ///< Previous sample (baseline for rates).
+
+    void send_line(const std::string& line);
+
+public:
+    Telemetry(const std::string& target);
+    Telemetry(const Telemetry&) = delete;
+    Telemetry(Telemetry&&) = delete;
+    ~Telemetry();
+
+    void write(const RenderProgress& progress, const std::string& type = "progress");
+};
+
+#endif /* end of include guard: __VBC_TELEMETRY_HPP */
@@ -0,0 +1,310 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <cairo.h>
+
+#include "Profiler.hpp"
+#include "Scheduler.hpp"
+#include "TilePyramid.hpp"
+
+namespace bfs = boost::filesystem;
+
+
+bool is_tile_format(const std::string& path) {
+    std::string ext = bfs::extension(path);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == ".dzi";
+}
+
+
+TilePyramid::TilePyramid(double scale)
+    : scale_(scale),
+      abort_(nullptr),
+      bbox_(),
+      width_(0),
+      height_(0),
+      levels_(0),
+      next_(0),
+      written_(0)
+{}
+
+
+void TilePyramid::flatten(Tree& tree) {
+    entries_.clear();
+    entries_.reserve(tree.num_nodes());
+
+    // Close subtrees when the traversal returns to a shallower depth
+    std::vector<std::pair<size_t, size_t>> open;    // entry index and depth
+    auto close = [this, &open]() {
+        Entry& entry = entries_[open.back().first];
+        entry.end = entries_.size();
+        open.pop_back();
+        if(!open.empty()) {
+            Entry& parent = entries_[open.back().first];
+            parent.x0 = std::min(parent.x0, entry.x0);
+            parent.x1 = std::max(parent.x1, entry.x1);
+            parent.y1 = std::max(parent.y1, entry.y1);
+        }
+    };
+
+    Tree::PreOrderIterator it(tree);
+    const Tree::PreOrderIterator end(tree.children().end(), tree.children().end());
+    for(; it != end; ++it) {
+        const Node* node = it->get();
+        if(!node->visible()) {
+            continue;
+        }
+        while(!open.empty() && open.back().second >= node->depth()) {
+            close();
+        }
+        open.emplace_back(entries_.size(), node->depth());
+        entries_.push_back(Entry { node->x(), node->y(), node->x(), node->x(), node->y(), 0, node->category() });
+    }
+    while(!open.empty()) {
+        close();
+    }
+}
+
+
+bool TilePyramid::render_tile(size_t level, uint64_t column, uint64_t row) {
+#ifdef M_PI
+    static const Scalar pi_2 = Scalar(2 * M_PI);
+#else
+    static const Scalar pi_2 = Scalar(8 * std::atan(1));
+#endif
+
+    // Level geometry and tile extent in layout units
+    const Scalar scale = Scalar(scale_ / std::ldexp(1.0, int(levels_ - 1 - level)));
+    const uint64_t level_w = std::max<uint64_t>(1, uint64_t(std::ceil(width_ / std::ldexp(1.0, int(levels_ - 1 - level)))));
+    const uint64_t level_h = std::max<uint64_t>(1, uint64_t(std::ceil(height_ / std::ldexp(1.0, int(levels_ - 1 - level)))));
+    const int tile_w = int(std::min<uint64_t>(tile_size, level_w - column * tile_size));
+    const int tile_h = int(std::min<uint64_t>(tile_size, level_h - row * tile_size));
+
+    const Scalar line_width = std::max(Scalar(2), 1 / scale);
+    const StyleSheet& style = *style_;
+    const Scalar radius = std::max(style.node_radius, 1 / scale);
+    const Scalar margin = radius + line_width;
+    const Scalar tx0 = bbox_.x0 + Scalar(column * tile_size) / scale - margin;
+    const Scalar ty0 = bbox_.y0 + Scalar(row * tile_size) / scale - margin;
+    const Scalar tx1 = bbox_.x0 + Scalar(column * tile_size + tile_w) / scale + margin;
+    const Scalar ty1 = bbox_.y0 + Scalar(row * tile_size + tile_h) / scale + margin;
+
+    // Cull subtrees outside of the tile and collapse subtrees below a pixel
+    std::vector<size_t> markers;
+    std::vector<size_t> points;
+    std::vector<std::pair<size_t, size_t>> edges;
+    size_t i = 0;
+    while(i < entries_.size()) {
+        const Entry& entry = entries_[i];
+        if(entry.x1 < tx0 || entry.x0 > tx1 || entry.y1 < ty0 || entry.y > ty1) {
+            i = entry.end;
+            continue;
+        }
+        if((entry.x1 - entry.x0 + 2 * style.node_radius) * scale < 1 && (entry.y1 - entry.y + 2 * style.node_radius) * scale < 1) {
+            points.push_back(i);
+            i = entry.end;
+            continue;
+        }
+
+        markers.push_back(i);
+        for(size_t child = i + 1; child < entry.end; child = entries_[child].end) {
+            const Entry& c = entries_[child];
+            if(std::max(entry.x, c.x) >= tx0 && std::min(entry.x, c.x) <= tx1 && c.y >= ty0 && entry.y <= ty1) {
+                edges.emplace_back(i, child);
+            }
+        }
+        ++i;
+    }
+    if(markers.empty() && points.empty() && edges.empty()) {
+        return false;
+    }
+
+    // Draw edges, then node markers and points batched per category
+    cairo_surface_t* surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, tile_w, tile_h);
+    cairo_t* canvas = cairo_create(surface);
+    cairo_set_source_rgb(canvas, style.background.r, style.background.g, style.background.b);
+    cairo_paint(canvas);
+
+    cairo_matrix_t matrix;
+    cairo_matrix_init(&matrix, scale, 0, 0, scale,
+                      -(bbox_.x0 * scale) - Scalar(column * tile_size), -(bbox_.y0 * scale) - Scalar(row * tile_size));
+    cairo_set_matrix(canvas, &matrix);
+
+    const EdgeStyle& edge_style = style.edge_styles[1];
+    cairo_set_line_width(canvas, line_width);
+    set_style_source(canvas, edge_style.source, edge_style.edge_color);
+    for(const auto& edge : edges) {
+        cairo_move_to(canvas, entries_[edge.first].x, entries_[edge.first].y);
+        cairo_line_to(canvas, entries_[edge.second].x, entries_[edge.second].y);
+    }
+    cairo_stroke(canvas);
+
+    for(size_t cat = 0; cat < style.node_styles.size(); ++cat) {
+        const NodeStyle& node_style = style.node_styles[cat];
+        bool any = false;
+        for(size_t index : markers) {
+            const Entry& entry = entries_[index];
+            if(entry.category != cat) {
+                continue;
+            }
+            cairo_new_sub_path(canvas);
+            if(node_style.draw_circle) {
+                cairo_arc(canvas, entry.x, entry.y, radius, 0, pi_2);
+            }
+            else {
+                cairo_rectangle(canvas, entry.x - radius, entry.y - radius, 2 * radius, 2 * radius);
+            }
+            any = true;
+        }
+        if(any) {
+            set_style_source(canvas, node_style.source, node_style.node_color);
+            if(node_style.draw_filled) {
+                cairo_fill(canvas);
+            }
+            else {
+                cairo_stroke(canvas);
+            }
+        }
+
+        any = false;
+        for(size_t index : points) {
+            const Entry& entry = entries_[index];
+            if(entry.category == cat) {
+                cairo_rectangle(canvas, entry.x - 1 / scale, entry.y - 1 / scale, 2 / scale, 2 / scale);
+                any = true;
+            }
+        }
+        if(any) {
+            set_style_source(canvas, node_style.source, node_style.node_color);
+            cairo_fill(canvas);
+        }
+    }
+    cairo_destroy(canvas);
+
+    // Write tile
+    std::string path = (bfs::path(dir_) / std::to_string(level) / (std::to_string(column) + "_" + std::to_string(row) + ".png")).string();
+    cairo_status_t status = cairo_surface_write_to_png(surface, path.c_str());
+    cairo_surface_destroy(surface);
+    if(status != CAIRO_STATUS_SUCCESS) {
+        throw std::runtime_error("could not write " + path + ": " + cairo_status_to_string(status));
+    }
+    return true;
+}
+
+
+void TilePyramid::render_tiles() {
+    const uint64_t total = first_.back();
+    while(!(abort_ && *abort_)) {
+        uint64_t index = next_++;
+        if(index >= total) {
+            break;
+        }
+
+        // Locate level, column, and row of tile
+        size_t level = size_t(std::upper_bound(first_.begin(), first_.end(), index) - first_.begin()) - 1;
+        uint64_t level_w = std::max<uint64_t>(1, uint64_t(std::ceil(width_ / std::ldexp(1.0, int(levels_ - 1 - level)))));
+        uint64_t columns = (level_w + tile_size - 1) / tile_size;
+        uint64_t column = (index - first_[level]) % columns;
+        uint64_t row = (index - first_[level]) / columns;
+
+        try {
+            StageTimer timer(Stage::Draw);
+            if(render_tile(level, column, row)) {
+                ++written_;
+            }
+        } catch(const std::exception& err) {
+            std::lock_guard<std::mutex> lock(m_);
+            error_ = err.what();
+            next_ = total;
+        }
+    }
+}
+
+
+uint64_t TilePyramid::write(const std::string& path, TreePtr tree) {
+    {
+        StageTimer timer(Stage::Layout);
+        tree->update_layout();
+    }
+    flatten(*tree);
+    style_ = tree->style_sheet();
+
+    // Determine image size and levels; level 0 is a single pixel
+    bbox_ = tree->bounding_box();
+    if(!tree->has_visible_nodes()) {
+        // Background only; the size of a single node keeps the pyramid valid
+        const Scalar radius = tree->style().node_radius;
+        bbox_ = Rect { -radius, -radius, radius, radius };
+    }
+    width_ = std::max<uint64_t>(1, uint64_t(std::ceil((bbox_.x1 - bbox_.x0) * scale_)));
+    height_ = std::max<uint64_t>(1, uint64_t(std::ceil((bbox_.y1 - bbox_.y0) * scale_)));
+    levels_ = size_t(std::ceil(std::log2(double(std::max(width_, height_))))) + 1;
+    first_.assign(1, 0);
+    for(size_t level = 0; level < levels_; ++level) {
+        uint64_t level_w = std::max<uint64_t>(1, uint64_t(std::ceil(width_ / std::ldexp(1.0, int(levels_ - 1 - level)))));
+        uint64_t level_h = std::max<uint64_t>(1, uint64_t(std::ceil(height_ / std::ldexp(1.0, int(levels_ - 1 - level)))));
+        first_.push_back(first_.back() + ((level_w + tile_size - 1) / tile_size) * ((level_h + tile_size - 1) / tile_size));
+    }
+
+    // Create tile directories
+    bfs::path dzi(path);
+    dir_ = (dzi.parent_path() / (dzi.stem().string() + "_files")).string();
+    for(size_t level = 0; level < levels_; ++level) {
+        bfs::create_directories(bfs::path(dir_) / std::to_string(level));
+    }
+
+    // Render tiles in parallel
+    next_ = 0;
+    written_ = 0;
+    error_.clear();
+    TaskGroup renderers;
+    size_t threads = Scheduler::instance().get_threads();
+    for(size_t i = 0; i < threads; ++i) {
+        renderers.run([this] { render_tiles(); });
+    }
+    renderers.wait();
+    entries_.clear();
+    entries_.shrink_to_fit();
+
+    if(!error_.empty()) {
+        throw std::runtime_error(error_);
+    }
+    if(abort_ && *abort_) {
+        return written_;
+    }
+
+    // Write descriptor last so that viewers never see an incomplete pyramid
+    std::ofstream out(path.c_str());
+    out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        << "<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\" TileSize=\"" << tile_size << "\" Overlap=\"0\" Format=\"png\">\n"
+        << "  <Size Width=\"" << width_ << "\" Height=\"" << height_ << "\"/>\n"
+        << "</Image>\n";
+    out.close();
+    if(!out) {
+        throw std::runtime_error("could not write " + path);
+    }
+
+    return written_;
+}
@@ -0,0 +1,87 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VBC_TILE_PYRAMID_HPP
+#define __VBC_TILE_PYRAMID_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Tree.hpp"
+#include "Types.hpp"
+
+/// Indicates that the file extension denotes a DeepZoom image (.dzi).
+bool is_tile_format(const std::string& path);
+
+/// Renders the laid-out tree into a DeepZoom tile pyramid.
+///
+/// The descriptor is written to the given .dzi path and the PNG tiles to the directory
+/// <stem>_files/<level>/<column>_<row>.png next to it. The deepest level shows the tree
+/// at the given number of pixels per layout unit; every level above halves the
+/// resolution down to a single pixel. Tiles are rendered in parallel. The tree is
+/// flattened in pre-order with the bounding box of every subtree, so each tile skips the
+/// subtrees outside of it, and subtrees smaller than a pixel are drawn as a single point.
+/// Tiles without any content are not written; viewers show them as background.
+class TilePyramid {
+private:
+    /// Node in pre-order with the bounding box of its subtree.
+    struct Entry {
+        Scalar  x, y;       ///< Node position.
+        Scalar  x0, x1;     ///< Horizontal extent of the subtree.
+        Scalar  y1;         ///< Bottom of the subtree.
+        size_t  end;        ///< Index past the last node of the subtree.
+        size_t  category;   ///< Node category.
+    };
+
+    double                  scale_;     ///< Pixels per layout unit at the deepest level.
+    const std::atomic_bool* abort_;     ///< External flag requesting early termination.
+
+    std::vector<Entry>      entries_;   ///< Flattened tree.
+    StyleSheetPtr           style_;     ///< Styles of the tree.
+    Rect                    bbox_;      ///< Bounding box of the tree.
+    uint64_t                width_;     ///< Image width at the deepest level.
+    uint64_t                height_;    ///< Image height at the deepest level.
+    size_t                  levels_;    ///< Number of levels.
+    std::vector<uint64_t>   first_;     ///< Index of the first tile of each level (plus total).
+    std::string             dir_;       ///< Tile directory.
+
+    std::atomic<uint64_t>   next_;      ///< Next tile to render.
+    std::atomic<uint64_t>   written_;   ///< Number of tiles written.
+    std::mutex              m_;         ///< Mutex protecting the error message.
+    std::string             error_;     ///< Error message of a failed tile.
+
+    void flatten(Tree& tree);
+    void render_tiles();
+    bool render_tile(size_t level, uint64_t column, uint64_t row);
+
+public:
+    static const size_t tile_size = 256;    ///< Side length of tiles in pixels.
+
+    TilePyramid(double scale);
+    TilePyramid(const TilePyramid&) = delete;
+    TilePyramid(TilePyramid&&) = delete;
+
+    void set_abort_flag(const std::atomic_bool* flag) { abort_ = flag; }
+
+    uint64_t write(const std::string& path, TreePtr tree); ///< Writes the pyramid and returns the number of tiles.
+};
+
+#endif /* end of include guard: __VBC_TILE_PYRAMID_HPP */
@@ -0,0 +1,155 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <fstream>
+#include <stdexcept>
+
+#include <pthread.h>
+
+#include "Json.hpp"
+#include "Trace.hpp"
+
+
+Tracer::Tracer()
+    : enabled_(false),
+      epoch_(Clock::now())
+{}
+
+
+Tracer& Tracer::instance() {
+    // Never destroyed, so that scheduler workers can record until they are joined at exit
+    static Tracer* tracer = new Tracer;
+    return *tracer;
+}
+
+
+void Tracer::enable() {
+    epoch_ = Clock::now();
+    enabled_ = true;
+}
+
+
+uint64_t Tracer::now() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - epoch_).count();
+}
+
+
+Tracer::ThreadBuffer& Tracer::local_buffer() {
+    thread_local ThreadBufferPtr buffer;
+    if(!buffer) {
+        buffer = std::make_shared<ThreadBuffer>();
+
+        // Default to the system name of the thread, e.g. of GStreamer streaming threads
+        char name[32] = "";
+        pthread_getname_np(pthread_self(), name, sizeof(name));
+        buffer->name = name;
+
+        std::lock_guard<std::mutex> lock(m_);
+        buffer->tid = buffers_.size() + 1;
+        buffers_.push_back(buffer);
+    }
+    return *buffer;
+}
+
+
+void Tracer::append(const Event& event) {
+    ThreadBuffer& buffer = local_buffer();
+    std::lock_guard<std::mutex> lock(buffer.m);
+    buffer.events.push_back(event);
+}
+
+
+void Tracer::set_thread_name(const std::string& name) {
+    if(!is_enabled()) {
+        return;
+    }
+
+    ThreadBuffer& buffer = local_buffer();
+    std::lock_guard<std::mutex> lock(buffer.m);
+    buffer.name = name;
+}
+
+
+void Tracer::complete(const char* name, const char* cat, uint64_t start, uint64_t end, uint64_t count) {
+    if(is_enabled()) {
+        append(Event { name, cat, 'X', start, end - start, 0, count });
+    }
+}
+
+
+void Tracer::async_begin(const char* name, const char* cat, uint64_t id) {
+    if(is_enabled()) {
+        append(Event { name, cat, 'b', now(), 0, id, 0 });
+    }
+}
+
+
+void Tracer::async_end(const char* name, const char* cat, uint64_t id) {
+    if(is_enabled()) {
+        append(Event { name, cat, 'e', now(), 0, id, 0 });
+    }
+}
+
+
+void Tracer::write(const std::string& path) const {
+    std::ofstream out(path.c_str(), std::ios::trunc);
+    if(!out) {
+        throw std::runtime_error("could not open trace file " + path);
+    }
+
+    std::vector<ThreadBufferPtr> buffers;
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        buffers = buffers_;
+    }
+
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    for(const ThreadBufferPtr& buffer : buffers) {
+        std::lock_guard<std::mutex> lock(buffer->m);
+
+        // Name the thread
+        out << (first ? "" : ",\n")
+            << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->tid
+            << ",\"args\":{\"name\":" << json_string(buffer->name) << "}}";
+        first = false;
+
+        for(const Event& event : buffer->events) {
+            out << ",\n{\"name\":" << json_string(event.name)
+                << ",\"cat\":" << json_string(event.cat)
+                << ",\"ph\":\"" << event.phase << '"'
+                << ",\"ts\":" << json_number(event.ts / 1e3)
+                << ",\"pid\":1,\"tid\":" << buffer->tid;
+            if(event.phase == 'X') {
+                out << ",\"dur\":" << json_number(event.dur / 1e3);
+            }
+            else {
+                out << ",\"id\":" << event.id;
+            }
+            if(event.count) {
+                out << ",\"args\":{\"count\":" << event.count << '}';
+            }
+            out << '}';
+        }
+    }
+    out << "\n]}\n";
+
+    if(!out) {
+        throw std::runtime_error("could not write trace file " + path);
+    }
+}
@@ -0,0 +1,112 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VBC_TRACE_HPP
+#define __VBC_TRACE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/// Records spans of the rendering pipeline in the Chrome trace event format.
+///
+/// Every thread appends to its own buffer, so threads never contend with each other while
+/// recording. Recording is disabled until enable() is called. Instrumented code checks
+/// is_enabled(), a relaxed load, before it reads the clock, so disabled tracing adds no
+/// clock reads. The trace can be opened in chrome://tracing or Perfetto.
+class Tracer {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    /// Single trace event.
+    struct Event {
+        const char* name;       ///< Event name (static string).
+        const char* cat;        ///< Event category (static string).
+        char        phase;      ///< Chrome trace phase ('X' complete, 'b'/'e' async begin/end).
+        uint64_t    ts;         ///< Start time in nanoseconds since the trace epoch.
+        uint64_t    dur;        ///< Duration in nanoseconds (complete events only).
+        uint64_t    id;         ///< Identifier matching async begin and end events.
+        uint64_t    count;      ///< Number of items covered by the event (0 if not applicable).
+    };
+
+private:
+    /// Event buffer of a single thread.
+    struct ThreadBuffer {
+        uint64_t            tid;        ///< Trace thread ID.
+        std::string         name;       ///< Thread name.
+        std::mutex          m;          ///< Guards the events while the trace is written.
+        std::vector<Event>  events;     ///< Recorded events.
+    };
+    typedef std::shared_ptr<ThreadBuffer> ThreadBufferPtr;
+
+    std::atomic_bool                enabled_;   ///< Indicates that events are recorded.
+    Clock::time_point               epoch_;     ///< Time of trace start.
+    mutable std::mutex              m_;         ///< Guards the list of thread buffers.
+    std::vector<ThreadBufferPtr>    buffers_;   ///< Buffers of all threads that recorded events.
+
+    Tracer();
+    ThreadBuffer& local_buffer();
+    void append(const Event& event);
+
+public:
+    Tracer(const Tracer&) = delete;
+    Tracer(Tracer&&) = delete;
+
+    static Tracer& instance();                  ///< Returns the process-wide tracer.
+
+    void enable();                              ///< Starts recording events.
+    bool is_enabled() const { return enabled_.load(std::memory_order_relaxed); }
+    uint64_t now() const;                       ///< Returns nanoseconds since trace start.
+
+    void set_thread_name(const std::string& name);  ///< Names the calling thread in the trace.
+    void complete(const char* name, const char* cat, uint64_t start, uint64_t end, uint64_t count = 0);
+    void async_begin(const char* name, const char* cat, uint64_t id);
+    void async_end(const char* name, const char* cat, uint64_t id);
+
+    void write(const std::string& path) const;  ///< Writes all recorded events to a JSON file.
+};
+
+/// Records a complete event spanning the lifetime of the object if tracing is enabled.
+class TraceSpan {
+private:
+    const char* name_;
+    const char* cat_;
+    uint64_t    start_;
+    bool        active_;
+
+public:
+    TraceSpan(const char* name, const char* cat)
+        : name_(name), cat_(cat), start_(0), active_(Tracer::instance().is_enabled())
+    {
+        if(active_) {
+            start_ = Tracer::instance().now();
+        }
+    }
+    TraceSpan(const TraceSpan&) = delete;
+    ~TraceSpan() {
+        if(active_) {
+            Tracer::instance().complete(name_, cat_, start_, Tracer::instance().now());
+        }
+    }
+};
+
+#endif /* end of include guard: __VBC_TRACE_HPP */
@@ -16,8 +16,11 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <cmath>
 #include <limits>
+#include <stdexcept>
+#include <vector>
 
 #include <cairo.h>
 
@@ -29,7 +32,8 @@ Node::Node(size_t seqnum)
     : parent_(nullptr),
       s_(seqnum),
       d_(0),
-      cat_(0)
+      cat_(0),
+      hidden_(false)
 {}
 
 
@@ -184,13 +188,21 @@ Tree::PreOrderIterator& Tree::PreOrderIterator::operator--() {
 }
 
 
-Tree::Tree()
+Tree::Tree(StyleSheetPtr style)
     : NodeBase(),
+      style_(style ? style : StyleSheet::standard()),
       lb_(-std::numeric_limits<double>::infinity()),
       ub_(std::numeric_limits<double>::infinity()),
       stale_(true),
-      bbox_()
-{}
+      bbox_(),
+      num_nodes_(0),
+      num_leaves_(0),
+      category_count_()
+{
+    for(const NodeStyle& node_style : style_->node_styles) {
+        hidden_categories_.push_back(node_style.hidden);
+    }
+}
 
 
 void Tree::add_node(size_t seqnum, size_t parent_seqnum, size_t category) {
@@ -203,7 +215,7 @@ void Tree::add_node(size_t seqnum, size_t parent_seqnum, size_t category) {
     if(parent_seqnum > 0 && (parent_seqnum >= index_.size() || !(parent = index_[parent_seqnum]))) {
         throw std::invalid_argument("unknown parent sequence number");
     }
-    if(category >= node_style_table.size()) {
+    if(category >= style_->node_styles.size()) {
         throw std::invalid_argument("unknown category code");
     }
 
@@ -211,17 +223,35 @@ void Tree::add_node(size_t seqnum, size_t parent_seqnum, size_t category) {
     NodePtr node = std::make_shared<Node>(seqnum);
     node->set_parent(parent_seqnum ? static_cast<NodeBase*>(parent.get()) : static_cast<NodeBase*>(this));
 
+    // Update statistics; the new node is a leaf and its parent may have been one
+    ++num_nodes_;
+    ++num_leaves_;
+    if(parent && parent->children().size() == 1) {
+        --num_leaves_;
+    }
+    if(depth_count_.size() <= node->depth()) {
+        depth_count_.resize(node->depth() + 1, 0);
+    }
+    ++depth_count_[node->depth()];
+    if(category_count_.size() <= category) {
+        category_count_.resize(category + 1, 0);
+    }
+    ++category_count_[category];
+
     // Enter node into sequence index
     if(index_.size() <= seqnum) {
         index_.resize(seqnum + 1);
     }
     index_[seqnum] = node;
 
-    // Set node category
+    // Set node category and inherit visibility
     node->set_category(category);
+    node->hidden_ = !category_visible(category) || (parent && parent->hidden_);
 
-    // Mark layout as stale
-    stale_ = true;
+    // Mark layout as stale unless the node is hidden
+    if(!node->hidden_) {
+        stale_ = true;
+    }
 }
 
 
@@ -233,20 +263,36 @@ void Tree::remove_node(size_t seqnum) {
     }
 
     // Attempt to orphan node (will throw exception if impossible)
+    NodePtr parent = node->parent();
     node->set_parent(nullptr);
 
+    // Update statistics; the removed node was a leaf and its parent may become one
+    --num_nodes_;
+    --num_leaves_;
+    if(parent && parent->children().empty()) {
+        ++num_leaves_;
+    }
+    --depth_count_[node->depth()];
+    while(!depth_count_.empty() && !depth_count_.back()) {
+        depth_count_.pop_back();
+    }
+    --category_count_[node->category()];
+
     // Remove node from sequence index
     index_[seqnum].reset();
 
-    // Mark layout as stale
-    stale_ = true;
+    // Mark layout as stale unless the node was hidden; nothing is drawn until the next layout
+    if(!node->hidden_) {
+        stale_ = true;
+        drawn_.clear();
+    }
 }
 
 
 void Tree::set_category(size_t seqnum, size_t category) {
     // Validate category code
     NodePtr node;
-    if(category >= node_style_table.size()) {
+    if(category >= style_->node_styles.size()) {
         throw std::out_of_range("invalid node category code");
     }
     if(seqnum >= index_.size() || !(node = index_[seqnum])) {
@@ -254,7 +300,140 @@ void Tree::set_category(size_t seqnum, size_t category) {
     }
 
     // Set new category
+    if(category_count_.size() <= category) {
+        category_count_.resize(category + 1, 0);
+    }
+    --category_count_[node->category()];
+    ++category_count_[category];
     node->set_category(category);
+
+    // Show or hide the subtree if the node's visibility changed
+    Node* parent = dynamic_cast<Node*>(node->parent_);
+    if(node->hidden_ != (!category_visible(category) || (parent && parent->hidden_))) {
+        update_visibility(node.get());
+        stale_ = true;
+    }
+}
+
+
+void Tree::set_category_visible(size_t category, bool visible) {
+    if(category_visible(category) == visible) {
+        return;
+    }
+    if(hidden_categories_.size() <= category) {
+        hidden_categories_.resize(category + 1, false);
+    }
+    hidden_categories_[category] = !visible;
+
+    // Only nodes of the category and their subtrees can change
+    if(category_count(category)) {
+        for(const NodePtr& root : children_) {
+            update_visibility(root.get());
+        }
+        stale_ = true;
+    }
+}
+
+
+bool Tree::has_visible_nodes() const {
+    // Descendants of hidden roots are hidden as well
+    for(const NodePtr& root : children_) {
+        if(!root->hidden_) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+void Tree::update_visibility(Node* root) {
+    // Parents are updated before their children
+    std::vector<Node*> pending { root };
+    while(!pending.empty()) {
+        Node* node = pending.back();
+        pending.pop_back();
+
+        Node* parent = dynamic_cast<Node*>(node->parent_);
+        node->hidden_ = !category_visible(node->cat_) || (parent && parent->hidden_);
+        for(const NodePtr& child : node->children_) {
+            pending.push_back(child.get());
+        }
+    }
+}
+
+
+void Tree::set_style(StyleSheetPtr style) {
+    if(!style) {
+        throw std::invalid_argument("missing style sheet");
+    }
+    for(size_t cat = style->node_styles.size(); cat < category_count_.size(); ++cat) {
+        if(category_count_[cat]) {
+            throw std::invalid_argument("style sheet lacks categories used by the tree");
+        }
+    }
+    style_ = style;
+    stale_ = true;
+
+    // Reset category visibility to the new style sheet
+    hidden_categories_.clear();
+    for(const NodeStyle& node_style : style_->node_styles) {
+        hidden_categories_.push_back(node_style.hidden);
+    }
+    for(const NodePtr& root : children_) {
+        update_visibility(root.get());
+    }
+}
+
+
+double Tree::relative_gap() const {
+    double scale = std::max(std::fabs(lb_), std::fabs(ub_));
+    if(!std::isfinite(scale)) {
+        return std::numeric_limits<double>::infinity();
+    }
+    return scale > 0 ? std::fabs(ub_ - lb_) / scale : 0.0;
+}
+
+
+TreePtr Tree::clone() const {
+    TreePtr copy = std::make_shared<Tree>(style_);
+    copy->lb_ = lb_;
+    copy->ub_ = ub_;
+    copy->stale_ = stale_;
+    copy->bbox_ = bbox_;
+    copy->index_.resize(index_.size());
+    copy->num_nodes_ = num_nodes_;
+    copy->num_leaves_ = num_leaves_;
+    copy->depth_count_ = depth_count_;
+    copy->category_count_ = category_count_;
+    copy->hidden_categories_ = hidden_categories_;
+
+    // Copy all children of a node at once to preserve their order
+    std::vector<std::pair<const NodeBase*, NodeBase*>> pending { { this, copy.get() } };
+    while(!pending.empty()) {
+        const NodeBase* src = pending.back().first;
+        NodeBase* dst = pending.back().second;
+        pending.pop_back();
+
+        for(const NodePtr& child : src->children()) {
+            NodePtr node = std::make_shared<Node>(child->s_);
+            node->set_parent(dst);
+            node->cat_ = child->cat_;
+            node->minfo_ = child->minfo_;
+            node->ginfo_ = child->ginfo_;
+            node->x_ = child->x_;
+            node->y_ = child->y_;
+            node->xshft_ = child->xshft_;
+            node->hidden_ = child->hidden_;
+            copy->index_[node->s_] = node;
+            pending.emplace_back(child.get(), node.get());
+        }
+    }
+    copy->drawn_.reserve(drawn_.size());
+    for(const Node* node : drawn_) {
+        copy->drawn_.push_back(copy->index_[node->s_].get());
+    }
+
+    return copy;
 }
 
 
@@ -264,10 +443,66 @@ void Tree::update_layout() {
         return;
     }
 
+    // Detach hidden subtrees so that the layout never visits them; splicing keeps their list positions valid
+    std::vector<std::pair<NodeBase*, ChildrenIterator>> detached;     // former parent and next sibling
+    ChildrenList hidden;
+    if(std::find(hidden_categories_.begin(), hidden_categories_.end(), true) != hidden_categories_.end()) {
+        std::vector<NodeBase*> pending { this };
+        while(!pending.empty()) {
+            ChildrenList& children = pending.back()->children();
+            NodeBase* parent = pending.back();
+            pending.pop_back();
+
+            for(ChildrenIterator it = children.begin(); it != children.end();) {
+                ChildrenIterator next = std::next(it);
+                if((*it)->hidden_) {
+                    detached.emplace_back(parent, next);
+                    hidden.splice(hidden.end(), children, it);
+                }
+                else if(!(*it)->children_.empty()) {
+                    pending.push_back(it->get());
+                }
+                it = next;
+            }
+        }
+    }
+
+    // Lay out the visible nodes and list them in sequence order for drawing
+    drawn_.clear();
+    if(!children_.empty()) {
+        layout_nodes();
+
+        std::vector<const NodeBase*> pending { this };
+        while(!pending.empty()) {
+            const NodeBase* parent = pending.back();
+            pending.pop_back();
+            for(const NodePtr& child : parent->children()) {
+                drawn_.push_back(child.get());
+                pending.push_back(child.get());
+            }
+        }
+        std::sort(drawn_.begin(), drawn_.end(), [](const Node* a, const Node* b) { return a->s_ < b->s_; });
+    }
+    else {
+        bbox_ = Rect { 0, 0, 0, 0 };
+    }
+
+    // Reattach hidden subtrees in reverse order so that every next sibling is in place again
+    while(!detached.empty()) {
+        detached.back().first->children().splice(detached.back().second, hidden, std::prev(hidden.end()));
+        detached.pop_back();
+    }
+
+    // Mark layout as not stale
+    stale_ = false;
+}
+
+
+void Tree::layout_nodes() {
     // Calculate node and subtree separation
-    const Scalar actual_sibling_sep = 2 * tree_node_radius + tree_sibling_sep;
-    const Scalar actual_subtree_sep = 2 * tree_node_radius + tree_subtree_sep;
-    const Scalar actual_level_sep = 2 * tree_node_radius + tree_level_sep;
+    const Scalar actual_sibling_sep = 2 * style_->node_radius + style_->sibling_sep;
+    const Scalar actual_subtree_sep = 2 * style_->node_radius + style_->subtree_sep;
+    const Scalar actual_level_sep = 2 * style_->node_radius + style_->level_sep;
 
     // Traverse tree
     PostOrderIterator it(*this);
@@ -400,17 +635,14 @@ void Tree::update_layout() {
 
         ++pre_it;
     }
-    bbox_.x0 -= tree_node_radius;
-    bbox_.x1 += tree_node_radius;
-    bbox_.y0 -= tree_node_radius;
-    bbox_.y1 += tree_node_radius;
-
-    // Mark layout as not stale
-    stale_ = false;
+    bbox_.x0 -= style_->node_radius;
+    bbox_.x1 += style_->node_radius;
+    bbox_.y0 -= style_->node_radius;
+    bbox_.y1 += style_->node_radius;
 }
 
 
-void Tree::draw(Canvas* canvas, bool raster_protect) {
+void Tree::draw(Canvas* canvas, bool raster_protect) const {
 #ifdef M_PI
     static const Scalar pi_2 = Scalar(2 * M_PI);
 #else
@@ -429,45 +661,38 @@ void Tree::draw(Canvas* canvas, bool raster_protect) {
 
     // Calculate adjusted dimensions
     const Scalar actual_line_width  = raster_protect ? std::max(Scalar(2), 1 / scale) : Scalar(2);
-    const Scalar actual_node_radius = raster_protect ? std::max(tree_node_radius, 1 / scale) : tree_node_radius;
+    const Scalar actual_node_radius = raster_protect ? std::max(style_->node_radius, 1 / scale) : style_->node_radius;
     const Scalar actual_node_side   = 2 * actual_node_radius;
 
-    // Fetch edge color
-    Color edge_color = edge_style_table[1].edge_color;
-
     // Set line width
     cairo_set_line_width(canvas, actual_line_width);
 
     // Draw edges
-    cairo_set_source_rgb(
-        canvas,
-        edge_color.r,
-        edge_color.g,
-        edge_color.b
-    );
-    for(const NodePtr& node_ptr : index_) {
-        Node *node, *parent;
-        if((node = node_ptr.get()) && (parent = dynamic_cast<Node*>(node->parent_))) {
+    const EdgeStyle& edge_style = style_->edge_styles[1];
+    set_style_source(canvas, edge_style.source, edge_style.edge_color);
+    for(const Node* node : drawn_) {
+        const Node* parent;
+        if(!node->hidden_ && (parent = dynamic_cast<const Node*>(node->parent_))) {
             cairo_move_to(canvas, node->x_, node->y_);
             cairo_line_to(canvas, parent->x_, parent->y_);
         }
     }
     cairo_stroke(canvas);
 
-    // Draw nodes
-    for(auto node_it = index_.cbegin(); node_it != index_.cend(); ++node_it) {
-        Node* node;
-        if(!(node = node_it->get())) {
+    // Draw nodes one at a time in sequence order, so that overlapping markers and their
+    // anti-aliased edges compose as before; only the source is kept across nodes of a style
+    const NodeStyle* current = nullptr;
+    for(const Node* node : drawn_) {
+        if(node->hidden_ || node->category() >= style_->node_styles.size()) {
             continue;
         }
+
         // Set up drawing context for node
-        const NodeStyle& style = node_style_table[node->category()];
-        cairo_set_source_rgb(
-            canvas,
-            style.node_color.r,
-            style.node_color.g,
-            style.node_color.b
-        );
+        const NodeStyle& style = style_->node_styles[node->category()];
+        if(&style != current) {
+            set_style_source(canvas, style.source, style.node_color);
+            current = &style;
+        }
 
         // Define path for node marker
         cairo_new_sub_path(canvas);
@@ -489,3 +714,52 @@ void Tree::draw(Canvas* canvas, bool raster_protect) {
         // TODO: Draw text if requested
     }
 }
+
+
+void Tree::draw_points(Canvas* canvas) const {
+    // Stop if there are no nodes
+    if(children().empty()) {
+        return;
+    }
+
+    // Edges and points are one and two device pixels wide
+    cairo_matrix_t matrix;
+    cairo_get_matrix(canvas, &matrix);
+    const Scalar scale = std::min(std::fabs(matrix.xx), std::fabs(matrix.yy));
+    const Scalar point_side = std::min(2 * style_->node_radius, 2 / scale);
+
+    // Draw edges
+    const EdgeStyle& edge_style = style_->edge_styles[1];
+    cairo_set_line_width(canvas, 1 / scale);
+    set_style_source(canvas, edge_style.source, edge_style.edge_color);
+    for(const Node* node : drawn_) {
+        const Node* parent;
+        if(!node->hidden_ && (parent = dynamic_cast<const Node*>(node->parent_))) {
+            cairo_move_to(canvas, node->x_, node->y_);
+            cairo_line_to(canvas, parent->x_, parent->y_);
+        }
+    }
+    cairo_stroke(canvas);
+
+    // Collect visible nodes per category so that every category is filled at once
+    std::vector<std::vector<const Node*>> batches(style_->node_styles.size());
+    for(const Node* node : drawn_) {
+        if(!node->hidden_ && node->category() < batches.size()) {
+            batches[node->category()].push_back(node);
+        }
+    }
+
+    // Draw nodes as filled squares regardless of their style
+    for(size_t cat = 0; cat < batches.size(); ++cat) {
+        if(batches[cat].empty()) {
+            continue;
+        }
+
+        const NodeStyle& style = style_->node_styles[cat];
+        set_style_source(canvas, style.source, style.node_color);
+        for(const Node* node : batches[cat]) {
+            cairo_rectangle(canvas, node->x_ - point_side / 2, node->y_ - point_side / 2, point_side, point_side);
+        }
+        cairo_fill(canvas);
+    }
+}
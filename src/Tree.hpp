@@ -25,6 +25,7 @@
 #include <string>
 #include <vector>
 
+#include "Styles.hpp"
 #include "Types.hpp"
 
 
@@ -74,6 +75,7 @@ private:
     Scalar x_;                  ///< X coordinate
     Scalar y_;                  ///< Y coordinate
     Scalar xshft_;              ///< X shift of subtree
+    bool hidden_;               ///< Node or one of its ancestors is of a hidden category
 
 public:
     Node(size_t seqnum);
@@ -85,6 +87,9 @@ public:
     size_t category() const { return cat_; }
     std::string main_info() const { return minfo_; }
     std::string general_info() const { return ginfo_; }
+    Scalar x() const { return x_; }     ///< Returns the X coordinate of the last layout.
+    Scalar y() const { return y_; }     ///< Returns the Y coordinate of the last layout.
+    bool visible() const { return !hidden_; }   ///< Returns whether the node is laid out and drawn.
 
     void set_parent(NodeBase* parent);
     void set_category(size_t category) { cat_ = category; }
@@ -159,17 +164,32 @@ public:
     };
 
 private:
+    StyleSheetPtr style_;                   ///< Layout parameters and styles
     double lb_;                             ///< Global lower bound for objective function value
     double ub_;                             ///< Global upper bound for objective function value
     bool stale_;                            ///< Indicates that the layout needs to be updated
     Rect bbox_;                             ///< Bounding box determined by last layout
     std::vector<NodePtr> index_;            ///< Nodes by sequence number
 
+    size_t num_nodes_;                      ///< Number of nodes
+    size_t num_leaves_;                     ///< Number of leaves
+    std::vector<size_t> depth_count_;       ///< Number of nodes by depth (no trailing zeros)
+    std::vector<size_t> category_count_;    ///< Number of nodes by category
+    std::vector<bool> hidden_categories_;   ///< Categories whose nodes are hidden with their subtrees
+    std::vector<const Node*> drawn_;        ///< Visible nodes in sequence order as of the last layout
+
+    void update_visibility(Node* root);     ///< Recomputes the visibility of a subtree from its parent.
+    void layout_nodes();                    ///< Lays out all nodes that are attached to the tree.
+
 public:
-    Tree();
+    explicit Tree(StyleSheetPtr style = nullptr);    ///< Creates an empty tree (standard styles if none are given).
     Tree(const Tree&) = delete;
     Tree(Tree&&) = delete;
 
+    const StyleSheet& style() const { return *style_; }     ///< Returns the layout parameters and styles.
+    StyleSheetPtr style_sheet() const { return style_; }    ///< Returns the shared style sheet.
+    void set_style(StyleSheetPtr style);                    ///< Replaces the style sheet, resets category visibility to it and marks the layout as stale.
+
     double lower_bound() const { return lb_; }
     double upper_bound() const { return ub_; }
     void set_lower_bound(double bound) { lb_ = bound; }
@@ -180,9 +200,24 @@ public:
     void remove_node(size_t node);
     void set_category(size_t node, size_t category);
 
+    size_t num_nodes() const { return num_nodes_; }                         ///< Returns the number of nodes.
+    size_t num_leaves() const { return num_leaves_; }                       ///< Returns the number of leaves.
+    size_t max_depth() const { return depth_count_.empty() ? 0 : depth_count_.size() - 1; } ///< Returns the depth of the deepest node.
+    size_t category_count(size_t category) const { return category < category_count_.size() ? category_count_[category] : 0; } ///< Returns the number of nodes of a category.
+    double relative_gap() const;                                            ///< Returns |UB - LB| / max(|LB|, |UB|).
+
+    bool category_visible(size_t category) const { return category >= hidden_categories_.size() || !hidden_categories_[category]; } ///< Returns whether nodes of a category are shown.
+    void set_category_visible(size_t category, bool visible);               ///< Shows or hides nodes of a category with their subtrees.
+    bool has_visible_nodes() const;                                         ///< Returns whether any node is laid out and drawn.
+
+    TreePtr clone() const;                  ///< Returns a deep copy of the tree, including its layout.
+
     void update_layout();
     Rect bounding_box() const { return bbox_; }
-    void draw(Canvas* canvas, bool raster_protect = false);
+
+    /// Draws the nodes that were visible at the last update_layout() without visiting hidden ones.
+    void draw(Canvas* canvas, bool raster_protect = false) const;
+    void draw_points(Canvas* canvas) const; ///< Draws hairline edges and nodes as pixel-sized squares, batched per category.
 };
 
 #endif /* end of include guard: __VBC_TREE_HPP */
@@ -16,25 +16,71 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <functional>
 #include <iostream>
 #include <limits>
 #include <sstream>
+#include <streambuf>
 #include <typeindex>
 #include <typeinfo>
 
 #include <boost/filesystem.hpp>
+#include <boost/iostreams/concepts.hpp>
 #include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/read.hpp>
 #include <boost/iostreams/device/file.hpp>
 #include <boost/iostreams/filter/bzip2.hpp>
 #include <boost/iostreams/filter/gzip.hpp>
 
+#include "Profiler.hpp"
+#include "Scheduler.hpp"
 #include "VbcReader.hpp"
 
 namespace bfs = boost::filesystem;
 namespace bio = boost::iostreams;
 
 
+/// Number of lines parsed between two samples of the parse stage timer.
+static const size_t parse_batch_lines = 1024;
+
+
+/// Returns whether a VBC file is decompressed on the fly.
+static bool is_compressed(const std::string& filename) {
+    std::string ext = bfs::extension(filename);
+    return ext == ".gz" || ext == ".GZ" || ext == ".bz2" || ext == ".BZ2";
+}
+
+
+/// Input filter that counts the bytes read from the underlying device.
+class ByteCounter : public bio::multichar_input_filter {
+private:
+    std::atomic<uint64_t>* count_;
+
+public:
+    explicit ByteCounter(std::atomic<uint64_t>* count) : count_(count) {}
+
+    template<typename Source>
+    std::streamsize read(Source& src, char* s, std::streamsize n) {
+        std::streamsize result = bio::read(src, s, n);
+        if(result > 0) {
+            count_->fetch_add(result, std::memory_order_relaxed);
+        }
+        return result;
+    }
+};
+
+
+/// Stream buffer that reads a line in place instead of copying it.
+class LineBuffer : public std::streambuf {
+public:
+    void reset(std::string& line) {
+        char* begin = &line[0];
+        setg(begin, begin, begin + line.size());
+    }
+};
+
+
 VbcReader::EOSEvent::EOSEvent()
     : Event(std::numeric_limits<size_t>::max(), -1.0)
 {}
@@ -58,17 +104,44 @@ void VbcReader::IOErrorEvent::apply(TreePtr tree) {}
 void VbcReader::IOErrorEvent::revert(TreePtr tree) {}
 
 
-VbcReader::VbcReader(bool rewindable, bool strip_info)
+VbcReader::VbcReader(bool rewindable, bool strip_info, StyleSheetPtr style)
     : rewind_(rewindable),
       strip_(strip_info),
+      style_(style),
       running_(false),
-      stopreq_(false)
+      stopreq_(false),
+      read_offset_(0),
+      input_pos_(0),
+      decoded_pos_(0),
+      decoded_in_(0),
+      compressed_(false),
+      parsed_(0),
+      input_size_(0),
+      queue_limit_(0),
+      timestamp_(0.0),
+      offset_(0),
+      applied_(0)
 {}
 
 
 VbcReader::~VbcReader() {
     // Wait for reader thread termination
+    stop();
+}
+
+
+void VbcReader::stop() {
     stopreq_ = true;
+
+    // Wake a read thread waiting for room in the event queue or for events from the solver
+    {
+        std::lock_guard<std::mutex> lock(m_);
+    }
+    room_cv_.notify_all();
+    if(stream_) {
+        stream_->abandon();
+    }
+
     if(reader_.joinable()) {
         reader_.join();
     }
@@ -76,10 +149,14 @@ VbcReader::~VbcReader() {
 
 
 EventPtr VbcReader::push_event(EventPtr old_head, EventPtr new_head) {
+    // Remember where the line that produced this event ends
+    new_head->set_offset(read_offset_);
+
     {
         std::lock_guard<std::mutex> lock(m_);
         fwd_.push_back(new_head);
     }
+    parsed_.fetch_add(1, std::memory_order_relaxed);
 
     // Notify waiting thread that advancement is now possible
     cv_.notify_one();
@@ -88,41 +165,90 @@ EventPtr VbcReader::push_event(EventPtr old_head, EventPtr new_head) {
 };
 
 
-void VbcReader::read_file(std::string filename) {
-    typedef typename bio::filtering_istream::traits_type traits_type;
+void VbcReader::read_file(std::string filename, uint64_t offset) {
+    typedef typename std::istringstream::traits_type traits_type;
     typedef typename traits_type::int_type int_type;
 
     EventPtr head;
-    bio::filtering_istream in;
+    bio::filtering_istream input;
 
     // Build pipeline based on file extensions
+    const bool compressed = is_compressed(filename);
     std::string ext = bfs::extension(filename);
     if(ext == ".gz" || ext == ".GZ") {
-        in.push(bio::gzip_decompressor());
+        input.push(bio::gzip_decompressor());
     }
     else if(ext == ".bz2" || ext == ".BZ2") {
-        in.push(bio::bzip2_decompressor());
+        input.push(bio::bzip2_decompressor());
     }
-    in.push(bio::file_source(filename));
+
+    // Seek directly to the resume offset in uncompressed files
+    bio::file_source source(filename);
+    input_pos_ = 0;
+    if(offset && !compressed && source.is_open()) {
+        source.seek(offset, BOOST_IOS::beg);
+        input_pos_ = offset;
+    }
+    input.push(ByteCounter(&input_pos_));
+    input.push(source);
 
     // Test if file was successfully opened
-    bio::file_source* file = in.component<bio::file_source>(in.size() - 1);
+    bio::file_source* file = input.component<bio::file_source>(input.size() - 1);
     if(!file->is_open()) {
         head = push_event(head, std::make_shared<IOErrorEvent>("Could not open VBC file"));
     }
 
-    // Read from file
+    // Skip decompressed data up to the resume offset
+    if(offset && compressed && input) {
+        input.ignore(offset);
+    }
+    read_offset_ = offset;
+
+    // Read from file line by line to keep track of the offset of every event
     size_t event_seq = 0;
     char field[128];
     bool error = false;
-    while(!stopreq_ && !error && in) {
+    std::string line;
+    LineBuffer line_buffer;
+    std::istream in(&line_buffer);
+    Tracer& tracer = Tracer::instance();
+    tracer.set_thread_name("vbc reader");
+    const bool timed = tracer.is_enabled() || Profiler::instance().is_enabled();
+    const bool counted = timed && PerfCounters::is_enabled();
+    PerfCounts batch_counts = counted ? PerfCounters::read() : PerfCounts();
+    uint64_t batch_start = timed ? tracer.now() : 0;
+    size_t batch_lines = 0;
+    while(!stopreq_ && !error && std::getline(input, line)) {
+        read_offset_ += line.size() + (input.eof() ? 0 : 1);
+
+        // Sample parse time in batches to keep the timer overhead low
+        if(++batch_lines == parse_batch_lines) {
+            if(timed) {
+                uint64_t now = tracer.now();
+                if(counted) {
+                    PerfCounts counts = PerfCounters::read();
+                    Profiler::instance().record_counts(Stage::Parse, batch_counts, counts);
+                    batch_counts = counts;
+                }
+                Profiler::instance().record(Stage::Parse, now - batch_start, batch_lines);
+                tracer.complete("parse batch", "reader", batch_start, now, batch_lines);
+                batch_start = now;
+            }
+            decoded_in_.store(input_pos_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            decoded_pos_.store(read_offset_, std::memory_order_relaxed);
+            batch_lines = 0;
+        }
+
+        line_buffer.reset(line);
+        in.clear();
+
         // Ignore leading whitespace
         in >> std::ws;
 
         // Peek at next character to determine type of line
         int_type nchar = in.get();
         if(nchar == traits_type::eof()) {
-            break;
+            continue;
         }
         else if(nchar == '#') {
             // Read metadata line
@@ -172,6 +298,7 @@ void VbcReader::read_file(std::string filename) {
             if(!(in >> std::ws >> opcode)) {
                 head = push_event(head, std::make_shared<IOErrorEvent>("incomplete operation encountered"));
                 error = true;
+                continue;
             }
 
             // Read remainder of line depending on opcode
@@ -185,8 +312,14 @@ void VbcReader::read_file(std::string filename) {
                     std::ostringstream* active = &general_info;
                     std::ostringstream* inactive = &main_info;
                     
-                    in >> node_seq >> std::ws;
-                    while((nchar = in.get()) != traits_type::eof() && nchar != '\n') {
+                    if(!(in >> node_seq)) {
+                        head = push_event(head, std::make_shared<IOErrorEvent>("error reading information modification parameters (opcode A or I)"));
+                        error = true;
+                        break;
+                    }
+
+                    in >> std::ws;
+                    while((nchar = in.get()) != traits_type::eof()) {
                         if(nchar == '\\') {
                             switch(nchar = in.get()) {
                             case 't':
@@ -209,12 +342,7 @@ void VbcReader::read_file(std::string filename) {
                         }
                     }
 
-
-                    if(!in) {
-                        head = push_event(head, std::make_shared<IOErrorEvent>("error reading information modification parameters (opcode A or I)"));
-                        error = true;
-                    }
-                    else if(strip_) {
+                    if(strip_) {
                         break;
                     }
                     else if(opcode == 'A') {
@@ -286,13 +414,72 @@ void VbcReader::read_file(std::string filename) {
         }
     }
 
+    if(timed && batch_lines) {
+        uint64_t now = tracer.now();
+        if(counted) {
+            Profiler::instance().record_counts(Stage::Parse, batch_counts, PerfCounters::read());
+        }
+        Profiler::instance().record(Stage::Parse, now - batch_start, batch_lines);
+        tracer.complete("parse batch", "reader", batch_start, now, batch_lines);
+    }
+    decoded_in_.store(input_pos_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    decoded_pos_.store(read_offset_, std::memory_order_relaxed);
+
     // Push end-of-stream event if no error has occurred
     if(!std::dynamic_pointer_cast<IOErrorEvent>(head)) {
         head = push_event(head, std::make_shared<EOSEvent>());
     }
 
     // Close file
-    in.reset();
+    input.reset();
+    running_ = false;
+
+    // Notify all waiting threads
+    cv_.notify_all();
+}
+
+
+void VbcReader::read_stream(EventStreamPtr stream) {
+    EventPtr head;
+    Tracer::instance().set_thread_name("event stream");
+    read_offset_ = 0;
+
+    // Move events from the solver's ring into the event queue until the stream is closed;
+    // events stay in the ring while the queue is full so that the solver is held back
+    while(true) {
+        // Sleep until the renderer has made room in the event queue
+        {
+            std::unique_lock<std::mutex> lock(m_);
+            room_cv_.wait(lock, [this] { return fwd_.size() < queue_limit_ || stopreq_; });
+        }
+        if(stopreq_) {
+            break;
+        }
+
+        // Sleep until the solver pushes an event or closes the stream
+        EventPtr event = stream->wait_pop();
+        if(!event) {
+            break;
+        }
+
+        Event* ptr = event.get();
+        const std::type_index event_type = typeid(*ptr);
+        if(strip_ && (event_type == std::type_index(typeid(SetInfoEvent)) || event_type == std::type_index(typeid(AppendInfoEvent)))) {
+            continue;
+        }
+        head = push_event(head, event);
+        if(event_type == std::type_index(typeid(IOErrorEvent))) {
+            break;
+        }
+    }
+
+    // Release a solver that may be waiting for free slots
+    stream->abandon();
+
+    // Push end-of-stream event if no error has occurred
+    if(!std::dynamic_pointer_cast<IOErrorEvent>(head)) {
+        head = push_event(head, std::make_shared<EOSEvent>());
+    }
     running_ = false;
 
     // Notify all waiting threads
@@ -301,22 +488,76 @@ void VbcReader::read_file(std::string filename) {
 
 
 bool VbcReader::open(const std::string& filename) {
-    using std::placeholders::_1;
+    return open(filename, std::make_shared<Tree>(style_), 0, 0.0);
+}
+
+
+bool VbcReader::open(const std::string& filename, TreePtr tree, uint64_t offset, double timestamp) {
+    // Do not reopen if already running
+    if(running_.exchange(true)) {
+        return false;
+    }
+
+    // Clear internal state
+    fwd_.clear();
+    rev_.clear();
+    tree_ = tree;
+    timestamp_ = timestamp;
+    offset_ = offset;
+    applied_ = 0;
+    parsed_ = 0;
+    decoded_pos_ = 0;
+    decoded_in_ = 0;
+    compressed_ = is_compressed(filename);
+
+    boost::system::error_code ec;
+    input_size_ = bfs::file_size(filename, ec);
+    if(ec) {
+        input_size_ = 0;
+    }
+
+    queue_limit_ = 0;
+    stream_.reset();
 
+    // Launch a new thread
+    stopreq_ = false;
+    reader_ = Scheduler::instance().spawn("vbc reader", std::bind(&VbcReader::read_file, this, filename, offset));
+
+    return true;
+}
+
+
+bool VbcReader::open(EventStreamPtr stream) {
     // Do not reopen if already running
     if(running_.exchange(true)) {
         return false;
     }
 
+    // Every stream is consumed by a single reader
+    if(!stream->attach()) {
+        running_ = false;
+        return false;
+    }
+
     // Clear internal state
     fwd_.clear();
     rev_.clear();
-    tree_ = std::make_shared<Tree>();
+    tree_ = std::make_shared<Tree>(style_);
     timestamp_ = 0.0;
+    offset_ = 0;
+    applied_ = 0;
+    parsed_ = 0;
+    input_pos_ = 0;
+    decoded_pos_ = 0;
+    decoded_in_ = 0;
+    compressed_ = false;
+    input_size_ = 0;
+    queue_limit_ = stream->capacity();
+    stream_ = stream;
 
     // Launch a new thread
     stopreq_ = false;
-    reader_ = std::thread(std::bind(&VbcReader::read_file, this, _1), filename);
+    reader_ = Scheduler::instance().spawn("event stream", std::bind(&VbcReader::read_stream, this, stream));
 
     return true;
 }
@@ -340,12 +581,28 @@ bool VbcReader::advance() {
         std::cerr << "IO ERROR: " << error->what() << std::endl;
     }
     else if(event_type != std::type_index(typeid(EOSEvent))) {
-        current->apply(tree_);
+        // Events are traced in batches by the caller, so only the profiler sees single events
+        Profiler& profiler = Profiler::instance();
+        if(profiler.is_enabled()) {
+            uint64_t apply_start = Tracer::instance().now();
+            current->apply(tree_);
+            profiler.record(Stage::Apply, Tracer::instance().now() - apply_start);
+        }
+        else {
+            current->apply(tree_);
+        }
+        ++applied_;
         if(current->get_time() > timestamp_) {
             timestamp_ = current->get_time();
         }
+        offset_ = current->get_offset();
         fwd_.pop_front();
 
+        // Let a read thread waiting for room in the event queue continue
+        if(fwd_.size() + 1 == queue_limit_) {
+            room_cv_.notify_one();
+        }
+
         if(rewind_) {
             rev_.push_front(current);
         }
@@ -382,10 +639,7 @@ void VbcReader::wait() {
 
 void VbcReader::close() {
     if(running_) {
-        stopreq_ = true;
-        if(reader_.joinable()) {
-            reader_.join();
-        }
+        stop();
     }
 }
 
@@ -438,3 +692,29 @@ double VbcReader::get_next_timestamp() const {
     return fwd_.empty() ? -1.0 : std::max(fwd_.front()->get_time(), timestamp_);
 }
 
+
+EventPtr VbcReader::get_next_event() const {
+    std::unique_lock<std::mutex> lock(const_cast<VbcReader*>(this)->m_);
+    return fwd_.empty() ? nullptr : fwd_.front();
+}
+
+
+uint64_t VbcReader::get_applied_position() const {
+    if(!compressed_) {
+        return std::min(offset_, input_size_);
+    }
+
+    // Scale by the compression ratio of the input decoded so far
+    const uint64_t decoded = decoded_pos_.load(std::memory_order_relaxed);
+    if(!decoded) {
+        return 0;
+    }
+    const double ratio = double(decoded_in_.load(std::memory_order_relaxed)) / double(decoded);
+    return std::min(uint64_t(double(offset_) * ratio), input_size_);
+}
+
+
+size_t VbcReader::get_queue_depth() const {
+    std::unique_lock<std::mutex> lock(const_cast<VbcReader*>(this)->m_);
+    return fwd_.size();
+}
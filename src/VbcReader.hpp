@@ -21,6 +21,7 @@
 
 #include <atomic>
 #include <condition_variable>
+#include <cstdint>
 #include <forward_list>
 #include <memory>
 #include <mutex>
@@ -28,6 +29,7 @@
 #include <thread>
 
 #include "Event.hpp"
+#include "EventStream.hpp"
 #include "Tree.hpp"
 
 class VbcReader;
@@ -66,23 +68,38 @@ public:
 private:
     const bool       rewind_;   ///< Indicates rewindable reader.
     const bool       strip_;    ///< Discard textual information on nodes.
+    const StyleSheetPtr style_; ///< Styles of trees created by the reader (null for standard styles).
     std::atomic_bool running_;  ///< Indicates running read thread.
-    bool             stopreq_;  ///< User has requested read thread to stop.
+    std::atomic_bool stopreq_;  ///< User has requested read thread to stop.
     std::thread      reader_;   ///< Current reader thread.
+    uint64_t         read_offset_; ///< Input offset after the line currently parsed by the read thread.
+    std::atomic<uint64_t> input_pos_;   ///< Number of bytes read from the (possibly compressed) input file.
+    std::atomic<uint64_t> decoded_pos_; ///< Decompressed input offset reached by the read thread (updated per parse batch).
+    std::atomic<uint64_t> decoded_in_;  ///< Number of bytes read from the input file at the last update of decoded_pos_.
+    bool             compressed_;   ///< Input file is compressed.
+    std::atomic<uint64_t> parsed_;      ///< Number of events parsed by the read thread.
+    uint64_t         input_size_;   ///< Size of the (possibly compressed) input file.
 
     std::mutex              m_;     ///< Mutex used for data wait operations.
     std::condition_variable cv_;    ///< Condition variable used to wait for data.
+    std::condition_variable room_cv_;   ///< Condition variable used to wait for room in the event queue.
+    size_t                  queue_limit_;   ///< Maximum event queue depth (0 for unbounded).
+    EventStreamPtr          stream_;    ///< Event stream consumed by the read thread (null for files).
 
     TreePtr tree_;                      ///< Internal tree structure.
     std::deque<EventPtr> fwd_;          ///< Forward event queue.
     std::forward_list<EventPtr> rev_;   ///< Rewind event stack.
     double timestamp_;                  ///< Timestamp of last non-virtual event applied
+    uint64_t offset_;                   ///< Input offset after last event applied
+    uint64_t applied_;                  ///< Number of events applied
 
     EventPtr push_event(EventPtr old_head, EventPtr new_head);
-    void read_file(std::string filename);
+    void read_file(std::string filename, uint64_t offset);
+    void read_stream(EventStreamPtr stream);
+    void stop();
 
 public:
-    VbcReader(bool rewindable, bool strip_info);
+    VbcReader(bool rewindable, bool strip_info, StyleSheetPtr style = nullptr);
     VbcReader(const VbcReader&) = delete;
     VbcReader(VbcReader&&) = delete;
     ~VbcReader();
@@ -91,6 +108,8 @@ public:
     TreePtr get_tree() const { return tree_; }
 
     bool open(const std::string& filename);
+    bool open(const std::string& filename, TreePtr tree, uint64_t offset, double timestamp);
+    bool open(EventStreamPtr stream);                           ///< Applies events pushed by an in-process solver.
     bool advance();
     bool rewind();
     void wait();
@@ -102,6 +121,14 @@ public:
     bool has_next() const;
     double get_timestamp() const;
     double get_next_timestamp() const;
+    EventPtr get_next_event() const;                            ///< Returns the next event to be applied (or null).
+    uint64_t get_offset() const { return offset_; }    ///< Returns the decompressed input offset after the last applied event.
+    uint64_t get_input_position() const { return input_pos_; } ///< Returns the number of bytes read from the input file.
+    uint64_t get_input_size() const { return input_size_; }    ///< Returns the size of the input file in bytes.
+    uint64_t get_applied_position() const;                      ///< Returns the input file position of the last applied event (estimated for compressed files).
+    uint64_t get_num_parsed() const { return parsed_; }        ///< Returns the number of events parsed so far.
+    uint64_t get_num_applied() const { return applied_; }      ///< Returns the number of events applied so far.
+    size_t get_queue_depth() const;                             ///< Returns the number of parsed events waiting to be applied.
 };
 
 #endif /* end of include guard: __VBC_VBC_READER_HPP */
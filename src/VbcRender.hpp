@@ -0,0 +1,54 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VBC_VBC_RENDER_HPP
+#define __VBC_VBC_RENDER_HPP
+
+/// Public interface of libvbcrender, the reader, tree, layout and render core.
+///
+/// The core depends on Cairo and Boost only. A tree is read with a VbcReader (from a VBC
+/// file or from an EventStream fed directly by an in-process solver), laid out
+/// and drawn with render_tree() or one of the exporters. All layout parameters and
+/// styles are taken from the tree's StyleSheet, which is passed to the reader (or the
+/// option structures of the exporters) instead of being read from global state; the
+/// VBCTOOL standard styles are used if none is given. Video output (VideoOutput and
+/// RenderJob) lives in the separate vbcrender_video library, which adds GStreamer.
+///
+/// Two pieces of state remain process-wide on purpose. Scheduler::instance() is shared
+/// because all pipelines of a process draw from one thread budget; configure it before
+/// the first render. The stage profiler and tracer are internal; they record nothing
+/// unless the command line tool enables them.
+
+#include "Analysis.hpp"
+#include "Animation.hpp"
+#include "Checkpoint.hpp"
+#include "ContactSheet.hpp"
+#include "Event.hpp"
+#include "EventStream.hpp"
+#include "FrameHash.hpp"
+#include "Render.hpp"
+#include "Scheduler.hpp"
+#include "Snapshot.hpp"
+#include "Styles.hpp"
+#include "TilePyramid.hpp"
+#include "Tree.hpp"
+#include "Types.hpp"
+#include "VbcReader.hpp"
+#include "VectorExport.hpp"
+
+#endif /* end of include guard: __VBC_VBC_RENDER_HPP */
@@ -0,0 +1,429 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <cairo.h>
+
+#include "Profiler.hpp"
+#include "Render.hpp"
+#include "VectorExport.hpp"
+
+namespace bfs = boost::filesystem;
+
+/// Number of edges or nodes written as one path or group.
+static const size_t batch_size = 4096;
+
+/// Size of the output buffer in bytes.
+static const size_t buffer_size = 1 << 20;
+
+
+/// Receives the drawing of a tree in page coordinates.
+class VectorSink {
+public:
+    virtual ~VectorSink() {}
+
+    virtual void begin_edges() = 0;                                     ///< Starts the edges.
+    virtual void edge(Scalar x0, Scalar y0, Scalar x1, Scalar y1) = 0;  ///< Adds an edge.
+    virtual void begin_nodes(size_t category) = 0;                      ///< Starts the nodes of a category.
+    virtual void node(Scalar x, Scalar y) = 0;                          ///< Adds a node of the current category.
+    virtual void end_batch() = 0;                                       ///< Ends the current edges or nodes.
+    virtual void finish() = 0;                                          ///< Completes the file.
+};
+
+
+static std::string hex_color(const Color& color) {
+    char str[8];
+    std::snprintf(str, sizeof(str), "#%02x%02x%02x",
+                  int(color.r * 255 + 0.5), int(color.g * 255 + 0.5), int(color.b * 255 + 0.5));
+    return str;
+}
+
+
+/// Writes SVG with CSS classes per style and one marker symbol per node category.
+class SvgSink : public VectorSink {
+private:
+    std::ostream& out_;
+    const StyleSheet& sheet_;
+    size_t count_;              ///< Elements in current batch.
+    size_t category_;           ///< Category of current nodes (or -1 for edges).
+
+    void open_batch() {
+        if(category_ == size_t(-1)) {
+            out_ << "<path class=\"e\" d=\"";
+        }
+        else {
+            out_ << "<g class=\"c" << category_ << "\">\n";
+        }
+        count_ = 0;
+    }
+
+    void close_batch() {
+        out_ << (category_ == size_t(-1) ? "\"/>\n" : "</g>\n");
+    }
+
+public:
+    SvgSink(std::ostream& out, const StyleSheet& sheet, Scalar width, Scalar height, Scalar line_width, Scalar radius)
+        : out_(out), sheet_(sheet), count_(0), category_(0)
+    {
+        out_ << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+             << "<svg xmlns=\"http://www.w3.org/2000/svg\" xmlns:xlink=\"http://www.w3.org/1999/xlink\" "
+             << "width=\"" << width << "\" height=\"" << height << "\" viewBox=\"0 0 " << width << ' ' << height << "\">\n";
+
+        // Styles
+        out_ << "<style>\n"
+             << ".e{fill:none;stroke:" << hex_color(sheet_.edge_styles[1].edge_color) << ";stroke-width:" << line_width << "}\n";
+        for(size_t cat = 0; cat < sheet_.node_styles.size(); ++cat) {
+            const NodeStyle& style = sheet_.node_styles[cat];
+            if(style.draw_filled) {
+                out_ << ".c" << cat << "{fill:" << hex_color(style.node_color) << "}\n";
+            }
+            else {
+                out_ << ".c" << cat << "{fill:none;stroke:" << hex_color(style.node_color) << ";stroke-width:" << line_width << "}\n";
+            }
+        }
+        out_ << "</style>\n";
+
+        // Node markers
+        out_ << "<defs>\n";
+        for(size_t cat = 0; cat < sheet_.node_styles.size(); ++cat) {
+            if(sheet_.node_styles[cat].draw_circle) {
+                out_ << "<circle id=\"m" << cat << "\" r=\"" << radius << "\"/>\n";
+            }
+            else {
+                out_ << "<rect id=\"m" << cat << "\" x=\"" << -radius << "\" y=\"" << -radius
+                     << "\" width=\"" << 2 * radius << "\" height=\"" << 2 * radius << "\"/>\n";
+            }
+        }
+        out_ << "</defs>\n";
+
+        out_ << "<rect width=\"100%\" height=\"100%\" fill=\"" << hex_color(sheet_.background) << "\"/>\n";
+    }
+
+    virtual void begin_edges() {
+        category_ = size_t(-1);
+        open_batch();
+    }
+
+    virtual void edge(Scalar x0, Scalar y0, Scalar x1, Scalar y1) {
+        if(count_ == batch_size) {
+            close_batch();
+            open_batch();
+        }
+        out_ << 'M' << x0 << ',' << y0 << 'L' << x1 << ',' << y1;
+        ++count_;
+    }
+
+    virtual void begin_nodes(size_t category) {
+        category_ = category;
+        open_batch();
+    }
+
+    virtual void node(Scalar x, Scalar y) {
+        if(count_ == batch_size) {
+            close_batch();
+            open_batch();
+        }
+        out_ << "<use xlink:href=\"#m" << category_ << "\" x=\"" << x << "\" y=\"" << y << "\"/>\n";
+        ++count_;
+    }
+
+    virtual void end_batch() {
+        close_batch();
+    }
+
+    virtual void finish() {
+        out_ << "</svg>\n";
+    }
+};
+
+
+/// Writes a single-page PDF whose content stream is written while the tree is traversed.
+///
+/// Circular markers are form XObjects drawn once per category; square markers are batched
+/// rectangles filled or stroked at once. The length of the content stream and all other
+/// objects follow the stream.
+class PdfSink : public VectorSink {
+private:
+    enum Object {
+        Catalog = 1,
+        Pages,
+        Page,
+        Contents,
+        Length,
+        FirstMarker
+    };
+
+    std::ostream& out_;
+    const StyleSheet& sheet_;
+    Scalar width_;
+    Scalar height_;
+    Scalar line_width_;
+    Scalar radius_;
+    std::vector<std::streamoff> offsets_;   ///< File offsets of objects.
+    std::streamoff stream_start_;           ///< File offset of the content stream.
+    size_t count_;                          ///< Elements in current batch.
+    size_t category_;                       ///< Category of current nodes (or -1 for edges).
+
+    void begin_object(size_t number) {
+        if(offsets_.size() <= number) {
+            offsets_.resize(number + 1, 0);
+        }
+        offsets_[number] = out_.tellp();
+        out_ << number << " 0 obj\n";
+    }
+
+    static void put_color(std::ostream& out, const Color& color, const char* op) {
+        out << color.r << ' ' << color.g << ' ' << color.b << ' ' << op << '\n';
+    }
+
+    size_t marker_object(size_t category) const {
+        size_t number = FirstMarker;
+        for(size_t cat = 0; cat < category; ++cat) {
+            number += sheet_.node_styles[cat].draw_circle ? 1 : 0;
+        }
+        return number;
+    }
+
+    bool draws_forms() const {
+        return category_ != size_t(-1) && sheet_.node_styles[category_].draw_circle;
+    }
+
+    void paint_batch() {
+        if(category_ == size_t(-1) || !sheet_.node_styles[category_].draw_filled) {
+            out_ << "S\n";
+        }
+        else if(!draws_forms()) {
+            out_ << "f\n";
+        }
+        count_ = 0;
+    }
+
+public:
+    PdfSink(std::ostream& out, const StyleSheet& sheet, Scalar width, Scalar height, Scalar line_width, Scalar radius)
+        : out_(out), sheet_(sheet), width_(width), height_(height), line_width_(line_width), radius_(radius),
+          stream_start_(0), count_(0), category_(0)
+    {
+        out_ << "%PDF-1.4\n%\xe2\xe3\xcf\xd3\n";
+
+        // Content stream starts with a top-down coordinate system and the background
+        begin_object(Contents);
+        out_ << "<< /Length " << int(Length) << " 0 R >>\nstream\n";
+        stream_start_ = out_.tellp();
+        out_ << "1 0 0 -1 0 " << height_ << " cm\n";
+        put_color(out_, sheet_.background, "rg");
+        out_ << "0 0 " << width_ << ' ' << height_ << " re f\n"
+             << line_width_ << " w\n";
+    }
+
+    virtual void begin_edges() {
+        category_ = size_t(-1);
+        count_ = 0;
+        put_color(out_, sheet_.edge_styles[1].edge_color, "RG");
+    }
+
+    virtual void edge(Scalar x0, Scalar y0, Scalar x1, Scalar y1) {
+        if(count_ == batch_size) {
+            paint_batch();
+        }
+        out_ << x0 << ' ' << y0 << " m " << x1 << ' ' << y1 << " l\n";
+        ++count_;
+    }
+
+    virtual void begin_nodes(size_t category) {
+        category_ = category;
+        count_ = 0;
+        if(!draws_forms()) {
+            put_color(out_, sheet_.node_styles[category].node_color, sheet_.node_styles[category].draw_filled ? "rg" : "RG");
+        }
+    }
+
+    virtual void node(Scalar x, Scalar y) {
+        if(draws_forms()) {
+            out_ << "q 1 0 0 1 " << x << ' ' << y << " cm /M" << category_ << " Do Q\n";
+            return;
+        }
+        if(count_ == batch_size) {
+            paint_batch();
+        }
+        out_ << x - radius_ << ' ' << y - radius_ << ' ' << 2 * radius_ << ' ' << 2 * radius_ << " re\n";
+        ++count_;
+    }
+
+    virtual void end_batch() {
+        if(count_) {
+            paint_batch();
+        }
+    }
+
+    virtual void finish() {
+        // Close content stream and write its length
+        std::streamoff length = out_.tellp() - stream_start_;
+        out_ << "endstream\nendobj\n";
+        begin_object(Length);
+        out_ << length << "\nendobj\n";
+
+        // Circular markers centered at the origin
+        static const Scalar kappa = 0.5523;
+        const Scalar r = radius_;
+        const Scalar k = kappa * radius_;
+        const Scalar b = radius_ + line_width_;
+        for(size_t cat = 0; cat < sheet_.node_styles.size(); ++cat) {
+            const NodeStyle& style = sheet_.node_styles[cat];
+            if(!style.draw_circle) {
+                continue;
+            }
+
+            std::ostringstream form;
+            form.flags(out_.flags());
+            form.precision(out_.precision());
+            put_color(form, style.node_color, style.draw_filled ? "rg" : "RG");
+            form << line_width_ << " w\n"
+                 << r << " 0 m\n"
+                 << r << ' ' << k << ' ' << k << ' ' << r << " 0 " << r << " c\n"
+                 << -k << ' ' << r << ' ' << -r << ' ' << k << ' ' << -r << " 0 c\n"
+                 << -r << ' ' << -k << ' ' << -k << ' ' << -r << " 0 " << -r << " c\n"
+                 << k << ' ' << -r << ' ' << r << ' ' << -k << ' ' << r << " 0 c\n"
+                 << (style.draw_filled ? "f\n" : "h S\n");
+            std::string data = form.str();
+
+            begin_object(marker_object(cat));
+            out_ << "<< /Type /XObject /Subtype /Form /BBox [" << -b << ' ' << -b << ' ' << b << ' ' << b << "]"
+                 << " /Length " << data.size() << " >>\nstream\n" << data << "endstream\nendobj\n";
+        }
+
+        // Page tree referencing the marker forms
+        begin_object(Page);
+        out_ << "<< /Type /Page /Parent " << int(Pages) << " 0 R /MediaBox [0 0 " << width_ << ' ' << height_ << "]"
+             << " /Contents " << int(Contents) << " 0 R /Resources << /XObject <<";
+        for(size_t cat = 0; cat < sheet_.node_styles.size(); ++cat) {
+            if(sheet_.node_styles[cat].draw_circle) {
+                out_ << " /M" << cat << ' ' << marker_object(cat) << " 0 R";
+            }
+        }
+        out_ << " >> >> >>\nendobj\n";
+        begin_object(Pages);
+        out_ << "<< /Type /Pages /Kids [" << int(Page) << " 0 R] /Count 1 >>\nendobj\n";
+        begin_object(Catalog);
+        out_ << "<< /Type /Catalog /Pages " << int(Pages) << " 0 R >>\nendobj\n";
+
+        // Cross-reference table
+        std::streamoff xref = out_.tellp();
+        out_ << "xref\n0 " << offsets_.size() << "\n0000000000 65535 f \n";
+        for(size_t i = 1; i < offsets_.size(); ++i) {
+            char entry[24];
+            std::snprintf(entry, sizeof(entry), "%010lld 00000 n \n", (long long)offsets_[i]);
+            out_ << entry;
+        }
+        out_ << "trailer\n<< /Size " << offsets_.size() << " /Root " << int(Catalog) << " 0 R >>\n"
+             << "startxref\n" << xref << "\n%%EOF\n";
+    }
+};
+
+
+bool is_vector_format(const std::string& path) {
+    std::string ext = bfs::extension(path);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == ".svg" || ext == ".pdf";
+}
+
+
+void write_vector(const std::string& path, TreePtr tree, size_t width, size_t height) {
+    std::string ext = bfs::extension(path);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+
+    {
+        StageTimer timer(Stage::Layout);
+        tree->update_layout();
+    }
+    StageTimer timer(Stage::Draw);
+
+    // Page coordinates and sizes as rendered into the same window as a snapshot
+    Rect window { 10, 10, Scalar(width - 10), Scalar(height - 10) };
+    cairo_matrix_t matrix = fit_matrix(*tree, window);
+    const Scalar scale = matrix.xx;
+    const Scalar line_width = 2 * scale;
+    const StyleSheet& sheet = tree->style();
+    const Scalar radius = sheet.node_radius * scale;
+
+    std::vector<char> buffer(buffer_size);
+    std::ofstream out;
+    out.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+    out.open(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if(!out) {
+        throw std::runtime_error("could not open " + path);
+    }
+    // Keep about three significant digits of the smallest sizes (PDF does not allow exponents)
+    int digits = int(std::ceil(-std::log10(std::max(std::min(radius, line_width), Scalar(1e-6))))) + 2;
+    out << std::fixed << std::setprecision(std::min(8, std::max(2, digits)));
+
+    std::unique_ptr<VectorSink> sink;
+    if(ext == ".svg") {
+        sink.reset(new SvgSink(out, sheet, Scalar(width), Scalar(height), line_width, radius));
+    }
+    else if(ext == ".pdf") {
+        sink.reset(new PdfSink(out, sheet, Scalar(width), Scalar(height), line_width, radius));
+    }
+    else {
+        throw std::invalid_argument("unsupported vector format " + ext);
+    }
+
+    // Edges in one traversal, then the nodes of each category in one traversal each
+    const Tree::PreOrderIterator end(tree->children().end(), tree->children().end());
+    if(tree->has_visible_nodes()) {
+        sink->begin_edges();
+        for(Tree::PreOrderIterator it(*tree); it != end; ++it) {
+            const Node* node = it->get();
+            NodePtr parent = node->parent();
+            if(parent && node->visible()) {
+                sink->edge(matrix.xx * node->x() + matrix.x0, matrix.yy * node->y() + matrix.y0,
+                           matrix.xx * parent->x() + matrix.x0, matrix.yy * parent->y() + matrix.y0);
+            }
+        }
+        sink->end_batch();
+
+        for(size_t cat = 0; cat < sheet.node_styles.size(); ++cat) {
+            if(!tree->category_count(cat) || !tree->category_visible(cat)) {
+                continue;
+            }
+            sink->begin_nodes(cat);
+            for(Tree::PreOrderIterator it(*tree); it != end; ++it) {
+                const Node* node = it->get();
+                if(node->category() == cat && node->visible()) {
+                    sink->node(matrix.xx * node->x() + matrix.x0, matrix.yy * node->y() + matrix.y0);
+                }
+            }
+            sink->end_batch();
+        }
+    }
+    sink->finish();
+
+    out.close();
+    if(!out) {
+        throw std::runtime_error("could not write " + path);
+    }
+}
@@ -0,0 +1,37 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VBC_VECTOR_EXPORT_HPP
+#define __VBC_VECTOR_EXPORT_HPP
+
+#include <string>
+
+#include "Tree.hpp"
+
+/// Indicates that the file extension denotes a supported vector format (SVG or PDF).
+bool is_vector_format(const std::string& path);
+
+/// Streams a drawing of the tree to an SVG or PDF file, depending on the file extension.
+///
+/// Edges and nodes are written in batches while the tree is traversed, so memory use does
+/// not grow with the size of the drawing. Edge and node styles are defined once at the
+/// beginning of the file (SVG classes and marker symbols, PDF marker forms) and
+/// referenced by the individual elements.
+void write_vector(const std::string& path, TreePtr tree, size_t width, size_t height);
+
+#endif /* end of include guard: __VBC_VECTOR_EXPORT_HPP */
@@ -16,12 +16,21 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include "FrameHash.hpp"
+#include "Profiler.hpp"
+#include "Render.hpp"
+#include "Scheduler.hpp"
 #include "Styles.hpp"
+#include "Trace.hpp"
 #include "VideoOutput.hpp"
 #include "Types.hpp"
 
+#include <algorithm>
 #include <cmath>
+#include <cstdio>
 #include <cstring>
+#include <fstream>
+#include <functional>
 #include <iomanip>
 #include <iostream>
 #include <thread>
@@ -42,11 +51,13 @@ struct VideoOutput::Data {
           txtsrc(NULL),
           stream_time(0),
           num_frames(0),
+          frame_hash(0),
           r_thread()
     {}
     Data(const Data&) = delete;
     Data(Data&&) = delete;
     ~Data() {
+        clear_panes();
         if(r_thread.joinable()) {
             GstFlowReturn ret;
             g_signal_emit_by_name(vidsrc, "end-of-stream", &ret);
@@ -68,9 +79,23 @@ struct VideoOutput::Data {
         }
     }
 
+    void clear_panes() {
+        for(cairo_t* ctx : pane_drawctx) {
+            cairo_destroy(ctx);
+        }
+        for(cairo_surface_t* pane : pane_surface) {
+            cairo_surface_destroy(pane);
+        }
+        pane_drawctx.clear();
+        pane_surface.clear();
+    }
+
     cairo_t*            drawctx;    ///< Cairo drawing context.
     cairo_surface_t*    surface;    ///< Cairo drawing surface.
 
+    std::vector<cairo_t*>           pane_drawctx;   ///< Drawing contexts for side-by-side panes.
+    std::vector<cairo_surface_t*>   pane_surface;   ///< Surfaces sharing the pixels of the main surface.
+
     GstBufferPool*  pool;           ///< Buffer pool for video frames.
     GstElement*     pipeline;       ///< GStreamer encoding pipeline.
     GstElement*     vidsrc;         ///< Source element for rendered frames.
@@ -79,6 +104,7 @@ struct VideoOutput::Data {
     guint64         frame_duration; ///< Duration of single frame in nanoseconds.
     guint64         stream_time;    ///< Current stream timestamp.
     guint64         num_frames;     ///< Number of frames rendered so far.
+    uint64_t        frame_hash;     ///< Hash of the last rendered frame (if enabled).
 
     std::thread     r_thread;       ///< Separate render thread.
     GMainLoop*      loop;           ///< Main loop.
@@ -105,6 +131,35 @@ static void on_stream_error(GstBus* bus, GstMessage* message, VideoOutput::Data*
 }
 
 
+/// Selects the fastest preset of common encoders.
+static void set_fastest_preset(GstElement* encoder) {
+    static const char* const presets[][2] = {
+        { "speed-preset", "ultrafast" },    // x264enc, x265enc
+        { "deadline", "1" },                // vp8enc, vp9enc
+        { "complexity", "low" }             // openh264enc
+    };
+    for(const auto& preset : presets) {
+        if(g_object_class_find_property(G_OBJECT_GET_CLASS(encoder), preset[0])) {
+            gst_util_set_object_arg(G_OBJECT(encoder), preset[0], preset[1]);
+        }
+    }
+}
+
+
+/// Marks the start of encoding a frame in the trace.
+static GstPadProbeReturn on_encoder_input(GstPad* pad, GstPadProbeInfo* info, gpointer user_data) {
+    Tracer::instance().async_begin("encode", "encoder", GST_BUFFER_PTS(GST_PAD_PROBE_INFO_BUFFER(info)));
+    return GST_PAD_PROBE_OK;
+}
+
+
+/// Marks the end of encoding a frame in the trace.
+static GstPadProbeReturn on_encoder_output(GstPad* pad, GstPadProbeInfo* info, gpointer user_data) {
+    Tracer::instance().async_end("encode", "encoder", GST_BUFFER_PTS(GST_PAD_PROBE_INFO_BUFFER(info)));
+    return GST_PAD_PROBE_OK;
+}
+
+
 static GstCaps* get_caps_for_file(const std::string& filename) {
     // Extract file extension
     size_t last_period = filename.rfind('.');
@@ -304,7 +359,12 @@ VideoOutput::VideoOutput()
       clock(false),
       bounds(false),
       text_halign(0),
-      text_valign(2)
+      text_valign(2),
+      enc_threads(0),
+      first_frame(0),
+      draft(false),
+      null_sink(false),
+      hash_frames(false)
 {}
 
 
@@ -318,6 +378,11 @@ double VideoOutput::get_stream_time() const {
 }
 
 
+uint64_t VideoOutput::get_frame_hash() const {
+    return d_ ? d_->frame_hash : 0;
+}
+
+
 size_t VideoOutput::get_num_frames() const {
     return size_t(d_->num_frames);
 }
@@ -399,6 +464,51 @@ void VideoOutput::set_text_align(size_t halign, size_t valign) {
 }
 
 
+void VideoOutput::set_encoder_threads(size_t threads) {
+    if(d_) {
+        throw std::logic_error("attempt to set encoder threads after rendering started");
+    }
+
+    enc_threads = threads;
+}
+
+
+void VideoOutput::set_first_frame(size_t frame) {
+    if(d_) {
+        throw std::logic_error("attempt to set first frame after rendering started");
+    }
+
+    first_frame = frame;
+}
+
+
+void VideoOutput::set_draft(bool on) {
+    if(d_) {
+        throw std::logic_error("attempt to set draft mode after rendering started");
+    }
+
+    draft = on;
+}
+
+
+void VideoOutput::set_null_sink(bool on) {
+    if(d_) {
+        throw std::logic_error("attempt to set null sink after rendering started");
+    }
+
+    null_sink = on;
+}
+
+
+void VideoOutput::set_hash_frames(bool on) {
+    if(d_) {
+        throw std::logic_error("attempt to set frame hashing after rendering started");
+    }
+
+    hash_frames = on;
+}
+
+
 void VideoOutput::start() {
     // Set up rendering pipeline if not yet created
     if(!d_) {
@@ -407,14 +517,11 @@ void VideoOutput::start() {
         // Create rendering surface and drawing context for Cairo
         d_->surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, (int)width, (int)height);
         d_->drawctx = cairo_create(d_->surface);
-
-        // Try to deduce output caps based on file extension
-        GstCaps* output_caps = get_caps_for_file(file);
-        if(!output_caps) {
-            throw std::runtime_error("failed to guess video file format");
+        if(draft) {
+            cairo_set_antialias(d_->drawctx, CAIRO_ANTIALIAS_NONE);
         }
 
-        // Define remaining caps
+        // Define caps of rendered frames
         GstCaps* input_video_caps = gst_caps_new_simple("video/x-raw",
                 "format", G_TYPE_STRING, is_big_endian() ? "xRGB" : "BGRx",
                 "width", G_TYPE_INT, (int)width,
@@ -422,64 +529,114 @@ void VideoOutput::start() {
                 "framerate", GST_TYPE_FRACTION, (int)fps_n, (int)fps_d,
                 NULL
                 );
-        GstCaps* input_text_caps = gst_caps_new_simple("text/x-raw",
-                "format", G_TYPE_STRING, "utf8",
-                NULL
-                );
 
-        // Dynamically generate an encoder bin
-        GstElement* encodebin = create_bin_for_caps(output_caps);
-        gst_caps_unref(output_caps);
-        if(!encodebin) {
-            throw std::runtime_error("failed to construct encoder for video file");
+        if(null_sink) {
+            // Measure the copy and push path only; frames are dropped right behind the source
+            GstElement* fakesink = gst_element_factory_make("fakesink", "null-output");
+            d_->vidsrc = gst_element_factory_make("appsrc", "video-source");
+            d_->pipeline = gst_pipeline_new("render-pipeline");
+            gst_bin_add_many(GST_BIN(d_->pipeline), d_->vidsrc, fakesink, NULL);
+            g_object_set(G_OBJECT(d_->vidsrc),
+                    "block" , TRUE              ,
+                    "caps"  , input_video_caps  ,
+                    "format", GST_FORMAT_TIME   ,
+                    NULL
+                    );
+            g_object_set(G_OBJECT(fakesink), "sync", FALSE, NULL);
+            gst_element_link(d_->vidsrc, fakesink);
         }
+        else {
+            // Try to deduce output caps based on file extension
+            GstCaps* output_caps = get_caps_for_file(file);
+            if(!output_caps) {
+                throw std::runtime_error("failed to guess video file format");
+            }
 
-        // Create remaining elements
-        GstElement *filesink, *converter, *overlay;
-        filesink = gst_element_factory_make("filesink", "file-output");
-        converter = gst_element_factory_make("videoconvert", "video-convert");
-        d_->vidsrc = gst_element_factory_make("appsrc", "video-source");
-        d_->pipeline = gst_pipeline_new("render-pipeline");
+            GstCaps* input_text_caps = gst_caps_new_simple("text/x-raw",
+                    "format", G_TYPE_STRING, "utf8",
+                    NULL
+                    );
 
-        gst_bin_add_many(GST_BIN(d_->pipeline), d_->vidsrc, converter, encodebin, filesink, NULL);
+            // Dynamically generate an encoder bin
+            GstElement* encodebin = create_bin_for_caps(output_caps);
+            gst_caps_unref(output_caps);
+            if(!encodebin) {
+                throw std::runtime_error("failed to construct encoder for video file");
+            }
 
-        // Configure first elements and link where possible
-        g_object_set(G_OBJECT(d_->vidsrc),
-                "block" , TRUE              ,
-                "caps"  , input_video_caps  ,
-                "format", GST_FORMAT_TIME   ,
-                NULL
-                );
-        g_object_set(G_OBJECT(filesink),
-                "location", file.c_str(),
-                NULL
-                );
-        gst_element_link_many(converter, encodebin, filesink, NULL);
+            // Create remaining elements
+            GstElement *filesink, *converter, *overlay;
+            filesink = gst_element_factory_make("filesink", "file-output");
+            converter = gst_element_factory_make("videoconvert", "video-convert");
+            d_->vidsrc = gst_element_factory_make("appsrc", "video-source");
+            d_->pipeline = gst_pipeline_new("render-pipeline");
 
-        if(clock || bounds) {
-            d_->txtsrc = gst_element_factory_make("appsrc", "overlay-text-source");
-            overlay = gst_element_factory_make("textoverlay", "text-overlay");
-            gst_bin_add_many(GST_BIN(d_->pipeline), d_->txtsrc, overlay, NULL);
+            gst_bin_add_many(GST_BIN(d_->pipeline), d_->vidsrc, converter, encodebin, filesink, NULL);
 
-            // Configure additional elements
-            g_object_set(G_OBJECT(d_->txtsrc),
+            // Configure first elements and link where possible
+            g_object_set(G_OBJECT(d_->vidsrc),
                     "block" , TRUE              ,
-                    "caps"  , input_text_caps   ,
+                    "caps"  , input_video_caps  ,
                     "format", GST_FORMAT_TIME   ,
                     NULL
                     );
-            g_object_set(G_OBJECT(overlay)  ,
-                    "halignment", (int)text_halign,
-                    "valignment", (int)text_valign,
-                    "line-alignment", (int)text_halign,
+            g_object_set(G_OBJECT(filesink),
+                    "location", file.c_str(),
                     NULL
                     );
-            gst_caps_unref(input_text_caps);
-            gst_element_link_many(d_->vidsrc, overlay, converter, NULL);
-            gst_element_link(d_->txtsrc, overlay);
-        }
-        else {
-            gst_element_link(d_->vidsrc, converter);
+            gst_element_link_many(converter, encodebin, filesink, NULL);
+
+            // Configure encoder speed and threads if supported, and trace frames passing the encoder
+            GstElement* encoder = gst_bin_get_by_name(GST_BIN(encodebin), "video-encoder");
+            if(encoder) {
+                if(enc_threads && g_object_class_find_property(G_OBJECT_GET_CLASS(encoder), "threads")) {
+                    g_object_set(G_OBJECT(encoder), "threads", (int)enc_threads, NULL);
+                }
+                if(draft) {
+                    set_fastest_preset(encoder);
+                }
+                if(Tracer::instance().is_enabled()) {
+                    GstPad* sinkpad = gst_element_get_static_pad(encoder, "sink");
+                    GstPad* srcpad = gst_element_get_static_pad(encoder, "src");
+                    if(sinkpad && srcpad) {
+                        gst_pad_add_probe(sinkpad, GST_PAD_PROBE_TYPE_BUFFER, on_encoder_input, NULL, NULL);
+                        gst_pad_add_probe(srcpad, GST_PAD_PROBE_TYPE_BUFFER, on_encoder_output, NULL, NULL);
+                    }
+                    if(sinkpad) {
+                        gst_object_unref(sinkpad);
+                    }
+                    if(srcpad) {
+                        gst_object_unref(srcpad);
+                    }
+                }
+                gst_object_unref(encoder);
+            }
+
+            if(clock || bounds) {
+                d_->txtsrc = gst_element_factory_make("appsrc", "overlay-text-source");
+                overlay = gst_element_factory_make("textoverlay", "text-overlay");
+                gst_bin_add_many(GST_BIN(d_->pipeline), d_->txtsrc, overlay, NULL);
+
+                // Configure additional elements
+                g_object_set(G_OBJECT(d_->txtsrc),
+                        "block" , TRUE              ,
+                        "caps"  , input_text_caps   ,
+                        "format", GST_FORMAT_TIME   ,
+                        NULL
+                        );
+                g_object_set(G_OBJECT(overlay)  ,
+                        "halignment", (int)text_halign,
+                        "valignment", (int)text_valign,
+                        "line-alignment", (int)text_halign,
+                        NULL
+                        );
+                gst_caps_unref(input_text_caps);
+                gst_element_link_many(d_->vidsrc, overlay, converter, NULL);
+                gst_element_link(d_->txtsrc, overlay);
+            }
+            else {
+                gst_element_link(d_->vidsrc, converter);
+            }
         }
 
         // Create buffer pool
@@ -499,9 +656,18 @@ void VideoOutput::start() {
         d_->r_thread.join();
     }
 
-    // Spin off new render thread.
+    // Reset timestamps and frame counts; segments of a longer video start at a later timestamp
+    d_->stream_time = first_frame * d_->frame_duration;
+    d_->num_frames = 0;
+
+    // Spin off new render thread; it mostly waits for bus messages and does not count against the thread budget,
+    // but the encoder threads do while the pipeline is playing.
     Data* data = d_.get();
-    d_->r_thread = std::thread([data]() {
+    const size_t encoder_threads = enc_threads;
+    d_->r_thread = Scheduler::instance().spawn("gst main loop", [data, encoder_threads]() {
+            Tracer::instance().set_thread_name("gst main loop");
+            BusyScope encoder(encoder_threads);
+
             // Create new main context and main loop.
             GMainContext* mainctx = g_main_context_new();
             g_main_context_push_thread_default(mainctx);
@@ -515,10 +681,6 @@ void VideoOutput::start() {
             guint error_handler = g_signal_connect(bus, "message::error", (GCallback)on_stream_error, data);
             guint eos_handler = g_signal_connect(bus, "message::eos", (GCallback)on_end_of_stream, data);
 
-            // Reset timestamps and frame counts
-            data->stream_time = 0;
-            data->num_frames = 0;
-
             // Transition the pipeline to playing state
             gst_element_set_state(data->pipeline, GST_STATE_READY);
             gst_element_set_state(data->pipeline, GST_STATE_PLAYING);
@@ -542,49 +704,77 @@ void VideoOutput::start() {
             g_main_context_pop_thread_default(mainctx);
             g_main_context_unref(mainctx);
             data->loop = NULL;
-    });
+    }, false);
 }
 
 
 void VideoOutput::push_frame(TreePtr tree) {
-    // Constant for square root of 2
-#ifndef M_SQRT1_2
-    static const Scalar sqrt2_half = Scalar(M_SQRT1_2);
-#elif defined(M_SQRT2)
-    static const Scalar sqrt2_half = Scalar(1 / M_SQRT2);
-#else
-    static const Scalar sqrt2_half = std::sqrt(0.5);
-#endif
+    push_frame(std::vector<TreePtr> { tree });
+}
+
 
-    // Update layout and get tree and canvas bounding boxes
-    tree->update_layout();
-    Rect bbox = tree->bounding_box();
-    Rect window { 10, 10, Scalar(width - 10), Scalar(height - 10) };
-
-    // Adjust transformation to center tree
-    Scalar scale = std::min(
-            (window.x1 - window.x0) / (bbox.x1 - bbox.x0),
-            (window.y1 - window.y0) / (bbox.y1 - bbox.y0)
-            );
-    Scalar scaled_bbox_mid_x = 0.5 * scale * (bbox.x0 + bbox.x1);
-    Scalar scaled_bbox_mid_y = 0.5 * scale * (bbox.y0 + bbox.y1);
-    Scalar window_mid_x = 0.5 * (window.x0 + window.x1);
-    Scalar window_mid_y = 0.5 * (window.y0 + window.y1);
-
-    cairo_matrix_t matrix;
-    cairo_matrix_init(&matrix, scale, 0, 0, scale, window_mid_x - scaled_bbox_mid_x, window_mid_y - scaled_bbox_mid_y);
-    cairo_set_matrix(d_->drawctx, &matrix);
-
-    // Fill surface with background color
-    cairo_set_source_rgb(d_->drawctx, background_color.r, background_color.g, background_color.b);
-    cairo_set_operator(d_->drawctx, CAIRO_OPERATOR_OVER);
-    cairo_paint(d_->drawctx);
-
-    // Draw the tree with raster protection
-    tree->draw(d_->drawctx, true);
+void VideoOutput::push_frame(const std::vector<TreePtr>& trees) {
+    if(trees.empty()) {
+        throw std::invalid_argument("no trees to render");
+    }
+
+    if(trees.size() == 1) {
+        // Draw the tree with raster protection
+        Rect window { 10, 10, Scalar(width - 10), Scalar(height - 10) };
+        render_tree(d_->drawctx, trees.front(), window, true, draft ? DetailLevel::Points : DetailLevel::Full);
+    }
+    else {
+        // (Re-)create pane surfaces that map onto disjoint columns of the main surface
+        if(d_->pane_surface.size() != trees.size()) {
+            d_->clear_panes();
+
+            unsigned char* pixels = cairo_image_surface_get_data(d_->surface);
+            int stride = cairo_image_surface_get_stride(d_->surface);
+            size_t pane_width = width / trees.size();
+            for(size_t i = 0; i < trees.size(); ++i) {
+                size_t x0 = i * pane_width;
+                size_t x1 = (i + 1 == trees.size()) ? width : x0 + pane_width;
+                cairo_surface_t* pane = cairo_image_surface_create_for_data(
+                        pixels + x0 * sizeof(uint32_t),
+                        CAIRO_FORMAT_RGB24,
+                        (int)(x1 - x0),
+                        (int)height,
+                        stride
+                        );
+                d_->pane_surface.push_back(pane);
+                d_->pane_drawctx.push_back(cairo_create(pane));
+                if(draft) {
+                    cairo_set_antialias(d_->pane_drawctx.back(), CAIRO_ANTIALIAS_NONE);
+                }
+            }
+        }
+
+        // Lay out and draw all panes concurrently; each pane has its own surface and context
+        auto render_pane = [this, &trees](size_t i) {
+            cairo_surface_t* pane = d_->pane_surface[i];
+            Rect window {
+                10, 10,
+                Scalar(cairo_image_surface_get_width(pane) - 10),
+                Scalar(cairo_image_surface_get_height(pane) - 10)
+            };
+            render_tree(d_->pane_drawctx[i], trees[i], window, true, draft ? DetailLevel::Points : DetailLevel::Full);
+            cairo_surface_flush(pane);
+        };
+
+        TaskGroup panes;
+        for(size_t i = 1; i < trees.size(); ++i) {
+            panes.run(std::bind(render_pane, i));
+        }
+        render_pane(0);
+        panes.wait();
+        cairo_surface_mark_dirty(d_->surface);
+    }
 
     // Flush changes to rendering surface
     cairo_surface_flush(d_->surface);
+    if(hash_frames) {
+        d_->frame_hash = hash_surface(d_->surface);
+    }
 
     // Acquire a buffer from GStreamer
     GstBuffer* buffer;
@@ -593,26 +783,29 @@ void VideoOutput::push_frame(TreePtr tree) {
     }
 
     // Copy pixels to the buffer
-    GstMapInfo map_info;
-    if(!gst_buffer_map(buffer, &map_info, GST_MAP_WRITE)) {
-        gst_buffer_unref(buffer);
-        throw std::runtime_error("failed to map buffer for writing");
-    }
+    {
+        StageTimer timer(Stage::Copy);
+        GstMapInfo map_info;
+        if(!gst_buffer_map(buffer, &map_info, GST_MAP_WRITE)) {
+            gst_buffer_unref(buffer);
+            throw std::runtime_error("failed to map buffer for writing");
+        }
 
-    unsigned char* img_src = cairo_image_surface_get_data(d_->surface);
-    unsigned char* img_dst = map_info.data;
-    size_t row_size = width * sizeof(uint32_t);
-    size_t row_stride = cairo_image_surface_get_stride(d_->surface);
-    if(row_size == row_stride) {
-        std::memcpy(img_dst, img_src, height * row_size);
-    }
-    else {
-        for(size_t row = 0; row < height; ++row) {
-            std::memcpy(img_dst + row * row_size, img_src + row * row_stride, row_size);
+        unsigned char* img_src = cairo_image_surface_get_data(d_->surface);
+        unsigned char* img_dst = map_info.data;
+        size_t row_size = width * sizeof(uint32_t);
+        size_t row_stride = cairo_image_surface_get_stride(d_->surface);
+        if(row_size == row_stride) {
+            std::memcpy(img_dst, img_src, height * row_size);
+        }
+        else {
+            for(size_t row = 0; row < height; ++row) {
+                std::memcpy(img_dst + row * row_size, img_src + row * row_stride, row_size);
+            }
         }
-    }
 
-    gst_buffer_unmap(buffer, &map_info);
+        gst_buffer_unmap(buffer, &map_info);
+    }
 
     // Attach timestamp information to the buffer
     GST_BUFFER_DURATION(buffer) = d_->frame_duration;
@@ -643,22 +836,31 @@ void VideoOutput::push_frame(TreePtr tree) {
         }
 
         if(bounds) {
-            double ub = tree->upper_bound();
-            double lb = tree->lower_bound();
+            for(size_t i = 0; i < trees.size(); ++i) {
+                double ub = trees[i]->upper_bound();
+                double lb = trees[i]->lower_bound();
+                std::string label;
+
+                // Distinguish bounds of side-by-side trees
+                if(trees.size() > 1) {
+                    label = "[" + std::to_string(i + 1) + "] ";
+                }
 
-            if(std::isfinite(ub)) {
-                if(!empty) {
-                    str << '\n';
+                if(std::isfinite(ub)) {
+                    if(!empty) {
+                        str << '\n';
+                    }
+                    str << label << "UB = " << ub;
+                    empty = false;
                 }
-                str << "UB = " << ub;
-                empty = false;
-            }
 
-            if(std::isfinite(lb)) {
-                if(!empty) {
-                    str << '\n';
+                if(std::isfinite(lb)) {
+                    if(!empty) {
+                        str << '\n';
+                    }
+                    str << label << "LB = " << lb;
+                    empty = false;
                 }
-                str << "LB = " << lb;
             }
         }
 
@@ -683,7 +885,10 @@ void VideoOutput::push_frame(TreePtr tree) {
 
     // Push buffer into the pipeline
     GstFlowReturn ret;
-    g_signal_emit_by_name(d_->vidsrc, "push-buffer", buffer, &ret);
+    {
+        StageTimer timer(Stage::Push);
+        g_signal_emit_by_name(d_->vidsrc, "push-buffer", buffer, &ret);
+    }
     gst_buffer_unref(buffer);
 
     if(ret != GST_FLOW_OK) {
@@ -706,3 +911,85 @@ void VideoOutput::stop(bool error) {
         d_->r_thread.join();
     }
 }
+
+
+void VideoOutput::remux(const std::string& src, const std::string& dst) {
+    // Find the highest ranked muxer for the destination file type
+    GstCaps* file_caps = get_caps_for_file(dst);
+    if(!file_caps) {
+        throw std::runtime_error("failed to guess video file format");
+    }
+    GList* all_muxers = gst_element_factory_list_get_elements(GST_ELEMENT_FACTORY_TYPE_MUXER, GST_RANK_MARGINAL);
+    GList* muxers = gst_element_factory_list_filter(all_muxers, file_caps, GST_PAD_SRC, FALSE);
+    muxers = g_list_sort(muxers, gst_plugin_feature_rank_compare_func);
+    std::string muxer_name = muxers ? gst_plugin_feature_get_name(GST_PLUGIN_FEATURE(muxers->data)) : "";
+    gst_plugin_feature_list_free(all_muxers);
+    gst_plugin_feature_list_free(muxers);
+    gst_caps_unref(file_caps);
+    if(muxer_name.empty()) {
+        throw std::runtime_error("failed to find muxer for video file");
+    }
+
+    // Build a pipeline that demuxes, parses and remuxes without re-encoding
+    std::string description = "filesrc name=source ! tsdemux ! parsebin ! " + muxer_name + " ! filesink name=sink";
+    GError* error = NULL;
+    GstElement* pipeline = gst_parse_launch(description.c_str(), &error);
+    if(!pipeline) {
+        std::string message = error ? error->message : "unknown error";
+        g_clear_error(&error);
+        throw std::runtime_error("failed to build remuxing pipeline: " + message);
+    }
+    g_clear_error(&error);
+
+    GstElement* source = gst_bin_get_by_name(GST_BIN(pipeline), "source");
+    GstElement* sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+    g_object_set(G_OBJECT(source), "location", src.c_str(), NULL);
+    g_object_set(G_OBJECT(sink), "location", dst.c_str(), NULL);
+    gst_object_unref(source);
+    gst_object_unref(sink);
+
+    // Run pipeline until end of stream
+    GstBus* bus = gst_element_get_bus(pipeline);
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    GstMessage* msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE, (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+    bool failed = msg && GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR;
+    if(msg) {
+        gst_message_unref(msg);
+    }
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(bus);
+    gst_object_unref(pipeline);
+
+    if(failed) {
+        throw std::runtime_error("failed to remux video file");
+    }
+}
+
+
+void VideoOutput::concatenate(const std::vector<std::string>& segments, const std::string& dst) {
+    // MPEG-TS segments can be concatenated byte by byte
+    std::string ext = dst.substr(std::min(dst.size(), dst.find_last_of('.')));
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    bool direct = (ext == ".ts" || ext == ".mts");
+    std::string combined = direct ? dst : dst + ".combined.ts";
+
+    {
+        std::ofstream out(combined.c_str(), std::ios::binary | std::ios::trunc);
+        for(const std::string& segment : segments) {
+            std::ifstream in(segment.c_str(), std::ios::binary);
+            if(!in) {
+                throw std::runtime_error("failed to read video segment " + segment);
+            }
+            out << in.rdbuf();
+        }
+        if(!out) {
+            throw std::runtime_error("failed to write " + combined);
+        }
+    }
+
+    // Otherwise, copy the streams into the requested container
+    if(!direct) {
+        remux(combined, dst);
+        std::remove(combined.c_str());
+    }
+}
@@ -19,8 +19,10 @@
 #ifndef __VBC_VIDEO_OUTPUT_HPP
 #define __VBC_VIDEO_OUTPUT_HPP
 
+#include <cstdint>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "Tree.hpp"
 
@@ -47,6 +49,11 @@ private:
     bool bounds;                ///< Render bounds overlay.
     size_t text_halign;         ///< Horizontal alignment of text overlay.
     size_t text_valign;         ///< Vertical alignment of text overlay.
+    size_t enc_threads;         ///< Number of encoder threads (0 for encoder default).
+    size_t first_frame;         ///< Index of the first frame in the overall video.
+    bool draft;                 ///< Render draft quality (no anti-aliasing, point nodes, fastest encoder preset).
+    bool null_sink;             ///< Discard frames instead of encoding them (for benchmarks).
+    bool hash_frames;           ///< Compute a hash of every rendered frame.
 
 public:
     VideoOutput();
@@ -60,6 +67,12 @@ public:
     bool get_clock() const { return clock; }                                                                    ///< Indicates whether a clock will be rendered.
     bool get_bounds() const { return bounds; }                                                                  ///< Indicates whether bounds text will be rendered.
     std::pair<size_t, size_t> get_text_align() const { return std::make_pair(text_halign, text_valign); }       ///< Returns bounds overlay alignment flags
+    size_t get_encoder_threads() const { return enc_threads; }                                                  ///< Returns requested number of encoder threads.
+    size_t get_first_frame() const { return first_frame; }                                                      ///< Returns index of the first rendered frame.
+    bool get_draft() const { return draft; }                                                                    ///< Indicates whether draft quality is rendered.
+    bool get_null_sink() const { return null_sink; }                                                            ///< Indicates whether frames are discarded instead of encoded.
+    bool get_hash_frames() const { return hash_frames; }                                                        ///< Indicates whether rendered frames are hashed.
+    uint64_t get_frame_hash() const;                                                                            ///< Returns the hash of the last rendered frame.
     size_t get_num_frames() const;                                                                              ///< Returns number of rendered frames.
     double get_frame_time() const;                                                                              ///< Returns duration of a single frame in seconds.
     double get_stream_time() const;                                                                             ///< Returns stream time at end of last rendered frame in seconds.
@@ -73,10 +86,19 @@ public:
     void set_clock(bool on);
     void set_bounds(bool on);
     void set_text_align(size_t halign, size_t valign);
+    void set_encoder_threads(size_t threads);
+    void set_first_frame(size_t frame);
+    void set_draft(bool on);
+    void set_null_sink(bool on);
+    void set_hash_frames(bool on);
 
     void start();                               ///< Sets the renderer up, allocates resources, and starts rendering threads.
     void push_frame(TreePtr tree);              ///< Renders a single frame of the tree and pushes it into the encoding pipeline.
+    void push_frame(const std::vector<TreePtr>& trees); ///< Renders the trees side by side into a single frame and pushes it into the encoding pipeline.
     void stop(bool error = false);              ///< Shuts the renderer down and closes the output.
+
+    static void remux(const std::string& src, const std::string& dst); ///< Copies the streams of an MPEG-TS file into the container format of the destination file.
+    static void concatenate(const std::vector<std::string>& segments, const std::string& dst); ///< Joins MPEG-TS segments into the destination file, remuxing unless it is MPEG-TS itself.
 };
 
 #endif /* end of include guard: __VBC_VIDEO_OUTPUT_HPP */
@@ -16,27 +16,48 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <chrono>
 #include <csignal>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
 #include <iomanip>
+#include <limits>
+#include <memory>
 #include <sstream>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 
 #include <boost/filesystem.hpp>
 #include <boost/program_options.hpp>
 #include <gst/gst.h>
-
-#include "Tree.hpp"
-#include "VbcReader.hpp"
-#include "VideoOutput.hpp"
+#include <pthread.h>
+#include <signal.h>
+
+#include "Analysis.hpp"
+#include "Animation.hpp"
+#include "BatchRunner.hpp"
+#include "ContactSheet.hpp"
+#include "Profiler.hpp"
+#include "RenderDaemon.hpp"
+#include "RenderFarm.hpp"
+#include "RenderJob.hpp"
+#include "Scheduler.hpp"
+#include "Snapshot.hpp"
+#include "Telemetry.hpp"
+#include "TilePyramid.hpp"
+#include "Trace.hpp"
+#include "VectorExport.hpp"
 
 namespace bfs = boost::filesystem;
 namespace po = boost::program_options;
 
 
-bool signal_terminate = false;
+std::atomic_bool signal_terminate(false);
 std::string signal_message;
 
 void signal_handler(int sig) {
@@ -50,36 +71,88 @@ void signal_handler(int sig) {
     }
 }
 
+std::atomic_bool profile_reporter_stop(false);
+
+/// Prints the stage profile whenever SIGUSR1 is received. The signal must be blocked in all threads.
+void profile_reporter(std::ostream* out) {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+
+    int sig;
+    while(sigwait(&set, &sig) == 0 && !profile_reporter_stop) {
+        Profiler::instance().print_report(*out);
+    }
+}
+
 /// Program options
 struct {
-    bfs::path input_path;                       ///< Path of VBC input file.
-    bfs::path output_path;                      ///< Path of video output file.
+    RenderOptions render;                       ///< Options of the rendering job.
+
+    bfs::path batch_path;                       ///< Path of batch job list.
+    bfs::path batch_report_path;                ///< Path of batch summary report.
+    size_t batch_jobs;                          ///< Number of concurrently running batch jobs.
+    size_t thread_budget;                       ///< Number of threads shared by all pipeline stages (0 for one per core).
+    bool pin_threads;                           ///< Pin scheduler workers to CPUs.
 
-    size_t video_width;                         ///< Width of video output in pixels.
-    size_t video_height;                        ///< Height of video output in pixels.
-    size_t video_fps_n;                         ///< Numerator of frame rate.
-    size_t video_fps_d;                         ///< Denominator of frame rate.
-    size_t video_condense_n;                    ///< Numerator of time condensation factor.
-    size_t video_condense_d;                    ///< Denominator of time condensation factor.
+    std::string daemon_socket;                  ///< Path of daemon socket.
+    size_t daemon_jobs;                         ///< Number of concurrently running daemon jobs.
 
-    double start_timestamp;                     ///< VBC timestamp to start rendering.
-    double stop_timestamp;                      ///< VBC timestamp to stop rendering.
+    size_t farm_workers;                        ///< Number of local worker processes (0 to render in-process).
+    std::string farm_dir;                       ///< Shared working directory of coordinator and workers.
+    std::string farm_worker_dir;                ///< Working directory when running as a worker.
+    double segment_length;                      ///< Length of segments in seconds of video.
 
-    bool                        clock;          ///< Render clock overlay.
-    bool                        bounds;         ///< Render bound overlay.
-    std::pair<size_t, size_t>   text_align;     ///< Alignment code for text overlay.
+    std::string analysis_path;                  ///< Path of statistics output (empty to render a video).
+    double sample_interval;                     ///< Sampling interval of statistics in seconds of solver time.
+
+    std::string animation_path;                 ///< Path of animation output (empty to render a video).
+    double animation_duration;                  ///< Playback duration of animated SVG in seconds.
+
+    std::string snapshot_times;                 ///< Comma-separated solver times of still images.
+    std::vector<double> snapshots;              ///< Parsed solver times of still images (empty to render a video).
+    std::string export_path;                    ///< Path of vector or tile export of the final tree (empty to render a video).
+    double tile_scale;                          ///< Pixels per layout unit at the deepest tile level.
+
+    size_t sheet_count;                         ///< Number of contact sheet thumbnails (0 to render a video).
+    size_t sheet_columns;                       ///< Number of contact sheet columns (0 for a square grid).
+
+    bool resumable;                             ///< Write resumable state after every segment.
+    bool resume;                                ///< Continue an interrupted render.
 
     double report_interval;                     ///< Interval for status updates in seconds.
     size_t header_repeat;                       ///< Number of status updates before header is repeated.
+    std::string telemetry_target;               ///< Target of JSON progress telemetry (empty to disable).
+    bool profile;                               ///< Print stage profile at exit.
+    bool perf_counters;                         ///< Count hardware events of hot stages.
+    std::string trace_path;                     ///< Path of Chrome trace output (empty to disable).
 } program_options;
 
 
+/// Returns the stream for profile reports; standard output is kept free for telemetry lines.
+std::ostream& profile_output() {
+    return program_options.telemetry_target == "-" ? std::cerr : std::cout;
+}
+
+
+/// Option values that require further parsing
+struct RawRenderOptions {
+    size_t draft_step;
+    std::string text_align;
+    std::string fps_frac;
+    std::string condense_frac;
+    std::string start_time;
+    std::string end_time;
+    std::string hidden_categories;
+};
+
+
 void print_usage_message(const char* executable, std::ostream& out) {
         // Find bare command
         std::string command = bfs::path(executable).filename().stem().c_str();
 
         // Print usage line
-        out << "Usage: " << command << " [args...] [-o output-file] input-file\n";
+        out << "Usage: " << command << " [args...] [-o output-file] input-file [input-file]\n";
 }
 
 
@@ -183,199 +256,651 @@ double parse_timestamp(const std::string& str) {
 }
 
 
-int parse_program_options(int argc, char** argv) {
-    std::string text_align;
-    std::string fps_frac;
-    std::string condense_frac;
-    std::string start_time;
-    std::string end_time;
-
-    // Describe program options
-    po::options_description visible("Allowed options");
+void add_render_options(po::options_description& visible, po::options_description& hidden, RenderOptions& opts, RawRenderOptions& raw) {
     visible.add_options()
-        ("help,h", "produce help message")
         (
             "output,o",
-            po::value<bfs::path>(&program_options.output_path)
-                ->default_value(bfs::path("vbcrender.avi"), ""),
+            po::value<std::string>(&opts.output_path)
+                ->default_value("vbcrender.avi", ""),
             "specify output file path"
         )(
             "width,w",
-            po::value<size_t>(&program_options.video_width)
+            po::value<size_t>(&opts.video_width)
                 ->default_value(1920, ""),
             "specify output video width"
         )(
             "height,h",
-            po::value<size_t>(&program_options.video_height)
+            po::value<size_t>(&opts.video_height)
                 ->default_value(1080, ""),
             "specify output video height"
         )(
             "fps",
-            po::value<std::string>(&fps_frac),
+            po::value<std::string>(&raw.fps_frac),
             "specify output video frame rate (fraction)"
         )(
             "condense",
-            po::value<std::string>(&condense_frac),
+            po::value<std::string>(&raw.condense_frac),
             "specify time condensation factor (fraction)"
         )(
             "start-time",
-            po::value<std::string>(&start_time),
+            po::value<std::string>(&raw.start_time),
             "start video at given event time"
         )(
             "end-time",
-            po::value<std::string>(&end_time),
+            po::value<std::string>(&raw.end_time),
             "end video at given event time"
         )(
             "clock",
-            po::bool_switch(&program_options.clock),
+            po::bool_switch(&opts.clock),
             "render clock"
         )(
             "bounds",
-            po::bool_switch(&program_options.bounds),
+            po::bool_switch(&opts.bounds),
             "render current bounds"
         )(
             "overlay-pos",
-            po::value<std::string>(&text_align),
+            po::value<std::string>(&raw.text_align),
             "specify position of text overlay"
+        )(
+            "draft",
+            po::value<size_t>(&raw.draft_step)
+                ->implicit_value(4, "4"),
+            "render quick preview at half size with every Nth frame"
+        )(
+            "null-sink",
+            po::bool_switch(&opts.null_sink),
+            "discard frames instead of encoding them (for benchmarks)"
+        )(
+            "frame-hashes",
+            po::value<std::string>(&opts.hash_path),
+            "write a hash of every rendered frame to file"
+        )(
+            "check-hashes",
+            po::value<std::string>(&opts.hash_reference_path),
+            "compare the hash of every rendered frame with a file written by --frame-hashes"
+        )(
+            "styles",
+            po::value<std::string>(&opts.style_path),
+            "load node and edge styles from a VBCTOOL resource file (.rsc)"
+        )(
+            "palette",
+            po::value<std::string>(&opts.palette_path),
+            "specify color palette for --styles (default: GRAPHrgb.txt next to it)"
+        )(
+            "hide",
+            po::value<std::string>(&raw.hidden_categories),
+            "hide nodes of the comma-separated categories together with their subtrees"
         )
     ;
-    po::options_description hidden("Hidden options");
     hidden.add_options()
         (
             "input-file",
-            po::value<bfs::path>(&program_options.input_path)
+            po::value<std::vector<std::string>>(&opts.input_paths)
         )
     ;
-    po::options_description desc;
-    desc.add(visible).add(hidden);
-
-    // Add positional arguments
-    po::positional_options_description p;
-    p.add("input-file", 1);
-
-    // Parse command line arguments
-    po::variables_map vm;
-    try{
-        po::store(
-            po::command_line_parser(argc, argv)
-                .options(desc)
-                .positional(p)
-                .run(),
-            vm
-        );
-        po::notify(vm);
-    } catch(const std::exception& err) {
-        std::cerr << "Error: " << err.what() << std::endl;
-        return 1;
-    }
-
-    // Output help message if desired
-    if(vm.count("help")) {
-        print_usage_message(argv[0], std::cout);
+}
 
-        std::cout << "\nRenders a video from a VBC file.\n\n"
-                  << visible << std::endl;
-        return 1;
-    }
 
+int parse_render_options(const po::variables_map& vm, const RawRenderOptions& raw, RenderOptions& opts, std::ostream& out) {
     // Parse frame rate as fraction
     if(vm.count("fps")) {
         try {
-            parse_fraction(fps_frac, program_options.video_fps_n, program_options.video_fps_d);
+            parse_fraction(raw.fps_frac, opts.video_fps_n, opts.video_fps_d);
         } catch(const std::invalid_argument& err) {
-            std::cerr << "Error parsing frame rate: " << err.what() << std::endl;
+            out << "Error parsing frame rate: " << err.what() << std::endl;
             return 1;
         }
 
-        if(!program_options.video_fps_n || !program_options.video_fps_d) {
-            std::cerr << "Error parsing frame rate: invalid numerator or denominator" << std::endl;
+        if(!opts.video_fps_n || !opts.video_fps_d) {
+            out << "Error parsing frame rate: invalid numerator or denominator" << std::endl;
             return 1;
         }
     }
     else {
-        program_options.video_fps_n = 30;
-        program_options.video_fps_d = 1;
+        opts.video_fps_n = 30;
+        opts.video_fps_d = 1;
     }
 
     // Parse time condensation factor as fraction
     if(vm.count("condense")) {
         try {
-            parse_fraction(condense_frac, program_options.video_condense_n, program_options.video_condense_d);
+            parse_fraction(raw.condense_frac, opts.video_condense_n, opts.video_condense_d);
         } catch(const std::invalid_argument& err) {
-            std::cerr << "Error parsing condensation factor: " << err.what() << std::endl;
+            out << "Error parsing condensation factor: " << err.what() << std::endl;
             return 1;
         }
 
-        if(!program_options.video_condense_n || !program_options.video_condense_d) {
-            std::cerr << "Error parsing condensation factor: invalid numerator or denominator" << std::endl;
+        if(!opts.video_condense_n || !opts.video_condense_d) {
+            out << "Error parsing condensation factor: invalid numerator or denominator" << std::endl;
             return 1;
         }
     }
     else {
-        program_options.video_condense_n = 1;
-        program_options.video_condense_d = 1;
+        opts.video_condense_n = 1;
+        opts.video_condense_d = 1;
     }
 
     // Parse start timestamp
     if(vm.count("start-time")) {
         try {
-            program_options.start_timestamp = parse_timestamp(start_time);
+            opts.start_timestamp = parse_timestamp(raw.start_time);
         }
         catch(const std::invalid_argument& err) {
-            std::cerr << "Error parsing start time: " << err.what() << std::endl;
+            out << "Error parsing start time: " << err.what() << std::endl;
             return 1;
         }
 
-        if(program_options.start_timestamp < 0) {
-            std::cerr << "Warning: adjusting start time to 0.0" << std::endl;
-            program_options.start_timestamp = 0;
+        if(opts.start_timestamp < 0) {
+            out << "Warning: adjusting start time to 0.0" << std::endl;
+            opts.start_timestamp = 0;
         }
     }
     else {
-        program_options.start_timestamp = 0;
+        opts.start_timestamp = 0;
     }
 
     // Parse end timestamp
     if(vm.count("end-time")) {
         try {
-            program_options.stop_timestamp = parse_timestamp(end_time);
+            opts.stop_timestamp = parse_timestamp(raw.end_time);
         }
         catch(const std::invalid_argument& err) {
-            std::cerr << "Error parsing end time: " << err.what() << std::endl;
+            out << "Error parsing end time: " << err.what() << std::endl;
             return 1;
         }
 
-        if(program_options.stop_timestamp <= program_options.start_timestamp) {
-            std::cerr << "Warning: end time is before start time and will be ignored" << std::endl;
+        if(opts.stop_timestamp <= opts.start_timestamp) {
+            out << "Warning: end time is before start time and will be ignored" << std::endl;
         }
     }
     else {
-        program_options.stop_timestamp = 0;
+        opts.stop_timestamp = 0;
     }
 
     // Parse overlay alignment
     if(vm.count("overlay-pos") > 0) {
         try {
-            parse_pango_alignment(text_align, program_options.text_align);
+            parse_pango_alignment(raw.text_align, opts.text_align);
         } catch(const std::invalid_argument& err) {
-            std::cerr << "Error parsing overlay alignment: " << err.what() << std::endl;
+            out << "Error parsing overlay alignment: " << err.what() << std::endl;
             return 1;
         }
     }
     else {
-        program_options.text_align = std::make_pair(0, 2);
+        opts.text_align = std::make_pair(0, 2);
+    }
+
+    // Draft previews trade resolution, frame rate and quality for speed
+    opts.draft = vm.count("draft") > 0;
+    if(opts.draft) {
+        if(!raw.draft_step) {
+            out << "Error: draft frame step must be positive" << std::endl;
+            return 1;
+        }
+        opts.video_width = std::max<size_t>(2, (opts.video_width / 2) & ~size_t(1));
+        opts.video_height = std::max<size_t>(2, (opts.video_height / 2) & ~size_t(1));
+        opts.video_fps_d *= raw.draft_step;
+    }
+
+    // Load style resource
+    if(!opts.palette_path.empty() && opts.style_path.empty()) {
+        out << "Error: --palette requires --styles" << std::endl;
+        return 1;
+    }
+    if(!opts.style_path.empty()) {
+        try {
+            opts.style = StyleSheet::load(opts.style_path, opts.palette_path);
+        } catch(const std::exception& err) {
+            out << "Error loading styles: " << err.what() << std::endl;
+            return 1;
+        }
+    }
+
+    // Parse hidden categories
+    if(vm.count("hide")) {
+        std::istringstream in(raw.hidden_categories);
+        std::string item;
+        while(std::getline(in, item, ',')) {
+            std::istringstream item_in(item);
+            size_t category;
+            if(!(item_in >> category) || !(item_in >> std::ws).eof()) {
+                out << "Error parsing hidden category '" << item << "'" << std::endl;
+                return 1;
+            }
+            opts.hidden_categories.push_back(category);
+        }
+        try {
+            opts.style = (opts.style ? opts.style : StyleSheet::standard())->hide_categories(opts.hidden_categories);
+        } catch(const std::invalid_argument& err) {
+            out << "Error hiding categories: " << err.what() << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+int parse_job_arguments(const std::vector<std::string>& args, RenderOptions& opts, std::ostream& err) {
+    RawRenderOptions raw;
+    po::options_description visible, hidden;
+    add_render_options(visible, hidden, opts, raw);
+    po::options_description desc;
+    desc.add(visible).add(hidden);
+    po::positional_options_description p;
+    p.add("input-file", 2);
+
+    po::variables_map vm;
+    try {
+        po::store(
+            po::command_line_parser(args)
+                .options(desc)
+                .positional(p)
+                .run(),
+            vm
+        );
+        po::notify(vm);
+    } catch(const std::exception& e) {
+        err << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    if(parse_render_options(vm, raw, opts, err)) {
+        return 1;
+    }
+    if(opts.input_paths.empty()) {
+        err << "Error: expected input file" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+
+int parse_batch_file(const bfs::path& path, BatchRunner& batch) {
+    std::ifstream in(path.c_str());
+    if(!in) {
+        std::cerr << "Error: could not open batch file " << path << std::endl;
+        return 1;
+    }
+
+    // Each line holds the arguments of one job in command line syntax
+    std::string line;
+    size_t line_num = 0;
+    while(std::getline(in, line)) {
+        ++line_num;
+        std::vector<std::string> args = po::split_unix(line);
+        if(args.empty() || args.front()[0] == '#') {
+            continue;
+        }
+
+        RenderOptions opts;
+        if(parse_job_arguments(args, opts, std::cerr)) {
+            std::cerr << "Error in batch file line " << line_num << std::endl;
+            return 1;
+        }
+
+        batch.add_job(opts);
+    }
+
+    return 0;
+}
+
+
+int parse_program_options(int argc, char** argv) {
+    RawRenderOptions raw;
+
+    // Describe program options
+    po::options_description visible("Allowed options");
+    visible.add_options()
+        ("help,h", "produce help message")
+    ;
+    po::options_description hidden("Hidden options");
+    add_render_options(visible, hidden, program_options.render, raw);
+
+    po::options_description report("Reporting options");
+    report.add_options()
+        (
+            "report-interval",
+            po::value<double>(&program_options.report_interval)
+                ->default_value(5.0, "5"),
+            "specify interval between status updates in seconds"
+        )(
+            "header-repeat",
+            po::value<size_t>(&program_options.header_repeat)
+                ->default_value(12, "12"),
+            "specify number of status lines between headers (0 to print once)"
+        )(
+            "telemetry",
+            po::value<std::string>(&program_options.telemetry_target),
+            "write JSON progress lines to file, fd:N, unix:SOCKET or - (stdout, status lines and profile move to stderr)"
+        )(
+            "profile",
+            po::bool_switch(&program_options.profile),
+            "print time spent per pipeline stage at exit (also on SIGUSR1)"
+        )(
+            "perf-counters",
+            po::bool_switch(&program_options.perf_counters),
+            "count hardware events of parse, layout and draw (implies --profile)"
+        )(
+            "trace",
+            po::value<std::string>(&program_options.trace_path),
+            "record pipeline spans to file in Chrome trace format"
+        )
+    ;
+    visible.add(report);
+
+    po::options_description batch("Batch options");
+    batch.add_options()
+        (
+            "batch",
+            po::value<bfs::path>(&program_options.batch_path),
+            "render all jobs listed in file (one command line per job)"
+        )(
+            "batch-jobs,j",
+            po::value<size_t>(&program_options.batch_jobs)
+                ->default_value(1, ""),
+            "specify number of concurrently running batch jobs"
+        )(
+            "batch-report",
+            po::value<bfs::path>(&program_options.batch_report_path),
+            "write batch summary report to file instead of stdout"
+        )
+    ;
+    visible.add(batch);
+
+    po::options_description scheduling("Scheduling options");
+    scheduling.add_options()
+        (
+            "threads",
+            po::value<size_t>(&program_options.thread_budget)
+                ->default_value(0, ""),
+            "specify number of threads shared by all pipeline stages and batch jobs (default: one per core)"
+        )(
+            "pin-threads",
+            po::bool_switch(&program_options.pin_threads),
+            "pin scheduler worker threads to CPUs"
+        )
+    ;
+    visible.add(scheduling);
+
+    po::options_description daemon("Daemon options");
+    daemon.add_options()
+        (
+            "daemon",
+            po::value<std::string>(&program_options.daemon_socket),
+            "accept rendering jobs on Unix domain socket"
+        )(
+            "daemon-jobs",
+            po::value<size_t>(&program_options.daemon_jobs)
+                ->default_value(1, ""),
+            "specify number of concurrently running daemon jobs"
+        )
+    ;
+    visible.add(daemon);
+
+    po::options_description farm("Distributed rendering options");
+    farm.add_options()
+        (
+            "farm",
+            po::value<size_t>(&program_options.farm_workers)
+                ->default_value(0, ""),
+            "render segments in given number of worker processes"
+        )(
+            "farm-dir",
+            po::value<std::string>(&program_options.farm_dir),
+            "specify new or empty shared working directory (kept after rendering)"
+        )(
+            "segment-length",
+            po::value<double>(&program_options.segment_length)
+                ->default_value(60.0, ""),
+            "specify segment length in seconds of video (also used by --resumable)"
+        )(
+            "farm-worker",
+            po::value<std::string>(&program_options.farm_worker_dir),
+            "render segments published in working directory"
+        )
+    ;
+    visible.add(farm);
+
+    po::options_description analysis("Analysis options");
+    analysis.add_options()
+        (
+            "analyze",
+            po::value<std::string>(&program_options.analysis_path),
+            "write tree statistics to file instead of rendering (CSV for .csv, binary columnar otherwise)"
+        )(
+            "sample-interval",
+            po::value<double>(&program_options.sample_interval)
+                ->default_value(1.0, "1"),
+            "specify sampling interval of statistics in seconds of solver time"
+        )
+    ;
+    visible.add(analysis);
+
+    po::options_description animation("Animation options");
+    animation.add_options()
+        (
+            "animate",
+            po::value<std::string>(&program_options.animation_path),
+            "write node creation times, final positions, category changes and bounds instead of rendering (animated SVG for .svg, binary columnar otherwise)"
+        )(
+            "animate-duration",
+            po::value<double>(&program_options.animation_duration)
+                ->default_value(60.0, "60"),
+            "specify playback duration of animated SVG in seconds"
+        )
+    ;
+    visible.add(animation);
+
+    po::options_description snapshot("Snapshot options");
+    snapshot.add_options()
+        (
+            "snapshot",
+            po::value<std::string>(&program_options.snapshot_times),
+            "write still images at comma-separated solver times instead of rendering (PNG, PDF, SVG or DeepZoom DZI by output extension)"
+        )(
+            "export",
+            po::value<std::string>(&program_options.export_path),
+            "write the final tree (or the tree at --end-time) to an SVG, PDF or DeepZoom DZI file instead of rendering"
+        )(
+            "tile-scale",
+            po::value<double>(&program_options.tile_scale)
+                ->default_value(1.0, "1"),
+            "specify pixels per layout unit at the deepest level of DeepZoom tiles"
+        )
+    ;
+    visible.add(snapshot);
+
+    po::options_description sheet("Contact sheet options");
+    sheet.add_options()
+        (
+            "contact-sheet",
+            po::value<size_t>(&program_options.sheet_count)
+                ->default_value(0, ""),
+            "write a PNG grid of N thumbnails evenly spaced over the run instead of rendering"
+        )(
+            "sheet-columns",
+            po::value<size_t>(&program_options.sheet_columns)
+                ->default_value(0, "auto"),
+            "specify number of contact sheet columns"
+        )
+    ;
+    visible.add(sheet);
+
+    po::options_description resume("Resume options");
+    resume.add_options()
+        (
+            "resumable",
+            po::bool_switch(&program_options.resumable),
+            "render in segments and save state after each of them"
+        )(
+            "resume",
+            po::bool_switch(&program_options.resume),
+            "continue an interrupted resumable render"
+        )
+    ;
+    visible.add(resume);
+
+    po::options_description desc;
+    desc.add(visible).add(hidden);
+
+    // Add positional arguments
+    po::positional_options_description p;
+    p.add("input-file", 2);
+
+    // Parse command line arguments
+    po::variables_map vm;
+    try{
+        po::store(
+            po::command_line_parser(argc, argv)
+                .options(desc)
+                .positional(p)
+                .run(),
+            vm
+        );
+        po::notify(vm);
+    } catch(const std::exception& err) {
+        std::cerr << "Error: " << err.what() << std::endl;
+        return 1;
+    }
+
+    // Output help message if desired
+    if(vm.count("help")) {
+        print_usage_message(argv[0], std::cout);
+
+        std::cout << "\nRenders a video from a VBC file. If two files are given, their trees are\n"
+                  << "rendered side by side on a shared timeline.\n\n"
+                  << visible << std::endl;
+        return 1;
+    }
+
+    if(parse_render_options(vm, raw, program_options.render, std::cerr)) {
+        return 1;
+    }
+
+    // Select at most one mode; modes other than video rendering take one input file or none
+    const struct {
+        const char* option;         ///< Option selecting the mode.
+        bool        selected;       ///< Mode is selected.
+        size_t      max_inputs;     ///< Maximum number of input files.
+    } modes[] = {
+        { "--farm-worker", !program_options.farm_worker_dir.empty(), 0 },
+        { "--daemon", !program_options.daemon_socket.empty(), 0 },
+        { "--batch", !program_options.batch_path.empty(), 0 },
+        { "--analyze", !program_options.analysis_path.empty(), 1 },
+        { "--animate", !program_options.animation_path.empty(), 1 },
+        { "--snapshot", vm.count("snapshot") > 0, 1 },
+        { "--export", !program_options.export_path.empty(), 1 },
+        { "--contact-sheet", program_options.sheet_count > 0, 1 },
+        { "--farm", program_options.farm_workers > 0, 1 },
+        { program_options.resume ? "--resume" : "--resumable", program_options.resumable || program_options.resume, 1 }
+    };
+    const char* mode = nullptr;
+    for(const auto& entry : modes) {
+        if(!entry.selected) {
+            continue;
+        }
+        if(mode) {
+            std::cerr << "Error: " << mode << " cannot be combined with " << entry.option << std::endl;
+            return 1;
+        }
+        mode = entry.option;
+
+        const size_t inputs = program_options.render.input_paths.size();
+        if(inputs > entry.max_inputs) {
+            std::cerr << "Error: " << entry.option << (entry.max_inputs ? " takes a single input file" : " takes no input file") << std::endl;
+            return 1;
+        }
     }
 
     // Throw an error if there is no input file
-    if(!vm.count("input-file")) {
+    if(!vm.count("input-file") && !vm.count("batch") && !vm.count("daemon") && !vm.count("farm-worker")) {
         print_usage_message(argv[0], std::cerr);
         std::cerr << "Error: expected input file" << std::endl;
         return 1;
     }
 
-    // Set (currently) fixed default options
-    program_options.report_interval = 5.0;
-    program_options.header_repeat = 12;
+    if(!(program_options.report_interval > 0.0)) {
+        std::cerr << "Error: report interval must be positive" << std::endl;
+        return 1;
+    }
+
+    // Configure the scheduler before any pipeline thread is created
+    Scheduler& scheduler = Scheduler::instance();
+    scheduler.configure(program_options.thread_budget, program_options.pin_threads);
+
+    // Readers, the render loop and the encoder need threads of their own; leave the encoder what the
+    // readers, the render loop and, with several panes, one drawing worker do not use
+    RenderOptions& render = program_options.render;
+    if(program_options.thread_budget && !vm.count("batch")) {
+        const size_t inputs = std::max<size_t>(1, render.input_paths.size());
+        if(program_options.thread_budget < inputs + 2) {
+            std::cerr << "Error: --threads must be at least " << inputs + 2
+                      << " (one reader per input, the render loop and the encoder)" << std::endl;
+            return 1;
+        }
+        size_t reserved = inputs + 1 + (inputs > 1 ? 1 : 0);
+        render.encoder_threads = program_options.thread_budget > reserved ? program_options.thread_budget - reserved : 1;
+    }
+
+    // Parse snapshot times
+    if(vm.count("snapshot")) {
+        std::istringstream in(program_options.snapshot_times);
+        std::string item;
+        while(std::getline(in, item, ',')) {
+            try {
+                program_options.snapshots.push_back(parse_timestamp(item));
+            }
+            catch(const std::invalid_argument& err) {
+                std::cerr << "Error parsing snapshot time '" << item << "': " << err.what() << std::endl;
+                return 1;
+            }
+        }
+        if(program_options.snapshots.empty()) {
+            std::cerr << "Error: expected at least one snapshot time" << std::endl;
+            return 1;
+        }
+        if(!is_snapshot_format(program_options.render.output_path)) {
+            std::cerr << "Error: snapshot output must be a .png, .pdf, .svg or .dzi file" << std::endl;
+            return 1;
+        }
+    }
+
+    if(vm.count("export") && !is_vector_format(program_options.export_path) && !is_tile_format(program_options.export_path)) {
+        std::cerr << "Error: export must be a .svg, .pdf or .dzi file" << std::endl;
+        return 1;
+    }
+
+    if(!(program_options.animation_duration > 0.0)) {
+        std::cerr << "Error: animation duration must be positive" << std::endl;
+        return 1;
+    }
+
+    if(!(program_options.tile_scale > 0.0)) {
+        std::cerr << "Error: tile scale must be positive" << std::endl;
+        return 1;
+    }
+
+    if(program_options.render.null_sink && (program_options.farm_workers || program_options.resumable || program_options.resume)) {
+        std::cerr << "Error: --null-sink cannot be combined with render farms or resumable rendering" << std::endl;
+        return 1;
+    }
+
+    const bool hashing = vm.count("frame-hashes") || vm.count("check-hashes");
+    if(hashing && (program_options.farm_workers || program_options.resumable || program_options.resume)) {
+        std::cerr << "Error: frame hashes cannot be combined with render farms or resumable rendering" << std::endl;
+        return 1;
+    }
+
+    if(program_options.sheet_count) {
+        std::string ext = bfs::extension(program_options.render.output_path);
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        if(ext != ".png") {
+            std::cerr << "Error: contact sheet output must be a .png file" << std::endl;
+            return 1;
+        }
+    }
 
     return 0;
 }
@@ -402,19 +927,335 @@ void print_status_line(double runtime, double clock_time, double stream_time, si
 }
 
 
-int main(int argc, char** argv) {
-    typedef std::chrono::steady_clock Clock;
-    typedef typename Clock::time_point TimePoint;
-    typedef typename Clock::duration Duration;
-    typedef std::chrono::duration<double> Seconds;
+int run_batch() {
+    BatchRunner batch;
+    if(parse_batch_file(program_options.batch_path, batch)) {
+        return 1;
+    }
+
+    batch.set_max_jobs(std::max<size_t>(1, program_options.batch_jobs));
+    if(program_options.thread_budget) {
+        for(const BatchRunner::Entry& entry : batch.get_jobs()) {
+            if(program_options.thread_budget < BatchRunner::min_threads(entry.options)) {
+                std::cerr << "Error: --threads must be at least " << BatchRunner::min_threads(entry.options)
+                          << " for job " << entry.index + 1 << " (one reader per input, the render loop and the encoder)" << std::endl;
+                return 1;
+            }
+        }
+        batch.set_thread_budget(program_options.thread_budget);
+    }
+    batch.set_abort_flag(&signal_terminate);
+    batch.set_log(&std::cout);
+
+    size_t failed = batch.run();
+    if(signal_terminate) {
+        std::cout << "SIGNAL: " << signal_message << std::endl;
+    }
+
+    // Write summary report
+    if(program_options.batch_report_path.empty()) {
+        batch.write_report(std::cout);
+    }
+    else {
+        std::ofstream report(program_options.batch_report_path.c_str());
+        batch.write_report(report);
+        if(!report) {
+            std::cerr << "Error: could not write batch report" << std::endl;
+            return 1;
+        }
+    }
+
+    return failed ? 1 : 0;
+}
+
+
+int run_daemon() {
+    RenderDaemon daemon(program_options.daemon_socket, parse_job_arguments);
+    daemon.set_max_jobs(std::max<size_t>(1, program_options.daemon_jobs));
+    daemon.set_report_interval(program_options.report_interval);
+    daemon.set_abort_flag(&signal_terminate);
+
+    int status = daemon.run();
+    if(signal_terminate) {
+        std::cout << "SIGNAL: " << signal_message << std::endl;
+    }
+
+    return status;
+}
+
+
+int run_farm() {
+    const RenderOptions& opts = program_options.render;
+    bool keep_dir = !program_options.farm_dir.empty();
+    std::string dir = keep_dir ? program_options.farm_dir : opts.output_path + ".farm";
+
+    RenderFarm farm(opts, dir);
+    farm.set_workers(program_options.farm_workers);
+    farm.set_segment_frames(size_t(program_options.segment_length * opts.video_fps_n / opts.video_fps_d + 0.5));
+    farm.set_keep_directory(keep_dir);
+    farm.set_abort_flag(&signal_terminate);
+
+    int status = farm.run();
+    if(signal_terminate) {
+        std::cout << "SIGNAL: " << signal_message << std::endl;
+    }
+
+    return status;
+}
+
+
+/// Reports a snapshot written by SnapshotRenderer.
+void print_snapshot(const std::string& path, double time, uint64_t tiles) {
+    std::cout << "SNAPSHOT: " << path << " at " << time << " s";
+    if(tiles) {
+        std::cout << " (" << tiles << " tiles)";
+    }
+    std::cout << std::endl;
+}
+
 
-    Clock clock;
-    TimePoint start_time;
+int run_snapshots() {
+    const RenderOptions& render = program_options.render;
+    const auto& times = program_options.snapshots;
+    SnapshotRenderer snapshots(render.input_paths.front(), render.video_width, render.video_height);
+    snapshots.set_tile_scale(program_options.tile_scale);
+    snapshots.set_style(render.style);
+
+    // Number output files in the order the times were given
+    bfs::path output(render.output_path);
+    for(size_t i = 0; i < times.size(); ++i) {
+        if(times.size() == 1) {
+            snapshots.add_snapshot(times[i], render.output_path);
+        }
+        else {
+            char suffix[16];
+            std::snprintf(suffix, sizeof(suffix), "-%02zu", i + 1);
+            bfs::path path = output.parent_path() / (output.stem().string() + suffix + output.extension().string());
+            snapshots.add_snapshot(times[i], path.string());
+        }
+    }
+
+    snapshots.set_written_callback(print_snapshot);
+    snapshots.set_abort_flag(&signal_terminate);
+    int status = snapshots.run();
+    if(signal_terminate) {
+        std::cout << "SIGNAL: " << signal_message << std::endl;
+    }
+    if(status) {
+        std::cerr << "ERROR: " << snapshots.get_error() << std::endl;
+    }
+
+    return status;
+}
+
+
+int run_export() {
+    const RenderOptions& render = program_options.render;
+    SnapshotRenderer snapshots(render.input_paths.front(), render.video_width, render.video_height);
+
+    // Export the final tree unless the end time is given
+    double time = std::numeric_limits<double>::infinity();
+    if(render.stop_timestamp > render.start_timestamp) {
+        time = render.stop_timestamp;
+    }
+    snapshots.add_snapshot(time, program_options.export_path);
+    snapshots.set_tile_scale(program_options.tile_scale);
+    snapshots.set_style(render.style);
+
+    snapshots.set_written_callback(print_snapshot);
+    snapshots.set_abort_flag(&signal_terminate);
+    int status = snapshots.run();
+    if(signal_terminate) {
+        std::cout << "SIGNAL: " << signal_message << std::endl;
+    }
+    if(status) {
+        std::cerr << "ERROR: " << snapshots.get_error() << std::endl;
+    }
+
+    return status;
+}
+
+
+int run_contact_sheet() {
+    const RenderOptions& render = program_options.render;
+    ContactSheetOptions opts;
+    opts.input_path = render.input_paths.front();
+    opts.output_path = render.output_path;
+    opts.count = program_options.sheet_count;
+    opts.columns = program_options.sheet_columns;
+    opts.width = render.video_width;
+    opts.height = render.video_height;
+    opts.start_timestamp = render.start_timestamp;
+    if(render.stop_timestamp > render.start_timestamp) {
+        opts.stop_timestamp = render.stop_timestamp;
+    }
+    opts.style = render.style;
+
+    ContactSheet sheet(opts);
+    sheet.set_abort_flag(&signal_terminate);
+    int status = sheet.run();
+    if(signal_terminate) {
+        std::cout << "SIGNAL: " << signal_message << std::endl;
+    }
+    if(status) {
+        std::cerr << "ERROR: " << sheet.get_error() << std::endl;
+    }
+    else {
+        std::cout << "SHEET: wrote " << opts.count << " thumbnails to " << opts.output_path << std::endl;
+    }
+
+    return status;
+}
+
+
+int run_animation() {
+    const RenderOptions& render = program_options.render;
+    AnimationOptions opts;
+    opts.input_path = render.input_paths.front();
+    opts.output_path = program_options.animation_path;
+    opts.width = render.video_width;
+    opts.height = render.video_height;
+    opts.duration = program_options.animation_duration;
+    opts.style = render.style;
+
+    std::string ext = bfs::extension(opts.output_path);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    opts.svg = (ext == ".svg");
+
+    TreeAnimation animation(opts);
+    animation.set_abort_flag(&signal_terminate);
+    int status = animation.run();
+    if(signal_terminate) {
+        std::cout << "SIGNAL: " << signal_message << std::endl;
+    }
+    if(status) {
+        std::cerr << "ERROR: " << animation.get_error() << std::endl;
+    }
+    else {
+        std::cout << "ANIMATION: wrote " << opts.output_path << std::endl;
+    }
+
+    return status;
+}
+
+
+int run_analysis() {
+    AnalysisOptions opts;
+    opts.input_path = program_options.render.input_paths.front();
+    opts.output_path = program_options.analysis_path;
+    opts.interval = program_options.sample_interval;
+    opts.style = program_options.render.style;
+
+    std::string ext = bfs::extension(opts.output_path);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    opts.columnar = (ext != ".csv");
+
+    TreeAnalysis analysis(opts);
+    analysis.set_abort_flag(&signal_terminate);
+    int status = analysis.run();
+    if(signal_terminate) {
+        std::cout << "SIGNAL: " << signal_message << std::endl;
+    }
+    if(status) {
+        std::cerr << "ERROR: " << analysis.get_error() << std::endl;
+    }
+    else {
+        std::cout << "ANALYSIS: wrote " << analysis.get_num_samples() << " samples to " << opts.output_path << std::endl;
+    }
+
+    return status;
+}
+
+
+int run_single() {
     size_t last_report_cycle = 0;
-    size_t current_report_cycle = 0;
     size_t reports_given = 0;
-    double current_runtime;
-    double stream_time;
+
+    // Keep resumable state next to the output file
+    RenderOptions opts = program_options.render;
+    if(program_options.resumable || program_options.resume) {
+        opts.resume_dir = opts.output_path + ".resume";
+        opts.segment_frames = std::max<size_t>(1, size_t(program_options.segment_length * opts.video_fps_n / opts.video_fps_d + 0.5));
+        opts.resume = program_options.resume;
+    }
+
+    // Open telemetry output
+    std::unique_ptr<Telemetry> telemetry;
+    if(!program_options.telemetry_target.empty()) {
+        try {
+            telemetry.reset(new Telemetry(program_options.telemetry_target));
+        } catch(const std::exception& err) {
+            std::cerr << "ERROR: " << err.what() << std::endl;
+            return 1;
+        }
+    }
+
+    // Keep standard output free for telemetry lines; the status table goes to standard error
+    std::streambuf* stdout_buffer = nullptr;
+    if(program_options.telemetry_target == "-") {
+        std::cout.flush();
+        stdout_buffer = std::cout.rdbuf(std::cerr.rdbuf());
+    }
+
+    RenderJob job(opts);
+    job.set_abort_flag(&signal_terminate);
+    job.set_progress_callback([&](const RenderProgress& progress) {
+        // Calculate report cycles
+        size_t current_report_cycle = size_t(progress.runtime / program_options.report_interval);
+
+        // Print current state
+        if(current_report_cycle != last_report_cycle) {
+            if(telemetry) {
+                telemetry->write(progress);
+            }
+
+            if(reports_given == 0 || (program_options.header_repeat && reports_given % program_options.header_repeat == 0)) {
+                print_status_header(std::cout);
+            }
+            print_status_line(
+                progress.runtime,
+                progress.clock_time,
+                progress.stream_time,
+                progress.frames,
+                std::cout
+            );
+            ++reports_given;
+            last_report_cycle = current_report_cycle;
+        }
+    });
+
+    int status = job.run();
+    if(telemetry) {
+        telemetry->write(job.get_result(), status ? "failed" : job.was_cancelled() ? "cancelled" : "done");
+    }
+    if(signal_terminate) {
+        std::cout << "SIGNAL: " << signal_message << std::endl;
+        if(!opts.resume_dir.empty()) {
+            std::cout << "SIGNAL: state saved in " << opts.resume_dir << ", rerun with --resume to continue" << std::endl;
+        }
+    }
+    if(status) {
+        std::cerr << "ERROR: " << job.get_error() << std::endl;
+    }
+    else if(!job.get_hash_summary().empty()) {
+        std::cout << "HASH: " << job.get_hash_summary() << std::endl;
+    }
+    if(stdout_buffer) {
+        std::cout.rdbuf(stdout_buffer);
+    }
+
+    return status;
+}
+
+
+int main(int argc, char** argv) {
+    int status;
+
+    // Block SIGUSR1 before any thread is created; it is handled by the profile reporter if profiling
+    sigset_t usr1_set;
+    sigemptyset(&usr1_set);
+    sigaddset(&usr1_set, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &usr1_set, NULL);
 
     // Initialize GStreamer
     gst_init(&argc, &argv);
@@ -429,89 +1270,79 @@ int main(int argc, char** argv) {
     std::signal(SIGTERM, signal_handler);
     std::signal(SIGINT, signal_handler);
 
-    VideoOutputPtr vid_out = std::make_shared<VideoOutput>();
-    VbcReaderPtr vbc_in = std::make_shared<VbcReader>(false, true);
+    // Enable hardware counters; rendering continues without them if unavailable
+    if(program_options.perf_counters) {
+        std::string error;
+        if(!PerfCounters::enable(error)) {
+            std::cerr << "Warning: hardware performance counters unavailable (" << error << ")" << std::endl;
+        }
+        program_options.profile = true;
+    }
 
-    // Configure VBC input
-    vbc_in->open(program_options.input_path.c_str());
-    vbc_in->wait();
-    if(vbc_in->get_state() == VbcReader::Error) {
-        vbc_in->advance();
-        gst_deinit();
-        return 1;
+    // Stage times are only measured if they are reported
+    std::thread reporter;
+    if(program_options.profile) {
+        Profiler::instance().enable();
+        reporter = std::thread(profile_reporter, &profile_output());
+    }
+    else if(!program_options.telemetry_target.empty()) {
+        Profiler::instance().enable();
     }
-    TreePtr tree = vbc_in->get_tree();
-
-    // Configure video output
-    vid_out->set_file_path(program_options.output_path.c_str());
-    vid_out->set_dim(program_options.video_width, program_options.video_height);
-    vid_out->set_frame_rate(
-        program_options.video_fps_n,
-        program_options.video_fps_d
-    );
-    vid_out->set_time_condensation(
-        program_options.video_condense_n,
-        program_options.video_condense_d
-    );
-    vid_out->set_time_adjustment(program_options.start_timestamp);
-    vid_out->set_clock(program_options.clock);
-    vid_out->set_bounds(program_options.bounds);
-    vid_out->set_text_align(program_options.text_align.first, program_options.text_align.second);
-    vid_out->start();
-
-    start_time = clock.now();
-    stream_time = vid_out->get_stream_time();
-    while(vbc_in->get_state() == VbcReader::Processing) {
-        // Check if termination has been requested
-        if(signal_terminate) {
-            std::cout << "SIGNAL: " << signal_message << std::endl;
-            break;
-        }
-
-        if(!vbc_in->has_next()) {
-            // Wait for the event queue to be populated
-            vbc_in->wait();
-        }
-        else if(vbc_in->get_next_timestamp() > stream_time + program_options.start_timestamp) {
-            // Render a video frame
-            vid_out->push_frame(tree);
-            stream_time = vid_out->get_stream_time();
-
-            // Find current runtime and calculate report cycles
-            current_runtime = std::chrono::duration_cast<Seconds>(clock.now() - start_time).count();
-            current_report_cycle = size_t(current_runtime / program_options.report_interval);
-
-            // Print current state
-            if(current_report_cycle != last_report_cycle) {
-                if(reports_given == 0 || (program_options.header_repeat && reports_given % program_options.header_repeat == 0)) {
-                    print_status_header(std::cout);
-                }
-                print_status_line(
-                    current_runtime,
-                    vid_out->get_clock_time(),
-                    stream_time,
-                    vid_out->get_num_frames(),
-                    std::cout
-                );
-                ++reports_given;
-                last_report_cycle = current_report_cycle;
-            }
-        }
-        else if(!vbc_in->advance()) {
-            std::cerr << "ERROR: Could not advance VBC state." << std::endl;
-            break;
-        }
 
-        // Check for early termination
-        if(program_options.stop_timestamp > program_options.start_timestamp && stream_time > program_options.stop_timestamp - program_options.start_timestamp) {
-            break;
-        }
+    // Start tracing before any pipeline thread is created
+    if(!program_options.trace_path.empty()) {
+        Tracer::instance().enable();
+        Tracer::instance().set_thread_name("main");
     }
 
-    vbc_in->close();
-    vid_out->stop();
+    if(!program_options.farm_worker_dir.empty()) {
+        status = RenderFarm::work(program_options.farm_worker_dir, &signal_terminate);
+    }
+    else if(!program_options.daemon_socket.empty()) {
+        status = run_daemon();
+    }
+    else if(!program_options.batch_path.empty()) {
+        status = run_batch();
+    }
+    else if(!program_options.analysis_path.empty()) {
+        status = run_analysis();
+    }
+    else if(!program_options.animation_path.empty()) {
+        status = run_animation();
+    }
+    else if(!program_options.snapshots.empty()) {
+        status = run_snapshots();
+    }
+    else if(!program_options.export_path.empty()) {
+        status = run_export();
+    }
+    else if(program_options.sheet_count) {
+        status = run_contact_sheet();
+    }
+    else if(program_options.farm_workers) {
+        status = run_farm();
+    }
+    else {
+        status = run_single();
+    }
+
+    // Stop profile reporter and print final profile
+    if(reporter.joinable()) {
+        profile_reporter_stop = true;
+        pthread_kill(reporter.native_handle(), SIGUSR1);
+        reporter.join();
+        Profiler::instance().print_report(profile_output());
+    }
+    if(!program_options.trace_path.empty()) {
+        try {
+            Tracer::instance().write(program_options.trace_path);
+        } catch(const std::exception& err) {
+            std::cerr << "ERROR: " << err.what() << std::endl;
+            status = 1;
+        }
+    }
 
     gst_deinit();
 
-    return 0;
+    return status;
 }
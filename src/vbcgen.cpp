@@ -0,0 +1,582 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/// vbcgen - Generates synthetic VBC files for benchmarking.
+///
+/// The generator simulates a branch-and-bound search: an open node is selected in
+/// depth-first, breadth-first or best-first order, optionally recolored, and either
+/// pruned or branched into child nodes. Information lines, bound updates and bursty
+/// timestamps are added at tunable rates. The output only depends on the options and
+/// the seed, and lines are formatted into a large buffer without iostream formatting
+/// so that files with hundreds of millions of nodes can be written quickly.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/device/file.hpp>
+#include <boost/iostreams/filter/bzip2.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/program_options.hpp>
+
+#include "Styles.hpp"
+
+namespace bfs = boost::filesystem;
+namespace bio = boost::iostreams;
+namespace po = boost::program_options;
+
+
+/// Order in which open nodes are selected for processing.
+enum class SearchOrder {
+    DepthFirst,
+    BreadthFirst,
+    BestFirst
+};
+
+/// Generator options
+struct GeneratorOptions {
+    std::string output_path;    ///< Path of VBC output ("-" for standard output).
+    std::string style_path;     ///< Path of VBCTOOL style resource the categories must exist in (empty for standard styles).
+    std::string palette_path;   ///< Path of color palette of the style resource (empty for default).
+    uint64_t    nodes;          ///< Number of nodes to generate.
+    size_t      branching;      ///< Number of children of a branched node.
+    SearchOrder order;          ///< Node selection order.
+    double      prune_rate;     ///< Probability that a processed node is pruned instead of branched.
+    size_t      categories;     ///< Number of node categories (1 to categories).
+    double      category_rate;  ///< Expected number of category changes per processed node.
+    size_t      info_size;      ///< Mean length of information strings in bytes (0 for none).
+    double      info_rate;      ///< Probability that a new node receives an information line.
+    double      bound_rate;     ///< Probability of a bound update per processed node.
+    double      duration;       ///< Expected solver time covered by the file in seconds.
+    double      burstiness;     ///< Probability that an event shares the time stamp of its predecessor.
+    uint64_t    seed;           ///< Seed of the random number generator.
+};
+
+
+/// SplitMix64 random number generator; fast and identical on every platform.
+class Random {
+private:
+    uint64_t state_;
+
+public:
+    explicit Random(uint64_t seed) : state_(seed) {}
+
+    uint64_t next() {
+        uint64_t z = (state_ += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    double uniform() { return (next() >> 11) * (1.0 / 9007199254740992.0); }   ///< Uniform in [0, 1).
+    bool bernoulli(double p) { return uniform() < p; }
+    uint64_t below(uint64_t n) { return next() % n; }                           ///< Uniform in [0, n).
+    double exponential(double mean) { return -mean * std::log1p(-uniform()); }
+};
+
+
+/// Buffered line writer that formats VBC fields without iostream overhead.
+class LineWriter {
+private:
+    std::ostream&       out_;
+    std::vector<char>   buf_;
+    size_t              len_;
+
+    void reserve(size_t n) {
+        if(len_ + n > buf_.size()) {
+            flush();
+            if(n > buf_.size()) {
+                buf_.resize(n);
+            }
+        }
+    }
+
+public:
+    explicit LineWriter(std::ostream& out) : out_(out), buf_(1 << 20), len_(0) {}
+    ~LineWriter() { flush(); }
+
+    void flush() {
+        out_.write(buf_.data(), len_);
+        len_ = 0;
+    }
+
+    LineWriter& put(char c) {
+        reserve(1);
+        buf_[len_++] = c;
+        return *this;
+    }
+
+    LineWriter& put(const char* s, size_t n) {
+        reserve(n);
+        std::memcpy(buf_.data() + len_, s, n);
+        len_ += n;
+        return *this;
+    }
+
+    LineWriter& put(const std::string& s) { return put(s.data(), s.size()); }
+
+    LineWriter& put(uint64_t value, size_t min_digits = 1) {
+        char digits[24];
+        size_t n = 0;
+        do {
+            digits[n++] = char('0' + value % 10);
+            value /= 10;
+        } while(value || n < min_digits);
+
+        reserve(n);
+        while(n) {
+            buf_[len_++] = digits[--n];
+        }
+        return *this;
+    }
+
+    /// Writes a time stamp given in hundredths of a second as HH:MM:SS.CC.
+    LineWriter& put_time(uint64_t centis) {
+        put(centis / 360000, 2).put(':');
+        put(centis / 6000 % 60, 2).put(':');
+        put(centis / 100 % 60, 2).put('.');
+        return put(centis % 100, 2);
+    }
+
+    /// Writes a bound with six decimal places.
+    LineWriter& put_bound(double value) {
+        if(value < 0) {
+            put('-');
+            value = -value;
+        }
+        uint64_t scaled = uint64_t(std::llround(value * 1e6));
+        put(scaled / 1000000).put('.');
+        return put(scaled % 1000000, 6);
+    }
+};
+
+
+/// Simulates the search and writes its events.
+class Generator {
+private:
+    typedef std::pair<double, uint64_t> Keyed;  ///< Best-first key and node number.
+
+    const GeneratorOptions& opts_;
+    LineWriter&             out_;
+    Random                  rng_;
+
+    double   time_;         ///< Current solver time in seconds.
+    double   mean_gap_;     ///< Mean time between events that do not share a time stamp.
+    uint64_t created_;      ///< Number of nodes created.
+    uint64_t events_;       ///< Number of event lines written.
+    double   lower_;        ///< Current lower bound.
+    double   upper_;        ///< Current upper bound.
+    std::string filler_;    ///< Source of information string contents.
+
+    // Open nodes; breadth-first order needs no storage since nodes are processed in creation order
+    std::vector<uint64_t> stack_;
+    std::priority_queue<Keyed, std::vector<Keyed>, std::greater<Keyed>> heap_;
+    uint64_t next_open_;
+
+    uint64_t open_count() const;
+    bool pop_open(uint64_t& node, double& key);
+    void push_open(uint64_t node, double key);
+
+    void begin_line();
+    void add_node(uint64_t node, uint64_t parent);
+    void set_category(uint64_t node);
+    void set_info(uint64_t node);
+    void set_bound();
+
+public:
+    Generator(const GeneratorOptions& opts, LineWriter& out);
+
+    void run();
+    uint64_t get_num_events() const { return events_; }
+};
+
+
+Generator::Generator(const GeneratorOptions& opts, LineWriter& out)
+    : opts_(opts),
+      out_(out),
+      rng_(opts.seed),
+      time_(0.0),
+      created_(0),
+      events_(0),
+      lower_(0.0),
+      upper_(0.0),
+      next_open_(1)
+{
+    // Spread the expected number of time steps evenly over the requested duration
+    const double steps = std::max<double>(1.0, opts.nodes * (1.0 + opts.category_rate + opts.info_rate * (opts.info_size > 0) + opts.bound_rate));
+    mean_gap_ = opts.duration / steps / std::max(1e-9, 1.0 - opts.burstiness);
+
+    // Information strings are cut from a fixed pseudo-random text
+    const char alphabet[] = "abcdefghijklmnopqrstuvwxyz0123456789 =.,";
+    filler_.resize(2 * opts.info_size + 64);
+    for(char& c : filler_) {
+        c = alphabet[rng_.below(sizeof(alphabet) - 1)];
+    }
+}
+
+
+uint64_t Generator::open_count() const {
+    switch(opts_.order) {
+    case SearchOrder::DepthFirst:
+        return stack_.size();
+    case SearchOrder::BreadthFirst:
+        return created_ + 1 - next_open_;
+    default:
+        return heap_.size();
+    }
+}
+
+
+bool Generator::pop_open(uint64_t& node, double& key) {
+    key = 0.0;
+    switch(opts_.order) {
+    case SearchOrder::DepthFirst:
+        if(stack_.empty()) {
+            return false;
+        }
+        node = stack_.back();
+        stack_.pop_back();
+        return true;
+    case SearchOrder::BreadthFirst:
+        if(next_open_ > created_) {
+            return false;
+        }
+        node = next_open_++;
+        return true;
+    default:
+        if(heap_.empty()) {
+            return false;
+        }
+        key = heap_.top().first;
+        node = heap_.top().second;
+        heap_.pop();
+        return true;
+    }
+}
+
+
+void Generator::push_open(uint64_t node, double key) {
+    switch(opts_.order) {
+    case SearchOrder::DepthFirst:
+        stack_.push_back(node);
+        break;
+    case SearchOrder::BreadthFirst:
+        break;
+    default:
+        heap_.push(Keyed(key, node));
+    }
+}
+
+
+void Generator::begin_line() {
+    // Bursts share the time stamp of the previous event
+    if(!rng_.bernoulli(opts_.burstiness)) {
+        time_ += rng_.exponential(mean_gap_);
+    }
+    out_.put_time(uint64_t(time_ * 100.0)).put(' ');
+    ++events_;
+}
+
+
+void Generator::add_node(uint64_t node, uint64_t parent) {
+    begin_line();
+    out_.put("N ", 2).put(parent).put(' ').put(node).put(' ').put(1 + rng_.below(opts_.categories)).put('\n');
+}
+
+
+void Generator::set_category(uint64_t node) {
+    begin_line();
+    out_.put("P ", 2).put(node).put(' ').put(1 + rng_.below(opts_.categories)).put('\n');
+}
+
+
+void Generator::set_info(uint64_t node) {
+    // Lengths vary uniformly between half and one and a half times the mean
+    const size_t length = opts_.info_size / 2 + rng_.below(opts_.info_size + 1);
+    const size_t start = rng_.below(filler_.size() - length + 1);
+
+    begin_line();
+    out_.put("I ", 2).put(node).put(' ').put(filler_.data() + start, length).put('\n');
+}
+
+
+void Generator::set_bound() {
+    // The gap closes geometrically; lower bounds rise and upper bounds fall
+    const double gap = upper_ - lower_;
+    begin_line();
+    if(rng_.bernoulli(0.5)) {
+        lower_ += gap * 0.1 * rng_.uniform();
+        out_.put("L ", 2).put_bound(lower_).put('\n');
+    }
+    else {
+        upper_ -= gap * 0.1 * rng_.uniform();
+        out_.put("U ", 2).put_bound(upper_).put('\n');
+    }
+}
+
+
+void Generator::run() {
+    // Bound updates raise the lower and lower the upper bound
+    out_.put("#TYPE: COMPLETE TREE\n#TIME: SET\n#BOUNDS: ").put(opts_.bound_rate > 0.0 ? "BOTH" : "NONE")
+        .put("\n#INFORMATION: STANDARD\n#NODE_NUMBER: NONE\n");
+
+    lower_ = 0.0;
+    upper_ = 1000.0;
+
+    // Create root node
+    if(opts_.nodes == 0) {
+        return;
+    }
+    created_ = 1;
+    add_node(1, 0);
+    push_open(1, 0.0);
+
+    uint64_t node;
+    double key;
+    while(created_ < opts_.nodes && pop_open(node, key)) {
+        // Recolor processed node
+        double changes = opts_.category_rate;
+        for(; changes >= 1.0; changes -= 1.0) {
+            set_category(node);
+        }
+        if(rng_.bernoulli(changes)) {
+            set_category(node);
+        }
+
+        if(rng_.bernoulli(opts_.bound_rate)) {
+            set_bound();
+        }
+
+        // Prune unless the search would run out of open nodes
+        if(open_count() > 0 && rng_.bernoulli(opts_.prune_rate)) {
+            continue;
+        }
+
+        // Branch; depth-first search continues with the first child
+        const uint64_t first = created_ + 1;
+        const uint64_t count = std::min<uint64_t>(opts_.branching, opts_.nodes - created_);
+        for(uint64_t child = first; child < first + count; ++child) {
+            add_node(child, node);
+            if(opts_.info_size && rng_.bernoulli(opts_.info_rate)) {
+                set_info(child);
+            }
+        }
+        created_ += count;
+        for(uint64_t i = count; i-- > 0;) {
+            push_open(first + i, key + rng_.exponential(1.0));
+        }
+    }
+}
+
+
+int parse_program_options(int argc, char** argv, GeneratorOptions& opts) {
+    std::string order;
+
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help,h", "produce help message")
+        (
+            "output,o",
+            po::value<std::string>(&opts.output_path)->default_value("-"),
+            "specify output file (.gz or .bz2 to compress, - for standard output)"
+        )(
+            "nodes,n",
+            po::value<uint64_t>(&opts.nodes)->default_value(100000),
+            "specify number of nodes"
+        )(
+            "branching,b",
+            po::value<size_t>(&opts.branching)->default_value(2),
+            "specify number of children of branched nodes"
+        )(
+            "order",
+            po::value<std::string>(&order)->default_value("dfs"),
+            "specify node selection order (dfs, bfs or best)"
+        )(
+            "prune-rate",
+            po::value<double>(&opts.prune_rate)->default_value(0.4, "0.4"),
+            "specify probability that a processed node is pruned"
+        )(
+            "categories",
+            po::value<size_t>(&opts.categories)->default_value(5),
+            "specify number of node categories"
+        )(
+            "styles",
+            po::value<std::string>(&opts.style_path),
+            "check --categories against a VBCTOOL resource file (.rsc) instead of the standard styles"
+        )(
+            "palette",
+            po::value<std::string>(&opts.palette_path),
+            "specify color palette for --styles (default: GRAPHrgb.txt next to it)"
+        )(
+            "category-rate",
+            po::value<double>(&opts.category_rate)->default_value(1.0, "1"),
+            "specify expected number of category changes per processed node"
+        )(
+            "info-size",
+            po::value<size_t>(&opts.info_size)->default_value(0),
+            "specify mean length of information strings (0 for none)"
+        )(
+            "info-rate",
+            po::value<double>(&opts.info_rate)->default_value(1.0, "1"),
+            "specify probability that a node receives an information string"
+        )(
+            "bound-rate",
+            po::value<double>(&opts.bound_rate)->default_value(0.01, "0.01"),
+            "specify probability of a bound update per processed node"
+        )(
+            "duration",
+            po::value<double>(&opts.duration)->default_value(3600.0, "3600"),
+            "specify expected solver time covered by the file in seconds"
+        )(
+            "burstiness",
+            po::value<double>(&opts.burstiness)->default_value(0.0, "0"),
+            "specify probability that an event shares the previous time stamp"
+        )(
+            "seed",
+            po::value<uint64_t>(&opts.seed)->default_value(1),
+            "specify random seed"
+        )
+    ;
+
+    po::variables_map vm;
+    try {
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        po::notify(vm);
+    } catch(const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    if(vm.count("help")) {
+        std::cout << "Usage: vbcgen [options]" << std::endl
+                  << desc << std::endl;
+        std::exit(0);
+    }
+
+    // Validate options
+    if(order == "dfs") {
+        opts.order = SearchOrder::DepthFirst;
+    }
+    else if(order == "bfs") {
+        opts.order = SearchOrder::BreadthFirst;
+    }
+    else if(order == "best") {
+        opts.order = SearchOrder::BestFirst;
+    }
+    else {
+        std::cerr << "Error: unknown node selection order '" << order << "'" << std::endl;
+        return 1;
+    }
+    if(opts.branching < 1 || opts.categories < 1) {
+        std::cerr << "Error: branching factor and number of categories must be positive" << std::endl;
+        return 1;
+    }
+    if(!opts.palette_path.empty() && opts.style_path.empty()) {
+        std::cerr << "Error: --palette requires --styles" << std::endl;
+        return 1;
+    }
+
+    // Categories 1 to n must have node styles; style 0 is never used by nodes
+    try {
+        StyleSheetPtr style = opts.style_path.empty() ? StyleSheet::standard() : StyleSheet::load(opts.style_path, opts.palette_path);
+        if(opts.categories >= style->node_styles.size()) {
+            std::cerr << "Error: number of categories must be at most " << style->node_styles.size() - 1
+                      << ", the number of node styles" << std::endl;
+            return 1;
+        }
+    } catch(const std::exception& err) {
+        std::cerr << "Error loading styles: " << err.what() << std::endl;
+        return 1;
+    }
+    if(opts.prune_rate < 0.0 || opts.prune_rate > 1.0 || opts.info_rate < 0.0 || opts.info_rate > 1.0
+       || opts.bound_rate < 0.0 || opts.bound_rate > 1.0 || opts.category_rate < 0.0) {
+        std::cerr << "Error: rates must be non-negative and probabilities at most 1" << std::endl;
+        return 1;
+    }
+    if(opts.burstiness < 0.0 || opts.burstiness >= 1.0) {
+        std::cerr << "Error: burstiness must be in [0, 1)" << std::endl;
+        return 1;
+    }
+    if(opts.duration < 0.0) {
+        std::cerr << "Error: duration must be non-negative" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+
+int main(int argc, char** argv) {
+    GeneratorOptions opts;
+    if(parse_program_options(argc, argv, opts)) {
+        return 1;
+    }
+
+    try {
+        // Build output pipeline based on file extension
+        bio::filtering_ostream out;
+        const std::string ext = bfs::extension(opts.output_path);
+        if(ext == ".gz" || ext == ".GZ") {
+            out.push(bio::gzip_compressor(bio::gzip_params(bio::gzip::best_speed)));
+        }
+        else if(ext == ".bz2" || ext == ".BZ2") {
+            out.push(bio::bzip2_compressor());
+        }
+        if(opts.output_path == "-") {
+            out.push(std::cout);
+        }
+        else {
+            bio::file_sink sink(opts.output_path, std::ios_base::out | std::ios_base::binary);
+            if(!sink.is_open()) {
+                std::cerr << "Error: could not open output file " << opts.output_path << std::endl;
+                return 1;
+            }
+            out.push(sink);
+        }
+
+        uint64_t events;
+        {
+            LineWriter writer(out);
+            Generator generator(opts, writer);
+            generator.run();
+            events = generator.get_num_events();
+        }
+        out.reset();
+
+        if(opts.output_path != "-") {
+            std::cout << "Wrote " << events << " events to " << opts.output_path << std::endl;
+        }
+    } catch(const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,85 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VBC_TESTS_CHECK_HPP
+#define __VBC_TESTS_CHECK_HPP
+
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include <boost/filesystem.hpp>
+
+/// Minimal check macros for the unit tests. A failed check reports its location and keeps
+/// the test running, so that a single run lists all failures; test_result() turns the
+/// number of failures into the exit code of the test.
+
+static int test_failures = 0;   ///< Number of failed checks.
+
+#define CHECK(expr) \
+    do { \
+        if(!(expr)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #expr << std::endl; \
+            ++test_failures; \
+        } \
+    } while(0)
+
+#define CHECK_EQUAL(actual, expected) \
+    do { \
+        if(!((actual) == (expected))) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #actual " == " #expected \
+                      << " (" << (actual) << " != " << (expected) << ")" << std::endl; \
+            ++test_failures; \
+        } \
+    } while(0)
+
+/// Returns the exit code of the test.
+inline int test_result() {
+    if(test_failures) {
+        std::cerr << test_failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+/// Temporary directory that is removed with its contents when the test ends.
+class TempDir {
+    boost::filesystem::path path_;
+
+public:
+    TempDir() : path_(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("vbcrender-test-%%%%-%%%%")) {
+        boost::filesystem::create_directories(path_);
+    }
+    TempDir(const TempDir&) = delete;
+    ~TempDir() {
+        boost::system::error_code ec;
+        boost::filesystem::remove_all(path_, ec);
+    }
+
+    std::string path() const { return path_.string(); }
+    std::string file(const std::string& name) const { return (path_ / name).string(); }
+
+    /// Writes a file into the directory and returns its path.
+    std::string write(const std::string& name, const std::string& contents) const {
+        std::ofstream out(file(name).c_str(), std::ios::binary | std::ios::trunc);
+        out << contents;
+        return file(name);
+    }
+};
+
+#endif /* end of include guard: __VBC_TESTS_CHECK_HPP */
@@ -0,0 +1,129 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/// Checkpoint round trip: a tree saved at any event and reloaded must continue from the
+/// checkpoint offset to the same final state as a full replay of the input.
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Check.hpp"
+#include "Checkpoint.hpp"
+#include "Tree.hpp"
+#include "VbcReader.hpp"
+
+
+static const char* const vbc_input =
+    "#TYPE: COMPLETE TREE\n"
+    "#TIME: SET\n"
+    "#BOUNDS: NONE\n"
+    "#INFORMATION: STANDARD\n"
+    "#NODE_NUMBER: NONE\n"
+    "00:00:00.01 N 0 1 1\n"
+    "00:00:00.02 N 1 2 2\n"
+    "00:00:00.03 N 1 3 2\n"
+    "00:00:00.04 I 2 \\ihello\\iworld\n"
+    "00:00:01.00 P 2 3\n"
+    "\n"
+    "00:00:01.50 U 12.5\n"
+    "00:00:02.00 L 3.25\n"
+    "00:00:02.50 N 3 4 4\n"
+    "00:00:03.00 N 3 5 2\n"
+    "00:00:03.50 A 4 more\\tinfo\n"
+    "00:00:04.00 P 5 5\n"
+    "00:00:04.50 N 5 6 1\n"
+    "00:00:05.00 U 10\n"
+    "00:00:05.50 L 4.5\n";
+
+
+/// Applies events until the end of the input or the given number of events and returns
+/// the number of applied events.
+static size_t replay(VbcReader& reader, size_t max_events = size_t(-1)) {
+    size_t applied = 0;
+    for(; applied < max_events; ++applied) {
+        reader.wait();
+        if(reader.get_state() != VbcReader::Processing) {
+            break;
+        }
+        reader.advance();
+    }
+    return applied;
+}
+
+
+/// Describes the bounds of a tree and all of its nodes in pre-order.
+static std::string describe(TreePtr tree) {
+    std::ostringstream out;
+    out << "lb=" << tree->lower_bound() << " ub=" << tree->upper_bound() << "\n";
+
+    Tree::PreOrderIterator it(*tree);
+    const Tree::PreOrderIterator end(tree->children().end(), tree->children().end());
+    for(; it != end; ++it) {
+        NodePtr parent = (*it)->parent();
+        out << (*it)->seq() << " parent=" << (parent ? parent->seq() : 0)
+            << " category=" << (*it)->category()
+            << " main=" << (*it)->main_info() << " general=" << (*it)->general_info() << "\n";
+    }
+    return out.str();
+}
+
+
+int main() {
+    TempDir dir;
+    const std::string input = dir.write("input.vbc", vbc_input);
+    const std::string ckpt_path = dir.file("input.ckpt");
+
+    // Replay the full input as reference
+    VbcReader full(false, false);
+    CHECK(full.open(input));
+    const size_t num_events = replay(full);
+    CHECK_EQUAL(full.get_state(), VbcReader::EndOfStream);
+    CHECK_EQUAL(num_events, size_t(14));
+    CHECK_EQUAL(full.get_tree()->upper_bound(), 10.0);
+    CHECK(full.get_tree()->node(6)->parent() == full.get_tree()->node(5));
+    const std::string expected = describe(full.get_tree());
+    full.close();
+
+    // Checkpoint after every event, reload the tree and resume reading at the checkpoint
+    for(size_t split = 1; split < num_events; ++split) {
+        VbcReader first(false, false);
+        CHECK(first.open(input));
+        replay(first, split);
+        const Checkpoint saved { first.get_offset(), first.get_timestamp(), split * 10 };
+        save_checkpoint(ckpt_path, saved, first.get_tree());
+        const std::string partial = describe(first.get_tree());
+        first.close();
+
+        Checkpoint loaded;
+        TreePtr tree = load_checkpoint(ckpt_path, loaded);
+        CHECK_EQUAL(loaded.offset, saved.offset);
+        CHECK_EQUAL(loaded.timestamp, saved.timestamp);
+        CHECK_EQUAL(loaded.frame, saved.frame);
+        CHECK_EQUAL(describe(tree), partial);
+
+        VbcReader resumed(false, false);
+        CHECK(resumed.open(input, tree, loaded.offset, loaded.timestamp));
+        CHECK_EQUAL(replay(resumed), num_events - split);
+        CHECK_EQUAL(resumed.get_state(), VbcReader::EndOfStream);
+        CHECK_EQUAL(describe(resumed.get_tree()), expected);
+        resumed.close();
+    }
+
+    return test_result();
+}
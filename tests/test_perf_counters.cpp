@@ -0,0 +1,95 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/// Hardware counter decoding: group reads are scaled for multiplexing and rejected when
+/// they are short, belong to a group of a different size or the group never ran.
+
+#include <cstdint>
+
+#include "Check.hpp"
+#include "PerfCounters.hpp"
+
+
+int main() {
+    const size_t cycles = size_t(PerfEvent::Cycles);
+    const size_t instructions = size_t(PerfEvent::Instructions);
+    const size_t cache_misses = size_t(PerfEvent::CacheMisses);
+    const size_t branch_misses = size_t(PerfEvent::BranchMisses);
+    const int all_slots[] = { 0, 1, 2, 3 };
+
+    // Counts of a group that ran all the time are returned unchanged
+    {
+        const uint64_t data[] = { 4, 1000, 1000, 5000, 4000, 30, 7 };
+        PerfCounts counts = PerfCounters::decode(data, 7, all_slots);
+        CHECK(counts.valid);
+        CHECK_EQUAL(counts.values[cycles], uint64_t(5000));
+        CHECK_EQUAL(counts.values[instructions], uint64_t(4000));
+        CHECK_EQUAL(counts.values[cache_misses], uint64_t(30));
+        CHECK_EQUAL(counts.values[branch_misses], uint64_t(7));
+    }
+
+    // Counts of a group that was multiplexed out half of the time are doubled
+    {
+        const uint64_t data[] = { 4, 2000, 1000, 5000, 4000, 30, 7 };
+        PerfCounts counts = PerfCounters::decode(data, 7, all_slots);
+        CHECK(counts.valid);
+        CHECK_EQUAL(counts.values[cycles], uint64_t(10000));
+        CHECK_EQUAL(counts.values[instructions], uint64_t(8000));
+        CHECK_EQUAL(counts.values[cache_misses], uint64_t(60));
+        CHECK_EQUAL(counts.values[branch_misses], uint64_t(14));
+    }
+
+    // Scaled counts are rounded to the nearest integer
+    {
+        const uint64_t data[] = { 4, 3, 2, 1, 3, 5, 0 };
+        PerfCounts counts = PerfCounters::decode(data, 7, all_slots);
+        CHECK(counts.valid);
+        CHECK_EQUAL(counts.values[cycles], uint64_t(2));
+        CHECK_EQUAL(counts.values[instructions], uint64_t(5));
+        CHECK_EQUAL(counts.values[cache_misses], uint64_t(8));
+        CHECK_EQUAL(counts.values[branch_misses], uint64_t(0));
+    }
+
+    // Events that could not be opened are skipped in the group and reported as zero
+    {
+        const int slots[] = { 0, 1, -1, 2 };
+        const uint64_t data[] = { 3, 400, 100, 10, 20, 3 };
+        PerfCounts counts = PerfCounters::decode(data, 6, slots);
+        CHECK(counts.valid);
+        CHECK_EQUAL(counts.values[cycles], uint64_t(40));
+        CHECK_EQUAL(counts.values[instructions], uint64_t(80));
+        CHECK_EQUAL(counts.values[cache_misses], uint64_t(0));
+        CHECK_EQUAL(counts.values[branch_misses], uint64_t(12));
+    }
+
+    // Invalid reads yield no counts
+    {
+        const uint64_t never_ran[] = { 4, 1000, 0, 0, 0, 0, 0 };
+        const uint64_t wrong_size[] = { 3, 1000, 1000, 5000, 4000, 30 };
+        const uint64_t short_read[] = { 4, 1000, 1000, 5000, 4000 };
+        CHECK(!PerfCounters::decode(never_ran, 7, all_slots).valid);
+        CHECK(!PerfCounters::decode(wrong_size, 6, all_slots).valid);
+        CHECK(!PerfCounters::decode(short_read, 5, all_slots).valid);
+        CHECK(!PerfCounters::decode(short_read, 2, all_slots).valid);
+
+        PerfCounts counts = PerfCounters::decode(short_read, 5, all_slots);
+        CHECK_EQUAL(counts.values[cycles], uint64_t(0));
+    }
+
+    return test_result();
+}
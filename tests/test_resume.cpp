@@ -0,0 +1,137 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/// Resumable rendering: the resume signature covers every option that changes the output,
+/// state of a different job is rejected, and files the job did not create are never touched.
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <boost/filesystem.hpp>
+
+#include "Check.hpp"
+#include "RenderJob.hpp"
+#include "Styles.hpp"
+
+namespace bfs = boost::filesystem;
+
+
+/// Returns the contents of a file.
+static std::string read_file(const std::string& path) {
+    std::ifstream in(path.c_str());
+    std::ostringstream out;
+    out << in.rdbuf();
+    return out.str();
+}
+
+
+/// Runs a job and returns its status and error message.
+static int run_job(const RenderOptions& options, std::string& error) {
+    RenderJob job(options);
+    int status = job.run();
+    error = job.get_error();
+    return status;
+}
+
+
+int main() {
+    TempDir dir;
+
+    RenderOptions base;
+    base.input_paths.push_back(dir.write("input.vbc", "#TYPE: COMPLETE TREE\n00:00:01.00 N 0 1 1\n"));
+    base.output_path = dir.file("output.mp4");
+    base.resume_dir = dir.file("state");
+    const std::string signature = RenderJob::resume_signature(base);
+
+    // Every option that changes the rendered video changes the signature
+    {
+        RenderOptions opts = base;
+        CHECK(RenderJob::resume_signature(opts) == signature);
+        opts.draft = !base.draft;
+        CHECK(RenderJob::resume_signature(opts) != signature);
+    }
+    {
+        RenderOptions opts = base;
+        opts.clock = !base.clock;
+        CHECK(RenderJob::resume_signature(opts) != signature);
+    }
+    {
+        RenderOptions opts = base;
+        opts.segment_frames = base.segment_frames + 1;
+        CHECK(RenderJob::resume_signature(opts) != signature);
+    }
+    {
+        RenderOptions opts = base;
+        opts.frame_limit = base.frame_limit + 1;
+        CHECK(RenderJob::resume_signature(opts) != signature);
+    }
+    {
+        RenderOptions opts = base;
+        opts.input_paths.front() = dir.file("other.vbc");
+        CHECK(RenderJob::resume_signature(opts) != signature);
+    }
+    {
+        // Styles are compared by content, so equal styles from another sheet still match
+        std::shared_ptr<StyleSheet> style = std::make_shared<StyleSheet>(*StyleSheet::standard());
+        RenderOptions opts = base;
+        opts.style = style;
+        CHECK(RenderJob::resume_signature(opts) == signature);
+        style->node_styles[1].draw_filled = !style->node_styles[1].draw_filled;
+        CHECK(RenderJob::resume_signature(opts) != signature);
+    }
+    {
+        // Hidden categories change the layout
+        RenderOptions opts = base;
+        opts.style = StyleSheet::standard()->hide_categories({ 1 });
+        CHECK(RenderJob::resume_signature(opts) != signature);
+    }
+
+    // State of a different job is rejected and left alone
+    bfs::create_directories(base.resume_dir);
+    RenderOptions other = base;
+    other.draft = !base.draft;
+    const std::string progress = dir.file("state/render.progress");
+    const std::string other_state = RenderJob::resume_signature(other) + "segments 2\n";
+    {
+        std::ofstream out(progress.c_str());
+        out << other_state;
+    }
+    RenderOptions resume = base;
+    resume.resume = true;
+    std::string error;
+    CHECK_EQUAL(run_job(resume, error), 1);
+    CHECK(error.find("belongs to a different job") != std::string::npos);
+    CHECK_EQUAL(read_file(progress), other_state);
+
+    // A new job never starts in a directory that holds other files
+    CHECK_EQUAL(run_job(base, error), 1);
+    CHECK(error.find("is not empty") != std::string::npos);
+    CHECK_EQUAL(read_file(progress), other_state);
+
+    bfs::remove(progress);
+    const std::string stray = dir.write("state/notes.txt", "keep me\n");
+    CHECK_EQUAL(run_job(resume, error), 1);
+    CHECK(error.find("holds no resumable state") != std::string::npos);
+    CHECK_EQUAL(run_job(base, error), 1);
+    CHECK(error.find("is not empty") != std::string::npos);
+    CHECK_EQUAL(read_file(stray), "keep me\n");
+    CHECK(!bfs::exists(base.output_path));
+
+    return test_result();
+}
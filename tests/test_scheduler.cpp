@@ -0,0 +1,160 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/// Shared scheduler: tasks of nested groups all run, errors reach the waiting thread, and
+/// pool workers together with busy threads outside the pool never exceed the thread budget.
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Check.hpp"
+#include "Scheduler.hpp"
+
+
+static const size_t budget = 4;     ///< Thread budget of the test.
+
+
+/// Tracks the number of tasks running at the same time.
+struct Concurrency {
+    std::atomic<size_t> running;    ///< Number of running tasks.
+    std::atomic<size_t> peak;       ///< Maximum number of tasks running at once.
+
+    Concurrency() : running(0), peak(0) {}
+
+    void task() {
+        size_t now = ++running;
+        size_t seen = peak;
+        while(now > seen && !peak.compare_exchange_weak(seen, now)) {}
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        --running;
+    }
+};
+
+
+/// Submits tasks while the given number of threads is busy outside the pool and returns the
+/// peaks of concurrent tasks before and while the calling thread waits for them.
+static void measure(size_t busy_threads, size_t& peak_workers, size_t& peak_total) {
+    BusyScope busy(busy_threads);
+    Concurrency concurrency;
+    TaskGroup group;
+    for(size_t i = 0; i < 200; ++i) {
+        group.run([&concurrency] { concurrency.task(); });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    peak_workers = concurrency.peak;
+    group.wait();
+    peak_total = concurrency.peak;
+}
+
+
+int main() {
+    Scheduler& scheduler = Scheduler::instance();
+    scheduler.configure(budget, false);
+    CHECK_EQUAL(scheduler.get_threads(), budget);
+
+    // All tasks of a group run before wait() returns
+    {
+        std::atomic<long> sum(0);
+        TaskGroup group;
+        for(long i = 1; i <= 10000; ++i) {
+            group.run([&sum, i] { sum += i; });
+        }
+        group.wait();
+        CHECK_EQUAL(sum.load(), 10000L * 10001 / 2);
+    }
+
+    // Nested groups wait inside tasks without deadlocking
+    {
+        std::atomic<int> leaves(0);
+        TaskGroup outer;
+        for(int i = 0; i < 20; ++i) {
+            outer.run([&leaves] {
+                TaskGroup inner;
+                for(int j = 0; j < 20; ++j) {
+                    inner.run([&leaves] { ++leaves; });
+                }
+                inner.wait();
+            });
+        }
+        outer.wait();
+        CHECK_EQUAL(leaves.load(), 400);
+    }
+
+    // The first error of a task is rethrown by wait()
+    {
+        std::string error;
+        try {
+            TaskGroup group;
+            group.run([] { throw std::runtime_error("task failed"); });
+            group.run([] {});
+            group.wait();
+        } catch(const std::runtime_error& err) {
+            error = err.what();
+        }
+        CHECK_EQUAL(error, "task failed");
+    }
+
+    // The budget cannot change once workers run
+    {
+        bool rejected = false;
+        try {
+            scheduler.configure(budget + 1, false);
+        } catch(const std::logic_error&) {
+            rejected = true;
+        }
+        CHECK(rejected);
+        CHECK_EQUAL(scheduler.get_threads(), budget);
+    }
+
+    // Workers give up one slot per busy thread; the waiting thread runs tasks on top of that
+    for(size_t busy = 0; busy <= budget + 1; ++busy) {
+        size_t peak_workers, peak_total;
+        measure(busy, peak_workers, peak_total);
+        const size_t limit = busy < budget ? budget - busy : 0;
+        CHECK(peak_workers <= limit);
+        CHECK(peak_total <= limit + 1);
+        CHECK(peak_total >= 1);
+    }
+
+    // Busy dedicated threads count against the budget until they exit
+    {
+        std::atomic_bool release(false);
+        std::vector<std::thread> loops;
+        for(size_t i = 0; i < budget - 1; ++i) {
+            loops.push_back(scheduler.spawn("busy loop", [&release] {
+                while(!release) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+            }));
+        }
+        size_t peak_workers, peak_total;
+        measure(0, peak_workers, peak_total);
+        CHECK(peak_workers <= 1);
+        CHECK(peak_total <= 2);
+        release = true;
+        for(std::thread& loop : loops) {
+            loop.join();
+        }
+    }
+
+    return test_result();
+}
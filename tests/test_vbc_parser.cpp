@@ -0,0 +1,146 @@
+/*
+ * vbcrender - Command line tool to render videos from VBC files.
+ * Copyright (C) 2019 Mirko Hahn
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/// VBC line parsing: headers, blank lines, whitespace, time stamps and all operations of
+/// valid input, and the error state for malformed lines.
+
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "Check.hpp"
+#include "Tree.hpp"
+#include "VbcReader.hpp"
+
+
+static const char* const vbc_header =
+    "#TYPE: COMPLETE TREE\n"
+    "#TIME: SET\n"
+    "#BOUNDS: NONE\n"
+    "#INFORMATION: STANDARD\n"
+    "#NODE_NUMBER: NONE\n";
+
+
+/// Applies all events of a file and returns the number of applied events.
+static size_t replay(VbcReader& reader) {
+    size_t applied = 0;
+    while(true) {
+        reader.wait();
+        if(reader.get_state() != VbcReader::Processing) {
+            return applied;
+        }
+        reader.advance();
+        ++applied;
+    }
+}
+
+
+/// Applies the error the reader stopped at and returns the message it reports.
+static std::string error_message(VbcReader& reader) {
+    std::ostringstream message;
+    std::streambuf* cerr_buffer = std::cerr.rdbuf(message.rdbuf());
+    reader.advance();
+    std::cerr.rdbuf(cerr_buffer);
+    return message.str();
+}
+
+
+/// Reads a single malformed input and checks that the reader stops with the given error.
+static void check_malformed(const TempDir& dir, const std::string& body, const std::string& message) {
+    VbcReader reader(false, false);
+    CHECK(reader.open(dir.write("malformed.vbc", body)));
+    replay(reader);
+    CHECK_EQUAL(reader.get_state(), VbcReader::Error);
+    CHECK_EQUAL(error_message(reader), "IO ERROR: " + message + "\n");
+    reader.close();
+}
+
+
+int main() {
+    TempDir dir;
+
+    // Valid input with irregular whitespace, blank lines and all time stamp formats
+    const std::string body = std::string(vbc_header) +
+        "00:00:00.50 N 0 1 1\n"
+        "\n"
+        "   \t\n"
+        "  00:00:01.00   N  1 2 2\n"
+        "01:02:03.50 D 1 3 2 7\n"
+        "1:02:04 I 2 \\imain\\igeneral\\ttab\n"
+        "1:02:05 A 2 \\imore\\i more\n"
+        "1:02:06 P 3 4\n"
+        "1:02:07 U 12.5\n"
+        "1:02:08 L -3.25\n"
+        "3730 N 3 4 3";
+    const std::string input = dir.write("valid.vbc", body);
+
+    VbcReader reader(false, false);
+    CHECK(reader.open(input));
+    CHECK_EQUAL(replay(reader), size_t(9));
+    CHECK_EQUAL(reader.get_state(), VbcReader::EndOfStream);
+    CHECK_EQUAL(reader.get_offset(), uint64_t(body.size()));
+    CHECK_EQUAL(reader.get_timestamp(), 3730.0);
+
+    TreePtr tree = reader.get_tree();
+    CHECK(!tree->node(1)->parent());
+    CHECK_EQUAL(tree->node(2)->parent()->seq(), size_t(1));
+    CHECK_EQUAL(tree->node(3)->parent()->seq(), size_t(1));
+    CHECK_EQUAL(tree->upper_bound(), 12.5);
+    CHECK_EQUAL(tree->lower_bound(), -3.25);
+    CHECK_EQUAL(tree->node(3)->category(), size_t(4));
+    CHECK_EQUAL(tree->node(4)->parent()->seq(), size_t(3));
+    CHECK_EQUAL(tree->node(2)->main_info(), "mainmore");
+    CHECK_EQUAL(tree->node(2)->general_info(), "general\ttab more");
+    reader.close();
+
+    // Time stamps in hours, minutes and seconds
+    VbcReader timed(false, false);
+    CHECK(timed.open(dir.write("timed.vbc", std::string(vbc_header) + "1:02:03.5 N 0 1 1\n")));
+    timed.wait();
+    CHECK(timed.advance());
+    CHECK_EQUAL(timed.get_timestamp(), 3723.5);
+    timed.close();
+
+    // Information is dropped when stripping
+    VbcReader stripped(false, true);
+    CHECK(stripped.open(input));
+    CHECK_EQUAL(replay(stripped), size_t(7));
+    CHECK_EQUAL(stripped.get_state(), VbcReader::EndOfStream);
+    CHECK_EQUAL(stripped.get_tree()->node(2)->main_info(), "");
+    stripped.close();
+
+    // Malformed headers and operations stop the reader with an error
+    check_malformed(dir, "#TYPE: PARTIAL TREE\n", "VbcReader encountered invalid TYPE line");
+    check_malformed(dir, "#TIME: NONE\n", "VbcReader only reads SET VBC files");
+    check_malformed(dir, std::string(vbc_header) + "00:00:01.00\n", "incomplete operation encountered");
+    check_malformed(dir, std::string(vbc_header) + "00:00:01.00 X 1\n", "unknown opcode");
+    check_malformed(dir, std::string(vbc_header) + "00:00:01.00 N 0 1\n", "error reading node creation parameters (opcode D or N)");
+    check_malformed(dir, std::string(vbc_header) + "00:00:01.00 P one 2\n", "error reading color change parameters (opcode P)");
+    check_malformed(dir, std::string(vbc_header) + "00:00:01.00 U high\n", "error reading bound change event (opcode L or U)");
+    check_malformed(dir, std::string(vbc_header) + "00:00:01.00 I\n", "error reading information modification parameters (opcode A or I)");
+
+    // Events before a malformed line are still applied
+    VbcReader partial(false, false);
+    CHECK(partial.open(dir.write("partial.vbc", std::string(vbc_header) + "00:00:01.00 N 0 1 1\n00:00:02.00 N 1\n")));
+    CHECK_EQUAL(replay(partial), size_t(1));
+    CHECK_EQUAL(partial.get_state(), VbcReader::Error);
+    CHECK(partial.get_tree()->node(1) != nullptr);
+    partial.close();
+
+    return test_result();
+}
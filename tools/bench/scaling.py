@@ -0,0 +1,232 @@
+#!/usr/bin/env python3
+
+#
+# vbcrender - Command line tool to render videos from VBC files.
+# Copyright (C) 2019 Mirko Hahn
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#
+
+# End-to-end scaling benchmark.
+#
+# Generates synthetic trees with vbcgen, renders each of them with vbcrender and records
+# wall time, frames and events per second, peak resident memory and the time spent per
+# pipeline stage (from the final telemetry line). Frames are discarded by a null sink
+# unless --encode is given, so that encoder plugins do not add noise. Results can be
+# stored as a baseline and later runs compared against it; the script exits with status
+# 1 if any metric regressed by more than the tolerance.
+
+import argparse
+import json
+import os
+import os.path
+import platform
+import subprocess
+import sys
+import tempfile
+import time
+
+# Metrics compared against baselines; True if larger values are better
+METRICS = {
+    'wall_seconds': False,
+    'frames_per_sec': True,
+    'events_per_sec': True,
+    'peak_rss_bytes': False,
+}
+
+
+def parse_size(value):
+    return int(float(value))
+
+
+def size_label(size):
+    exponent = len(str(size)) - 1
+    return '1e%d' % exponent if size == 10 ** exponent else str(size)
+
+
+def generate_input(args, size):
+    path = os.path.join(args.work_dir, 'scaling-%s-%s-%d.vbc' % (size_label(size), args.order, args.seed))
+    if not os.path.exists(path):
+        print('SCALING: generating %s' % path, file=sys.stderr)
+        subprocess.check_call([
+            args.vbcgen,
+            '--nodes', str(size),
+            '--order', args.order,
+            '--seed', str(args.seed),
+            '--duration', str(args.duration),
+            '-o', path,
+        ], stdout=subprocess.DEVNULL)
+    return path
+
+
+def render_once(args, input_path):
+    telemetry_path = os.path.join(args.work_dir, 'telemetry.jsonl')
+    output_path = os.path.join(args.work_dir, 'scaling.mkv')
+    if os.path.exists(telemetry_path):
+        os.remove(telemetry_path)
+
+    command = [
+        args.vbcrender,
+        '--telemetry', telemetry_path,
+        '--report-interval', '1e9',
+        '--width', str(args.width),
+        '--height', str(args.height),
+        '-o', output_path,
+    ]
+    if not args.encode:
+        command.append('--null-sink')
+    command.extend(args.extra)
+    command.append(input_path)
+
+    # Peak RSS of the child is taken from its resource usage
+    start = time.monotonic()
+    process = subprocess.Popen(command, stdout=subprocess.DEVNULL)
+    _, status, usage = os.wait4(process.pid, 0)
+    wall = time.monotonic() - start
+    process.returncode = os.WEXITSTATUS(status) if os.WIFEXITED(status) else -os.WTERMSIG(status)
+    if process.returncode != 0:
+        raise RuntimeError('vbcrender failed with status %d: %s' % (process.returncode, ' '.join(command)))
+
+    final = None
+    with open(telemetry_path, 'r') as f:
+        for line in f:
+            record = json.loads(line)
+            if record.get('type') == 'done':
+                final = record
+    if final is None:
+        raise RuntimeError('vbcrender did not report completion')
+
+    return {
+        'wall_seconds': wall,
+        'frames': final['frames'],
+        'events': final['events_applied'],
+        'frames_per_sec': final['frames'] / wall if wall > 0 else 0.0,
+        'events_per_sec': final['events_applied'] / wall if wall > 0 else 0.0,
+        'peak_rss_bytes': usage.ru_maxrss * 1024,
+        'stages': {name: stage['seconds'] for name, stage in final['stages'].items()},
+    }
+
+
+def render(args, input_path):
+    # Report the run with the median wall time
+    runs = [render_once(args, input_path) for _ in range(args.repeat)]
+    runs.sort(key=lambda run: run['wall_seconds'])
+    result = runs[len(runs) // 2]
+    result['repeat'] = args.repeat
+    result['wall_seconds_spread'] = runs[-1]['wall_seconds'] - runs[0]['wall_seconds']
+    return result
+
+
+def compare(results, baseline, args):
+    regressions = []
+    for label, result in results.items():
+        reference = baseline.get('results', {}).get(label)
+        if reference is None:
+            print('SCALING: %s has no baseline' % label, file=sys.stderr)
+            continue
+
+        for metric, higher_is_better in METRICS.items():
+            if metric not in reference or not reference[metric]:
+                continue
+            tolerance = args.rss_tolerance if metric == 'peak_rss_bytes' else args.tolerance
+            change = result[metric] / reference[metric] - 1.0
+            worse = -change if higher_is_better else change
+            verdict = 'REGRESSION' if worse > tolerance else 'ok'
+            print('%-6s %-16s %14.4g -> %14.4g (%+6.1f%%) %s' % (
+                label, metric, reference[metric], result[metric], 100.0 * change, verdict))
+            if worse > tolerance:
+                regressions.append((label, metric))
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Run end-to-end scaling benchmarks of vbcrender.')
+    parser.add_argument('--vbcrender', default='./vbcrender', help='path of vbcrender executable')
+    parser.add_argument('--vbcgen', default='./vbcgen', help='path of vbcgen executable')
+    parser.add_argument('--sizes', default='1e4,1e5,1e6,1e7,1e8', help='comma-separated node counts')
+    parser.add_argument('--order', default='dfs', choices=['dfs', 'bfs', 'best'], help='node selection order of generated trees')
+    parser.add_argument('--seed', type=int, default=1, help='seed of generated trees')
+    parser.add_argument('--duration', type=float, default=60.0, help='solver time of generated trees in seconds')
+    parser.add_argument('--width', type=int, default=1280, help='video width')
+    parser.add_argument('--height', type=int, default=720, help='video height')
+    parser.add_argument('--encode', action='store_true', help='encode frames instead of discarding them')
+    parser.add_argument('--repeat', type=int, default=1, help='number of runs per size (median is reported)')
+    parser.add_argument('--work-dir', help='directory for generated trees (kept between runs)')
+    parser.add_argument('--output', help='write results as JSON to this file')
+    parser.add_argument('--baseline', help='compare results against this JSON file')
+    parser.add_argument('--save-baseline', help='store results as a new baseline in this file')
+    parser.add_argument('--tolerance', type=float, default=0.10, help='relative tolerance of time and throughput metrics')
+    parser.add_argument('--rss-tolerance', type=float, default=0.10, help='relative tolerance of peak memory')
+    parser.add_argument('extra', nargs='*', help='additional vbcrender arguments (after --)')
+    args = parser.parse_args()
+
+    if args.repeat < 1:
+        parser.error('--repeat must be positive')
+    if args.work_dir is None:
+        args.work_dir = os.path.join(tempfile.gettempdir(), 'vbcrender-scaling')
+    os.makedirs(args.work_dir, exist_ok=True)
+
+    results = {}
+    for size in [parse_size(value) for value in args.sizes.split(',') if value]:
+        label = size_label(size)
+        input_path = generate_input(args, size)
+        print('SCALING: rendering %s nodes' % label, file=sys.stderr)
+        results[label] = render(args, input_path)
+        results[label]['nodes'] = size
+        print('SCALING: %s nodes: %.2f s, %.1f frames/s, %.0f events/s, %.1f MiB peak RSS' % (
+            label,
+            results[label]['wall_seconds'],
+            results[label]['frames_per_sec'],
+            results[label]['events_per_sec'],
+            results[label]['peak_rss_bytes'] / 2.0 ** 20), file=sys.stderr)
+
+    document = {
+        'machine': {
+            'platform': platform.platform(),
+            'processor': platform.processor(),
+            'cpus': os.cpu_count(),
+        },
+        'settings': {
+            'order': args.order,
+            'seed': args.seed,
+            'duration': args.duration,
+            'width': args.width,
+            'height': args.height,
+            'encode': args.encode,
+            'extra': args.extra,
+        },
+        'results': results,
+    }
+
+    for path in [args.output, args.save_baseline]:
+        if path:
+            with open(path, 'w') as f:
+                json.dump(document, f, indent=2, sort_keys=True)
+                f.write('\n')
+
+    if args.baseline:
+        with open(args.baseline, 'r') as f:
+            baseline = json.load(f)
+        if baseline.get('settings') != document['settings']:
+            print('SCALING: warning: baseline was recorded with different settings', file=sys.stderr)
+        regressions = compare(results, baseline, args)
+        if regressions:
+            print('SCALING: %d metric(s) regressed beyond tolerance' % len(regressions), file=sys.stderr)
+            return 1
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())